@@ -15,6 +15,8 @@
 #include <stdexcept>
 #include <chrono>
 #include <iostream>
+#include <array>
+#include <algorithm>
 
 #include "helper.h"
 #include "container.h"
@@ -25,27 +27,49 @@
 #include "descriptor.h"
 #include "graphicspipeline.h"
 #include "command.h"
-#include "depth.h"
-#include "framebuffer.h"
 #include "texture.h"
 #include "synchronization.h"
 #include "buffer.h"
+#include "bindless.h"
+#include "asynccompute.h"
+#include "atlas.h"
+#include "pipelinecache.h"
+#include "pipelinemanager.h"
+#include "shaderlibrary.h"
+#include "deletion.h"
+#include "rendergraph.h"
+#include "resolution.h"
+#include "recording.h"
+#include "commandcache.h"
+#include "pacing.h"
+#include "simulation.h"
+#include "resizestorm.h"
+#include "trace.h"
+#include "zones.h"
+#include "gpuprofiler.h"
+#include "batch.h"
+#include "benchmark.h"
+#include "inittasks.h"
+#include "options.h"
 
 class VulkanApplication {
 public:
     VulkanApplication() = delete;
     VulkanApplication(uint32_t width, uint32_t height, std::string appName);
+    void configure(int argc, char** argv);
     void run();
 private:
     void cleanup();
     void initVulkan();
     void initWindow();
+    bool keepRunning();
     void mainLoop();
     void drawFrame();
     void cleanupSwapchain();
     void updateUniformBuffer(scg::sDevice& s_device, scg::sSwapchain& s_swapchain, scg::sUniformBuffer& s_ubuf, uint32_t currentImage);
     void recreateSwapchain();
-    void recordCommandBuffer(uint32_t imageIndex);
+    scg::sPipelineKey selectDrawKey();
+    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, scg::sPipelineKey drawKey, VkExtent2D sceneExtent);
 
     scg::sInstance s_inst;
     scg::sDevice s_device;
@@ -53,22 +77,75 @@ private:
     scg::sRenderPass s_rpass;
     scg::sDescriptor s_descriptor;
     scg::sGraphicsPipeline s_gpipeline;
+    scg::sPipelineCache s_pcache;
+    scg::sPipelineManager s_pmanager;
+    scg::sShaderLibrary s_shaderlib;
+    scg::sDeletionQueue s_deletion;
     scg::sCommand s_command;
-    scg::sDepth s_depth;
-    scg::sFramebuffer s_fbuf;
+    scg::sCommandCache s_ccache;
+    scg::sRenderGraph s_graph;
+    scg::sDynamicResolution s_dres;
+    scg::sRecorder s_recorder;
     scg::sTexture s_texture;
     scg::sSynch s_synch;
+    scg::sFramePacing s_pacing;
+    scg::sSimulation s_sim;
+    scg::sResizeStorm s_storm;
+    scg::sBatchRender s_batch;
+    scg::sBenchmark s_bench;
+    scg::sTrace s_trace;
+    scg::sGpuProfiler s_gprof;
     scg::sUniformBuffer s_ubuf;
     scg::sGeometry s_geom;
+    scg::sAsyncCompute s_async;
+    scg::sMaterialTable s_mtable;
 
     bool framebufferResized{false};
+    bool presentModeChanged{false};
+    // the window is minimized and the swapchain waits for it to get a size again
+    bool swapchainOutdated{false};
     bool isAppleDevice{false};
     int currentFrame{0};
+    uint64_t frameCount{0};
+    // when the CPU work of the current frame started, after the wait for its slot
+    std::chrono::steady_clock::time_point frameCpuStart;
+    scg::sPipelineKey pipelineKey;
+    bool depthPrepass{false};
 
     static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
         auto app = reinterpret_cast<VulkanApplication*>(glfwGetWindowUserPointer(window));
         app->framebufferResized = true;
     }
+
+    // T toggles alpha testing, C back face culling and Z the depth prepass, variants compile in the background.
+    // P cycles the present mode, which takes a new swapchain
+    static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+        auto app = reinterpret_cast<VulkanApplication*>(glfwGetWindowUserPointer(window));
+        if (action != GLFW_PRESS) {
+            return;
+        }
+        if (key == GLFW_KEY_T) {
+            app->pipelineKey.alphaTest = !app->pipelineKey.alphaTest;
+        } else if (key == GLFW_KEY_C) {
+            app->pipelineKey.doubleSided = !app->pipelineKey.doubleSided;
+        } else if (key == GLFW_KEY_Z) {
+            app->depthPrepass = !app->depthPrepass;
+        } else if (key == GLFW_KEY_P) {
+            std::array<VkPresentModeKHR, 4> modes = {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR};
+            // modes the surface lacks would fall back to FIFO and the cycle would never leave it
+            std::vector<VkPresentModeKHR> available = scg::querySwapchainSupport(app->s_device.physicalDevice, app->s_inst.surface).presentModes;
+            size_t current = std::find(modes.begin(), modes.end(), app->s_swapchain.presentMode) - modes.begin();
+            current = std::min(current, modes.size() - 1);
+            for (size_t i = 1; i <= modes.size(); i++) {
+                VkPresentModeKHR next = modes[(current + i) % modes.size()];
+                if (std::find(available.begin(), available.end(), next) != available.end()) {
+                    app->s_inst.presentMode = next;
+                    break;
+                }
+            }
+            app->presentModeChanged = true;
+        }
+    }
 };
 
 VulkanApplication::VulkanApplication(uint32_t width, uint32_t height, std::string appName) {
@@ -87,52 +164,207 @@ VulkanApplication::VulkanApplication(uint32_t width, uint32_t height, std::strin
 #endif
 }
 
+void VulkanApplication::configure(int argc, char** argv) {
+    scg::parseCommandLine(argc, argv, s_inst);
+}
+
 void VulkanApplication::run() {
-    initWindow();
+    if (!s_inst.headless) {
+        initWindow();
+    }
     initVulkan();
     mainLoop();
     cleanup();
+
+    if (s_bench.regressed) {
+        throw std::runtime_error("benchmark regressed past the baseline threshold!");
+    }
+}
+
+// headless the loop only ends at the frame limit, otherwise whichever comes first
+bool VulkanApplication::keepRunning() {
+    if (s_inst.frameLimit != 0 && frameCount >= s_inst.frameLimit) {
+        return false;
+    }
+    return s_inst.headless || !glfwWindowShouldClose(s_inst.window);
 }
 
 void VulkanApplication::mainLoop() {
-    while (!glfwWindowShouldClose(s_inst.window)) {
-        glfwPollEvents();
+    auto loopStart = std::chrono::steady_clock::now();
+    while (keepRunning()) {
+        // nothing can be presented while minimized, so sleep until the next event instead of spinning
+        if (swapchainOutdated) {
+            glfwWaitEvents();
+            recreateSwapchain();
+            continue;
+        }
+
+        scg::waitBeforeInput(s_inst, s_device, s_synch, s_pacing, currentFrame);
+        if (!s_inst.headless) {
+            glfwPollEvents();
+        }
+        scg::sampleInput(s_pacing);
+        uint64_t frame = frameCount;
         drawFrame();
+        // a frame that had to recreate the swapchain instead is not counted
+        if (frameCount != frame) {
+            scg::noteBenchmarkFrame(s_bench, frame, frameCpuStart);
+        }
+        scg::stepResizeStorm(s_inst, s_storm);
     }
 
     vkDeviceWaitIdle(s_device.device);
+    scg::finishBatchRender(s_batch);
+    if (s_bench.enabled) {
+        for (int i = 0; i < s_inst.maxFramesInFlight; i++) {
+            scg::collectGpuProfilerFrame(s_device, s_command, s_trace, s_gprof, i);
+            scg::noteBenchmarkGpu(s_bench, s_gprof, i);
+        }
+        scg::finishBenchmark(s_device, s_bench);
+    }
+    if (s_inst.headless) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loopStart).count();
+        std::cout << "headless: rendered " << frameCount << " frames in " << seconds << " s, " << frameCount / seconds << " fps" << std::endl;
+    }
 }
 
 void VulkanApplication::initVulkan() {
+    scg::createTrace(s_inst, s_trace);
+    scg::enableZones(s_trace);
+    scg::nameZoneThread("main thread");
+    SCG_FUNCTION_ZONE();
     scg::createInstance(s_inst);
     if (s_inst.enableValidationLayers) {
         scg::setupDebugMessenger(s_inst.instance, s_inst.debugMessenger);
     }
-    scg::createSurface(s_inst);
+    if (!s_inst.headless) {
+        scg::createSurface(s_inst);
+    }
     scg::createDevice(s_inst, s_device);
-    scg::createSwapchain(s_inst, s_device, s_swapchain);
-    scg::createImageViews(s_device, s_swapchain);
-    scg::createRenderPass(s_device, s_swapchain, s_rpass);
-    scg::createDescriptorSetLayout(s_device, s_descriptor);
-    scg::createGraphicsPipeline(s_device, s_descriptor, s_rpass, s_gpipeline);
-    scg::createCommandPool(s_inst, s_device, s_command);
-    scg::createDepthResources(s_device, s_swapchain, s_depth);
-    scg::createFramebuffers(s_device, s_swapchain, s_rpass, s_depth, s_fbuf);
-    scg::createTextureImage(s_inst, s_device, s_command, s_texture);
-    scg::createTextureImageView(s_device, s_texture);
-    scg::createTextureSampler(s_device, s_texture);
-    std::cout << "completed creating command buffers" << std::endl;
-    scg::loadModel(s_inst, s_geom);
-    std::cout << "completed loading the obj model" << std::endl;
-    scg::createVertexBuffer(s_device, s_command, s_geom);
-    scg::createIndexBuffer(s_device, s_command, s_geom);
-    scg::createUniformBuffers(s_inst, s_device, s_ubuf);
-    scg::createDescriptorPool(s_inst, s_device, s_descriptor);
-    scg::createDescriptorSets(s_inst, s_device, s_descriptor, s_ubuf, s_texture);
-    std::cout << "completed creating descriptor sets" << std::endl;
-    scg::createCommandBuffers(s_inst, s_device, s_command);
-    scg::createSynchObjects(s_inst, s_device, s_synch);
-    std::cout << "completed synch objects" << std::endl;
+    s_descriptor.useBindless = s_device.descriptorIndexing;
+    std::cout << (s_descriptor.useBindless ? "using bindless material table" : "descriptor indexing unavailable, using per-texture descriptors") << "\n";
+
+    // every task lists the tasks whose results it reads, everything else may run at the same time
+    scg::sInitGraph s_init;
+    scg::addInitTask(s_init, "swapchain", {}, [this]() {
+        if (s_inst.headless) {
+            scg::createOffscreenTargets(s_inst, s_device, s_swapchain);
+        } else {
+            scg::createSwapchain(s_inst, s_device, s_swapchain);
+            scg::createImageViews(s_device, s_swapchain);
+        }
+    });
+    scg::addInitTask(s_init, "render pass", {"swapchain"}, [this]() {
+        s_rpass.samples = scg::selectSampleCount(s_device, s_inst.msaaSamples);
+        scg::createRenderPass(s_device, s_swapchain, s_rpass);
+    });
+    scg::addInitTask(s_init, "descriptor set layouts", {}, [this]() {
+        scg::createDescriptorSetLayout(s_device, s_descriptor);
+        if (s_descriptor.useBindless) {
+            scg::createBindlessDescriptorSetLayout(s_device, s_descriptor);
+        }
+    });
+    scg::addInitTask(s_init, "pipeline cache", {}, [this]() {
+        scg::createPipelineCache(s_inst, s_device, s_pcache);
+    });
+    scg::addInitTask(s_init, "shader library", {}, [this]() {
+        scg::createShaderLibrary(s_inst, s_device, s_descriptor, s_shaderlib, s_gpipeline);
+    });
+    scg::addInitTask(s_init, "graphics pipeline", {"render pass", "descriptor set layouts", "pipeline cache", "shader library"}, [this]() {
+        s_gpipeline.defaultKey.alphaTest = s_inst.alphaTest;
+        s_gpipeline.defaultKey.doubleSided = s_inst.doubleSided;
+        s_gpipeline.defaultKey.samples = s_rpass.samples;
+        s_gpipeline.reversedZ = s_inst.reversedZ;
+        pipelineKey = s_gpipeline.defaultKey;
+        depthPrepass = s_inst.depthPrepass;
+        scg::createGraphicsPipeline(s_device, s_descriptor, s_rpass, s_pcache, s_gpipeline);
+        scg::createDepthPipelines(s_device, s_rpass, s_pcache, s_gpipeline);
+    });
+    // adds the upscale shaders to the library, so it must not overlap anything else that does
+    scg::addInitTask(s_init, "dynamic resolution", {"render pass", "pipeline cache", "shader library"}, [this]() {
+        if (s_inst.enableDynamicResolution) {
+            scg::createDynamicResolution(s_inst, s_device, s_rpass, s_pcache, s_shaderlib, s_dres);
+        }
+    });
+    scg::addInitTask(s_init, "pipeline manager", {"graphics pipeline"}, [this]() {
+        scg::startPipelineManager(s_inst, s_device, s_rpass, s_pcache, s_gpipeline, s_pmanager);
+        // warm the variants the keyboard toggles can reach
+        for (uint32_t toggles = 1; toggles < 8; toggles++) {
+            scg::sPipelineKey key = pipelineKey;
+            key.alphaTest ^= (toggles & 1) != 0;
+            key.doubleSided ^= (toggles & 2) != 0;
+            key.depthPrepass ^= (toggles & 4) != 0;
+            if (!(key.alphaTest && key.depthPrepass)) {
+                scg::requestPipeline(s_gpipeline, s_pmanager, key);
+            }
+        }
+    });
+    scg::addInitTask(s_init, "command pool", {}, [this]() {
+        scg::createCommandPool(s_device, s_command);
+    });
+    // uploads are timed once the profiler exists, so every upload waits for it
+    scg::addInitTask(s_init, "gpu profiler", {"command pool"}, [this]() {
+        scg::createGpuProfiler(s_inst, s_device, s_command, s_trace, s_gprof);
+    });
+    scg::addInitTask(s_init, "texture", {"gpu profiler"}, [this]() {
+        scg::createTextureImage(s_inst, s_device, s_command, s_texture);
+        scg::createTextureImageView(s_device, s_texture);
+    });
+    scg::addInitTask(s_init, "texture sampler", {}, [this]() {
+        scg::createTextureSampler(s_device, s_texture);
+    });
+    scg::addInitTask(s_init, "model", {}, [this]() {
+        scg::loadModel(s_inst, s_geom, s_mtable);
+        // the atlas rewrites texcoords, which only the bindless shaders know how to sample
+        if (s_descriptor.useBindless && s_inst.enableAtlas) {
+            scg::buildTextureAtlas(s_inst, s_geom, s_mtable);
+        }
+        s_recorder.draws = scg::splitDrawRanges(s_geom.drawRanges, s_inst.syntheticDrawCount);
+    });
+    scg::addInitTask(s_init, "geometry buffers", {"model", "gpu profiler"}, [this]() {
+        scg::createVertexBuffer(s_device, s_command, s_geom);
+        scg::createPositionBuffer(s_device, s_command, s_geom);
+        scg::createIndexBuffer(s_device, s_command, s_geom);
+    });
+    scg::addInitTask(s_init, "uniform buffers", {}, [this]() {
+        scg::createUniformBuffers(s_inst, s_device, s_ubuf);
+    });
+    scg::addInitTask(s_init, "descriptor sets", {"descriptor set layouts", "uniform buffers", "texture", "texture sampler"}, [this]() {
+        scg::createDescriptorAllocators(s_inst, s_descriptor);
+        scg::createDescriptorSets(s_inst, s_device, s_descriptor, s_ubuf, s_texture);
+    });
+    // the bindless set has its own pool, so it does not wait for the per-texture sets
+    scg::addInitTask(s_init, "material table", {"model", "descriptor set layouts", "texture", "texture sampler", "gpu profiler"}, [this]() {
+        if (s_descriptor.useBindless) {
+            scg::createMaterialTextures(s_device, s_command, s_mtable);
+            scg::createMaterialBuffer(s_device, s_command, s_mtable);
+            scg::createIndirectBuffer(s_device, s_command, s_geom, s_mtable);
+            scg::createBindlessDescriptorPool(s_device, s_descriptor);
+            scg::createBindlessDescriptorSet(s_device, s_descriptor, s_texture, s_mtable);
+        }
+    });
+    // acquires the culling shader, so it follows the other task that adds to the library
+    scg::addInitTask(s_init, "gpu culling", {"model", "gpu profiler", "pipeline cache", "dynamic resolution"}, [this]() {
+        scg::createAsyncCompute(s_inst, s_device, s_command, s_pcache, s_shaderlib, s_geom, s_recorder.draws, s_async);
+    });
+    scg::addInitTask(s_init, "command buffers", {"command pool", "swapchain"}, [this]() {
+        scg::createCommandBuffers(s_inst, s_device, s_command);
+        scg::createCommandCache(s_inst, s_device, s_swapchain, s_command, s_ccache);
+    });
+    scg::addInitTask(s_init, "recorder", {}, [this]() {
+        scg::createRecorder(s_inst, s_device, s_recorder);
+    });
+    scg::addInitTask(s_init, "synch objects", {}, [this]() {
+        scg::createSynchObjects(s_inst, s_device, s_synch);
+    });
+    scg::runInitGraph(s_inst, s_init);
+
+    scg::createFramePacing(s_inst, s_pacing);
+    scg::startSimulation(s_inst, s_sim);
+    scg::createResizeStorm(s_inst, s_storm);
+    scg::createBatchRender(s_inst, s_device, s_swapchain, s_batch);
+    scg::createBenchmark(s_inst, s_bench);
+    scg::reportInitGraph(s_init);
 }
 
 // no resizing for now
@@ -145,37 +377,79 @@ void VulkanApplication::initWindow() {
     glfwSetWindowUserPointer(s_inst.window, this);
 
     glfwSetFramebufferSizeCallback(s_inst.window, framebufferResizeCallback);
+    glfwSetKeyCallback(s_inst.window, keyCallback);
 }
 
+// The old swapchain is handed to the new one and everything built on its images is retired
+// through the deletion queue, so frames in flight finish on the old images while the next frame
+// already renders to the new ones and the GPU never has to drain.
 void VulkanApplication::recreateSwapchain() {
+    SCG_FUNCTION_ZONE();
+    // the offscreen targets keep their size
+    if (s_inst.headless) {
+        return;
+    }
     int width = 0, height = 0;
     glfwGetFramebufferSize(s_inst.window, &width, &height);
-    while (width == 0 || height == 0) {
-        glfwGetFramebufferSize(s_inst.window, &width, &height);
-        glfwWaitEvents();
+    if (width == 0 || height == 0) {
+        swapchainOutdated = true;
+        return;
     }
+    swapchainOutdated = false;
 
-    vkDeviceWaitIdle(s_device.device);
-
-    cleanupSwapchain();
+    auto recreateStart = std::chrono::high_resolution_clock::now();
+    if (s_inst.waitIdleOnResize) {
+        vkDeviceWaitIdle(s_device.device);
+    }
 
+    // the last frame on the old images has been submitted, the next submission renders to the new ones
+    uint64_t retireValue = scg::getPendingTimelineValue(s_device);
+    scg::sSwapchain oldSwapchain = s_swapchain;
     scg::createSwapchain(s_inst, s_device, s_swapchain);
     scg::createImageViews(s_device, s_swapchain);
-    scg::createDepthResources(s_device, s_swapchain, s_depth);
-    scg::createFramebuffers(s_device, s_swapchain, s_rpass, s_depth, s_fbuf);
+    scg::retireSwapchain(s_device, oldSwapchain, s_deletion, retireValue);
+
+    // the cached framebuffers and the transient depth buffer follow the swapchain extent
+    scg::retireRenderGraph(s_device, s_graph, s_deletion, retireValue);
+
+    // the cached buffers reference the old images, and the image count may have changed
+    scg::retireCommandCache(s_device, s_command, s_ccache, s_deletion, retireValue);
+    scg::createCommandCache(s_inst, s_device, s_swapchain, s_command, s_ccache);
+
+    auto recreateEnd = std::chrono::high_resolution_clock::now();
+    scg::noteSwapchainRecreate(s_storm, std::chrono::duration<double, std::milli>(recreateEnd - recreateStart).count());
 }
 
 void VulkanApplication::updateUniformBuffer(scg::sDevice& s_device, scg::sSwapchain& s_swapchain, scg::sUniformBuffer& s_ubuf, uint32_t currentImage) {
+    SCG_FUNCTION_ZONE();
     static auto startTime = std::chrono::high_resolution_clock::now();
 
-    auto currentTime = std::chrono::high_resolution_clock::now();
-    float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+    // with the update thread the newest published state is used as is, otherwise it is computed here,
+    // and a sequence follows its camera path frame by frame regardless of how long frames take
+    scg::sSimulationState state;
+    if (s_batch.enabled) {
+        scg::sequenceState(s_batch, frameCount, state);
+    } else if (s_bench.enabled) {
+        scg::simulate(state, scg::benchmarkTime(s_bench, frameCount));
+    } else if (s_sim.enabled) {
+        state = scg::acquireLatestState(s_sim.buffer);
+    } else {
+        auto currentTime = std::chrono::high_resolution_clock::now();
+        float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+        scg::simulate(state, time);
+    }
 
     scg::UniformBufferObject ubo{};
-    ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    ubo.proj = glm::perspective(glm::radians(45.0f), s_swapchain.swapchainExtent.width / (float) s_swapchain.swapchainExtent.height, 0.1f, 10.0f);
+    ubo.model = state.model;
+    ubo.view = state.view;
+    float aspect = s_swapchain.swapchainExtent.width / (float) s_swapchain.swapchainExtent.height;
+    if (s_inst.reversedZ) {
+        ubo.proj = scg::reversedInfinitePerspective(glm::radians(45.0f), aspect, 0.1f);
+    } else {
+        ubo.proj = glm::perspective(glm::radians(45.0f), aspect, 0.1f, 10.0f);
+    }
     ubo.proj[1][1] *= -1;
+    scg::updateCullParams(s_async, ubo.proj * ubo.view * ubo.model, currentImage);
 
     void* data;
     vkMapMemory(s_device.device, s_ubuf.uniformBuffersMemory[currentImage], 0, sizeof(ubo), 0, &data);
@@ -185,10 +459,29 @@ void VulkanApplication::updateUniformBuffer(scg::sDevice& s_device, scg::sSwapch
 
 // (scg::sDevice& s_device, scg::sSwapchain& s_swapchain, scg::sCommand& s_command, scg::sUniformBuffer& s_ubuf, scg::sSynchronization& s_synch)
 void VulkanApplication::drawFrame() {
-    vkWaitForFences(s_device.device, 1, &(s_synch.inFlightFences[currentFrame]), VK_TRUE, UINT64_MAX);
-
-    uint32_t imageIndex;
-    VkResult result = vkAcquireNextImageKHR(s_device.device, s_swapchain.swapchain, UINT64_MAX, s_synch.imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+    SCG_FUNCTION_ZONE();
+    {
+        SCG_ZONE("wait for frame");
+        scg::waitForFrame(s_device, s_synch, currentFrame);
+    }
+    frameCpuStart = std::chrono::steady_clock::now();
+    scg::collectGpuProfilerFrame(s_device, s_command, s_trace, s_gprof, currentFrame);
+    scg::noteBenchmarkGpu(s_bench, s_gprof, currentFrame);
+
+    // anything retired at or before the completed timeline value is no longer in use
+    scg::flushDeletionQueue(s_deletion, scg::getCompletedTimelineValue(s_device));
+    scg::trimRetiredPipelines(s_device, s_pmanager, scg::getPendingTimelineValue(s_device), scg::getCompletedTimelineValue(s_device));
+    scg::updateDynamicResolution(s_device, s_dres, currentFrame);
+    scg::applyShaderReload(s_device, s_gpipeline, s_pmanager, s_shaderlib, s_deletion, scg::getPendingTimelineValue(s_device));
+    scg::pollShaderChanges(s_device, s_rpass, s_pcache, s_gpipeline, s_pmanager, s_shaderlib);
+
+    // headless every frame in flight owns its image and nothing has to be acquired
+    uint32_t imageIndex = static_cast<uint32_t>(currentFrame);
+    VkResult result = VK_SUCCESS;
+    if (!s_inst.headless) {
+        SCG_ZONE("acquire");
+        result = vkAcquireNextImageKHR(s_device.device, s_swapchain.swapchain, UINT64_MAX, s_synch.imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+    }
 
     if (result == VK_ERROR_OUT_OF_DATE_KHR) {
         // get this method
@@ -199,37 +492,62 @@ void VulkanApplication::drawFrame() {
     }
 
     updateUniformBuffer(s_device, s_swapchain, s_ubuf, currentFrame);
+    if (s_batch.enabled) {
+        scg::acquireReadbackSlot(s_batch, frameCount, scg::getCompletedTimelineValue(s_device));
+    }
 
-    vkResetFences(s_device.device, 1, &(s_synch.inFlightFences[currentFrame]));
-
-    vkResetCommandBuffer(s_command.commandBuffers[currentFrame], /*VkCommandBufferResetFlagBits*/ 0);
-    recordCommandBuffer(imageIndex);
-
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-    VkSemaphore waitSemaphores[] = {s_synch.imageAvailableSemaphores[currentFrame]};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphores;
-    submitInfo.pWaitDstStageMask = waitStages;
-
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &(s_command.commandBuffers[currentFrame]);
+    // what the recording depends on is settled first, a cached command buffer is reused only when it matches
+    scg::sPipelineKey drawKey = selectDrawKey();
+    VkExtent2D sceneExtent = scg::getRenderExtent(s_dres, s_swapchain.swapchainExtent);
+
+    // on its own queue the culling can start while the previous frame still rasterizes
+    VkSemaphore cullSemaphore = scg::submitCulling(s_device, s_async, currentFrame);
+
+    auto recordStart = std::chrono::steady_clock::now();
+    VkCommandBuffer commandBuffer = s_command.commandBuffers[currentFrame];
+    bool needsRecording = true;
+    if (s_ccache.enabled) {
+        scg::sCommandState state{};
+        state.key = drawKey.pack();
+        state.pipeline = scg::getPipeline(s_gpipeline, s_pmanager, drawKey);
+        state.depthPipeline = drawKey.depthPrepass ? s_gpipeline.depthPipelines[drawKey.doubleSided ? 1 : 0] : VK_NULL_HANDLE;
+        state.sceneExtent = sceneExtent;
+        scg::updateCommandState(s_ccache, state);
+        commandBuffer = scg::getCachedCommandBuffer(s_ccache, currentFrame, imageIndex, needsRecording);
+    }
+    if (needsRecording) {
+        SCG_ZONE("record");
+        vkResetCommandBuffer(commandBuffer, /*VkCommandBufferResetFlagBits*/ 0);
+        recordCommandBuffer(commandBuffer, imageIndex, drawKey, sceneExtent);
+    }
+    auto recordEnd = std::chrono::steady_clock::now();
+    if (!s_recorder.workers.empty() || s_inst.syntheticDrawCount != 0 || s_ccache.enabled) {
+        scg::reportRecordTime(s_recorder, std::chrono::duration<double, std::milli>(recordEnd - recordStart).count());
+    }
 
-    VkSemaphore signalSemaphores[] = {(s_synch.renderFinishedSemaphores[currentFrame])};
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = signalSemaphores;
+    {
+        SCG_ZONE("submit");
+        scg::submitFrame(s_device, s_synch, currentFrame, commandBuffer, cullSemaphore);
+    }
+    scg::submitGpuFrame(s_dres, currentFrame);
+    scg::submitGpuProfilerFrame(s_gprof, currentFrame);
+    scg::submitFrameLatency(s_pacing, currentFrame);
+    scg::noteBenchmarkSubmit(s_bench, currentFrame, frameCount);
+    if (s_batch.enabled) {
+        scg::submitReadback(s_batch, s_synch.frameTimelineValues[currentFrame]);
+    }
 
-    if (vkQueueSubmit(s_device.graphicsQueue, 1, &submitInfo, s_synch.inFlightFences[currentFrame]) != VK_SUCCESS) {
-        throw std::runtime_error("failed to submit draw command buffer!");
+    if (s_inst.headless) {
+        currentFrame = (currentFrame + 1) % s_inst.maxFramesInFlight;
+        frameCount++;
+        return;
     }
 
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
     presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = signalSemaphores;
+    presentInfo.pWaitSemaphores = &(s_synch.renderFinishedSemaphores[currentFrame]);
 
     VkSwapchainKHR swapchains[] = {s_swapchain.swapchain};
     presentInfo.swapchainCount = 1;
@@ -237,10 +555,14 @@ void VulkanApplication::drawFrame() {
 
     presentInfo.pImageIndices = &imageIndex;
 
-    result = vkQueuePresentKHR(s_device.presentQueue, &presentInfo);
+    {
+        SCG_ZONE("present");
+        result = vkQueuePresentKHR(s_device.presentQueue, &presentInfo);
+    }
 
-    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized) {
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized || presentModeChanged) {
         framebufferResized = false;
+        presentModeChanged = false;
         // get this method
         recreateSwapchain();
     } else if (result != VK_SUCCESS) {
@@ -248,73 +570,200 @@ void VulkanApplication::drawFrame() {
     }
 
     currentFrame = (currentFrame + 1) % s_inst.maxFramesInFlight;
+    frameCount++;
+}
+
+// discards need the fragment shader, so alpha tested frames skip the prepass, and so does any
+// frame before the EQUAL variant has compiled since the default pipeline writes depth
+scg::sPipelineKey VulkanApplication::selectDrawKey() {
+    scg::sPipelineKey drawKey = pipelineKey;
+    drawKey.depthPrepass = depthPrepass && !drawKey.alphaTest;
+    if (drawKey.depthPrepass && !scg::hasPipeline(s_gpipeline, s_pmanager, drawKey)) {
+        drawKey.depthPrepass = false;
+    }
+    return drawKey;
 }
 
-// s_swapchain, s_rpass, s_command, s_fbuf
-void VulkanApplication::recordCommandBuffer(uint32_t imageIndex) {
+// the frame is declared as a render graph, which places the barriers and owns the depth buffer
+void VulkanApplication::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, scg::sPipelineKey drawKey, VkExtent2D sceneExtent) {
     VkCommandBufferBeginInfo beginInfo{};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
-    if (vkBeginCommandBuffer(s_command.commandBuffers[currentFrame], &beginInfo) != VK_SUCCESS) {
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
         throw std::runtime_error("failed to begin recording command buffer!");
     }
+    // each cached command buffer binds the sets of its own chain
+    uint32_t chain = s_ccache.enabled ? imageIndex : 0;
+    scg::beginTransientDescriptors(s_device, s_descriptor, currentFrame, chain);
+    scg::beginGpuFrame(commandBuffer, s_dres, currentFrame);
+    scg::beginGpuProfilerFrame(commandBuffer, s_gprof, currentFrame);
+    scg::beginGpuScope(commandBuffer, s_gprof, currentFrame, "frame");
+
+    if (s_async.enabled && !s_async.separateQueue) {
+        scg::beginGpuScope(commandBuffer, s_gprof, currentFrame, "culling");
+        scg::recordCulling(commandBuffer, s_async, currentFrame);
+        scg::endGpuScope(commandBuffer, s_gprof, currentFrame);
+    }
 
-    VkRenderPassBeginInfo renderPassInfo{};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = s_rpass.renderPass;
-    renderPassInfo.framebuffer = s_fbuf.swapchainFramebuffers[imageIndex];
-    renderPassInfo.renderArea.offset = {0, 0};
-    renderPassInfo.renderArea.extent = s_swapchain.swapchainExtent;
+    scg::resetRenderGraph(s_graph);
 
-    std::array<VkClearValue, 2> clearValues{};
-    clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
-    clearValues[1].depthStencil = {1.0f, 0};
+    // the acquire semaphore is waited on at COLOR_ATTACHMENT_OUTPUT, the old contents are discarded,
+    // headless the frame that last used the image has completed before this one was recorded
+    scg::sGraphResourceState acquired{};
+    acquired.writeStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    uint32_t backbuffer = scg::importImage(s_graph, "backbuffer", s_swapchain.swapchainImages[imageIndex], s_swapchain.swapchainImageViews[imageIndex],
+            s_swapchain.swapchainImageFormat, s_swapchain.swapchainExtent, VK_IMAGE_ASPECT_COLOR_BIT, acquired, s_swapchain.finalLayout);
 
-    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-    renderPassInfo.pClearValues = clearValues.data();
+    VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+    if (scg::hasStencilComponent(s_rpass.depthFormat)) {
+        depthAspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+    }
+    uint32_t depth = scg::createTransientImage(s_graph, "depth", s_rpass.depthFormat, s_swapchain.swapchainExtent, s_rpass.samples, depthAspect);
+    VkClearDepthStencilValue depthClear = {s_inst.reversedZ ? 0.0f : 1.0f, 0};
+
+    // with dynamic resolution the scene goes to the corner of a swapchain sized target first, so
+    // a new scale only changes the render area and never reallocates
+    uint32_t scene = backbuffer;
+    if (s_dres.enabled) {
+        scene = scg::createTransientImage(s_graph, "scene", s_swapchain.swapchainImageFormat, s_swapchain.swapchainExtent, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+    }
 
-    vkCmdBeginRenderPass(s_command.commandBuffers[currentFrame], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    // the multisampled color only lives inside the forward pass, the graph makes it a lazily
+    // allocated transient attachment that is never stored
+    uint32_t sceneColor = scene;
+    if (s_rpass.samples != VK_SAMPLE_COUNT_1_BIT) {
+        sceneColor = scg::createTransientImage(s_graph, "msaa-color", s_swapchain.swapchainImageFormat, s_swapchain.swapchainExtent, s_rpass.samples, VK_IMAGE_ASPECT_COLOR_BIT);
+    }
 
-    vkCmdBindPipeline(s_command.commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, s_gpipeline.graphicsPipeline);
+    auto setViewportAndScissor = [sceneExtent](VkCommandBuffer commandBuffer) {
+        VkViewport viewport{};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = (float) sceneExtent.width;
+        viewport.height = (float) sceneExtent.height;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor{};
+        scissor.offset = {0, 0};
+        scissor.extent = sceneExtent;
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    };
+
+    if (drawKey.depthPrepass) {
+        uint32_t prepass = scg::addPass(s_graph, "depth-prepass", [this, drawKey, setViewportAndScissor](VkCommandBuffer commandBuffer) {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, s_gpipeline.depthPipelines[drawKey.doubleSided ? 1 : 0]);
+            setViewportAndScissor(commandBuffer);
+
+            VkBuffer positionBuffers[] = {s_geom.positionBuffer};
+            VkDeviceSize offsets[] = {0};
+            vkCmdBindVertexBuffers(commandBuffer, 0, 1, positionBuffers, offsets);
+            vkCmdBindIndexBuffer(commandBuffer, s_geom.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, s_gpipeline.pipelineLayout, 0, 1, &(s_descriptor.descriptorSets[currentFrame]), 0, nullptr);
+
+            // materials do not matter for depth, the whole mesh is one draw
+            vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(s_geom.indices.size()), 1, 0, 0, 0);
+        });
+        scg::writeDepth(s_graph, prepass, depth, VK_ATTACHMENT_LOAD_OP_CLEAR, depthClear);
+        scg::setRenderArea(s_graph, prepass, sceneExtent);
+    }
 
-    VkViewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = (float) s_swapchain.swapchainExtent.width;
-    viewport.height = (float) s_swapchain.swapchainExtent.height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-    vkCmdSetViewport(s_command.commandBuffers[currentFrame], 0, 1, &viewport);
+    // everything a forward draw needs bound, recorded again at the start of every secondary command buffer
+    VkPipeline forwardPipeline = scg::getPipeline(s_gpipeline, s_pmanager, drawKey);
+    auto bindForwardState = [this, forwardPipeline, setViewportAndScissor](VkCommandBuffer commandBuffer) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, forwardPipeline);
+        setViewportAndScissor(commandBuffer);
 
-    VkRect2D scissor{};
-    scissor.offset = {0, 0};
-    scissor.extent = s_swapchain.swapchainExtent;
-    vkCmdSetScissor(s_command.commandBuffers[currentFrame], 0, 1, &scissor);
+        VkBuffer vertexBuffers[] = {s_geom.vertexBuffer};
+        VkDeviceSize offsets[] = {0};
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
 
-    VkBuffer vertexBuffers[] = {s_geom.vertexBuffer};
-    VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(s_command.commandBuffers[currentFrame], 0, 1, vertexBuffers, offsets);
+        vkCmdBindIndexBuffer(commandBuffer, s_geom.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
 
-    vkCmdBindIndexBuffer(s_command.commandBuffers[currentFrame], s_geom.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, s_gpipeline.pipelineLayout, 0, 1, &(s_descriptor.descriptorSets[currentFrame]), 0, nullptr);
 
-    vkCmdBindDescriptorSets(s_command.commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, s_gpipeline.pipelineLayout, 0, 1, &(s_descriptor.descriptorSets[currentFrame]), 0, nullptr);
+        if (s_descriptor.useBindless) {
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, s_gpipeline.pipelineLayout, 1, 1, &(s_descriptor.bindlessSet), 0, nullptr);
+        }
+    };
+    // the material index rides in firstInstance, as it does for the indirect draws
+    auto drawSlice = [this](VkCommandBuffer commandBuffer, uint32_t first, uint32_t last) {
+        for (uint32_t i = first; i < last; i++) {
+            const scg::sDrawRange& draw = s_recorder.draws[i];
+            vkCmdDrawIndexed(commandBuffer, draw.indexCount, 1, draw.firstIndex, 0, draw.materialIndex);
+        }
+    };
+
+    // cached primaries outlive a frame, the workers' per-frame pools would reset their secondaries under them
+    // and culled draws are a single indirect call
+    bool parallelRecording = !s_recorder.workers.empty() && !s_ccache.enabled && !s_async.enabled;
+    uint32_t forward = scg::addPass(s_graph, "forward", [this, parallelRecording, bindForwardState, drawSlice](VkCommandBuffer commandBuffer) {
+        if (parallelRecording) {
+            scg::recordInParallel(s_recorder, currentFrame, scg::getInheritanceInfo(s_graph), [bindForwardState, drawSlice](VkCommandBuffer secondary, uint32_t first, uint32_t last) {
+                bindForwardState(secondary);
+                drawSlice(secondary, first, last);
+            }, commandBuffer);
+            return;
+        }
 
-    vkCmdDrawIndexed(s_command.commandBuffers[currentFrame], static_cast<uint32_t>(s_geom.indices.size()), 1, 0, 0, 0);
+        bindForwardState(commandBuffer);
+        if (s_async.enabled) {
+            scg::recordCulledDraws(commandBuffer, s_async, currentFrame);
+        } else if (s_inst.syntheticDrawCount != 0) {
+            drawSlice(commandBuffer, 0, static_cast<uint32_t>(s_recorder.draws.size()));
+        } else if (s_descriptor.useBindless) {
+            scg::recordBindlessDraws(commandBuffer, s_device, s_geom, s_mtable);
+        } else {
+            vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(s_geom.indices.size()), 1, 0, 0, 0);
+        }
+    });
+    if (parallelRecording) {
+        scg::useSecondaryCommandBuffers(s_graph, forward);
+    }
+    scg::writeColor(s_graph, forward, sceneColor, VK_ATTACHMENT_LOAD_OP_CLEAR, {{0.0f, 0.0f, 0.0f, 1.0f}});
+    if (sceneColor != scene) {
+        scg::resolveColor(s_graph, forward, scene);
+    }
+    if (drawKey.depthPrepass) {
+        scg::readDepth(s_graph, forward, depth);
+    } else {
+        scg::writeDepth(s_graph, forward, depth, VK_ATTACHMENT_LOAD_OP_CLEAR, depthClear);
+    }
+    scg::setRenderArea(s_graph, forward, sceneExtent);
+
+    if (s_dres.enabled) {
+        uint32_t upscale = scg::addPass(s_graph, "upscale", [this, scene, sceneExtent, chain](VkCommandBuffer commandBuffer) {
+            scg::recordUpscale(commandBuffer, s_device, s_descriptor, s_dres, currentFrame, chain, scg::getImageView(s_graph, scene), sceneExtent, s_swapchain.swapchainExtent);
+        });
+        scg::readImage(s_graph, upscale, scene, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+        scg::writeColor(s_graph, upscale, backbuffer, VK_ATTACHMENT_LOAD_OP_DONT_CARE, {});
+    }
+
+    scg::compileRenderGraph(s_device, s_graph, s_deletion, scg::getPendingTimelineValue(s_device));
+    scg::executeRenderGraph(s_graph, commandBuffer, s_gprof, currentFrame);
 
-    vkCmdEndRenderPass(s_command.commandBuffers[currentFrame]);
+    if (s_batch.enabled) {
+        scg::beginGpuScope(commandBuffer, s_gprof, currentFrame, "readback");
+        scg::recordReadback(commandBuffer, s_batch, s_swapchain.swapchainImages[imageIndex]);
+        scg::endGpuScope(commandBuffer, s_gprof, currentFrame);
+    }
 
-    if (vkEndCommandBuffer(s_command.commandBuffers[currentFrame]) != VK_SUCCESS) {
+    scg::endGpuScope(commandBuffer, s_gprof, currentFrame);
+    scg::endGpuFrame(commandBuffer, s_dres, currentFrame);
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
         throw std::runtime_error("failed to record command buffer!");
     }
 }
 
+// only at exit, with the device idle
 void VulkanApplication::cleanupSwapchain() {
-    vkDestroyImageView(s_device.device, s_depth.depthImageView, nullptr);
-    vkDestroyImage(s_device.device, s_depth.depthImage, nullptr);
-    vkFreeMemory(s_device.device, s_depth.depthImageMemory, nullptr);
+    scg::invalidateRenderGraph(s_device, s_graph);
 
-    for (auto framebuffer : s_fbuf.swapchainFramebuffers) {
-        vkDestroyFramebuffer(s_device.device, framebuffer, nullptr);
+    if (s_inst.headless) {
+        scg::destroyOffscreenTargets(s_device, s_swapchain);
+        return;
     }
 
     for (auto imageView : s_swapchain.swapchainImageViews) {
@@ -325,18 +774,41 @@ void VulkanApplication::cleanupSwapchain() {
 }
 
 void VulkanApplication::cleanup() {
+    scg::stopSimulation(s_sim);
+    // the device is idle, the frames still in flight have completed
+    for (int i = 0; i < s_inst.maxFramesInFlight; i++) {
+        scg::collectGpuProfilerFrame(s_device, s_command, s_trace, s_gprof, i);
+    }
+    scg::collectZones(s_trace);
+    scg::writeTrace(s_trace);
     cleanupSwapchain();
 
+    scg::destroyRecorder(s_device, s_recorder);
+    scg::destroyBatchRender(s_device, s_batch);
+    scg::destroyAsyncCompute(s_device, s_async);
+    scg::stopPipelineManager(s_device, s_pmanager);
     vkDestroyPipeline(s_device.device, s_gpipeline.graphicsPipeline, nullptr);
+    for (auto pipeline : s_gpipeline.depthPipelines) {
+        vkDestroyPipeline(s_device.device, pipeline, nullptr);
+    }
+    scg::destroyDynamicResolution(s_device, s_dres);
+    scg::destroyGpuProfiler(s_device, s_command, s_gprof);
+    scg::drainDeletionQueue(s_deletion);
+    scg::destroyShaderLibrary(s_device, s_shaderlib);
+    scg::savePipelineCache(s_inst, s_device, s_pcache);
+    scg::destroyPipelineCache(s_device, s_pcache);
+    scg::destroyRenderGraph(s_device, s_graph);
     vkDestroyPipelineLayout(s_device.device, s_gpipeline.pipelineLayout, nullptr);
     vkDestroyRenderPass(s_device.device, s_rpass.renderPass, nullptr);
+    vkDestroyRenderPass(s_device.device, s_rpass.depthRenderPass, nullptr);
+    vkDestroyRenderPass(s_device.device, s_rpass.colorRenderPass, nullptr);
 
     for (size_t i = 0; i < s_inst.maxFramesInFlight; i++) {
             vkDestroyBuffer(s_device.device, s_ubuf.uniformBuffers[i], nullptr);
             vkFreeMemory(s_device.device, s_ubuf.uniformBuffersMemory[i], nullptr);
         }
 
-    vkDestroyDescriptorPool(s_device.device, s_descriptor.descriptorPool, nullptr);
+    scg::destroyDescriptorAllocators(s_device, s_descriptor);
 
     vkDestroySampler(s_device.device, s_texture.textureSampler, nullptr);
     vkDestroyImageView(s_device.device, s_texture.textureImageView, nullptr);
@@ -345,16 +817,28 @@ void VulkanApplication::cleanup() {
 
     vkDestroyDescriptorSetLayout(s_device.device, s_descriptor.descriptorSetLayout, nullptr);
 
+    if (s_descriptor.useBindless) {
+        scg::destroyBindless(s_device, s_descriptor, s_mtable);
+    }
+
     vkDestroyBuffer(s_device.device, s_geom.indexBuffer, nullptr);
     vkFreeMemory(s_device.device, s_geom.indexBufferMemory, nullptr);
 
     vkDestroyBuffer(s_device.device, s_geom.vertexBuffer, nullptr);
     vkFreeMemory(s_device.device, s_geom.vertexBufferMemory, nullptr);
 
+    vkDestroyBuffer(s_device.device, s_geom.positionBuffer, nullptr);
+    vkFreeMemory(s_device.device, s_geom.positionBufferMemory, nullptr);
+
     for (size_t i = 0; i < s_inst.maxFramesInFlight; i++) {
         vkDestroySemaphore(s_device.device, s_synch.renderFinishedSemaphores[i], nullptr);
         vkDestroySemaphore(s_device.device, s_synch.imageAvailableSemaphores[i], nullptr);
-        vkDestroyFence(s_device.device, s_synch.inFlightFences[i], nullptr);
+        if (s_synch.inFlightFences[i] != VK_NULL_HANDLE) {
+            vkDestroyFence(s_device.device, s_synch.inFlightFences[i], nullptr);
+        }
+    }
+    if (s_device.timelineSemaphore) {
+        vkDestroySemaphore(s_device.device, s_device.graphicsTimeline, nullptr);
     }
     
     vkDestroyCommandPool(s_device.device, s_command.commandPool, nullptr);
@@ -365,6 +849,11 @@ void VulkanApplication::cleanup() {
         scg::DestroyDebugUtilsMessengerEXT(s_inst.instance, s_inst.debugMessenger, nullptr);
     }
 
+    if (s_inst.headless) {
+        vkDestroyInstance(s_inst.instance, nullptr);
+        return;
+    }
+
     vkDestroySurfaceKHR(s_inst.instance, s_inst.surface, nullptr);
     vkDestroyInstance(s_inst.instance, nullptr);
 
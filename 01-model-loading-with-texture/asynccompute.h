@@ -0,0 +1,353 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#include "container.h"
+#include "zones.h"
+#include "buffer.h"
+#include "shaderlibrary.h"
+
+// GPU culling tests a bounding sphere per draw against the frustum in a compute shader and writes
+// the indirect commands the forward pass draws with, instanceCount 0 for every draw outside. When
+// the device has a compute family without graphics, the culling is its own submission on that
+// queue, which signals a semaphore the frame's draws wait on at DRAW_INDIRECT, so it runs while the
+// previous frame is still rasterizing. With a single family the dispatch opens the frame's command
+// buffer instead, behind a barrier. The buffers both queues use are shared concurrently, so no
+// ownership transfers are needed, and every frame in flight has its own parameters and commands.
+namespace scg {
+    void createAsyncCompute(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sCommand& s_command, scg::sPipelineCache& s_pcache, scg::sShaderLibrary& s_shaderlib, scg::sGeometry& s_geom, const std::vector<scg::sDrawRange>& draws, scg::sAsyncCompute& s_async);
+    std::vector<glm::vec4> computeDrawBounds(scg::sGeometry& s_geom, const std::vector<scg::sDrawRange>& draws);
+    void uploadSharedBuffer(scg::sDevice& s_device, scg::sCommand& s_command, const void* contents, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+    void createCullDescriptorSets(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sAsyncCompute& s_async);
+    void createCullPipeline(scg::sDevice& s_device, scg::sPipelineCache& s_pcache, scg::sShaderLibrary& s_shaderlib, scg::sAsyncCompute& s_async);
+    void createCullCommandBuffers(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sAsyncCompute& s_async);
+    void recordCulling(VkCommandBuffer commandBuffer, scg::sAsyncCompute& s_async, uint32_t frame);
+    void updateCullParams(scg::sAsyncCompute& s_async, const glm::mat4& modelViewProj, uint32_t frame);
+    VkSemaphore submitCulling(scg::sDevice& s_device, scg::sAsyncCompute& s_async, uint32_t frame);
+    void recordCulledDraws(VkCommandBuffer commandBuffer, scg::sAsyncCompute& s_async, uint32_t frame);
+    void destroyAsyncCompute(scg::sDevice& s_device, scg::sAsyncCompute& s_async);
+}
+
+void scg::createAsyncCompute(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sCommand& s_command, scg::sPipelineCache& s_pcache, scg::sShaderLibrary& s_shaderlib, scg::sGeometry& s_geom, const std::vector<scg::sDrawRange>& draws, scg::sAsyncCompute& s_async) {
+    SCG_FUNCTION_ZONE();
+    if (!s_inst.enableGpuCulling) {
+        return;
+    }
+    // a culled draw keeps its material in firstInstance, and every draw comes from one indirect call
+    if (!s_device.drawIndirectFirstInstance || (!s_device.multiDrawIndirect && draws.size() > 1)) {
+        std::cout << "indirect draws unsupported, GPU culling disabled" << std::endl;
+        return;
+    }
+    s_async.enabled = true;
+    s_async.separateQueue = s_device.asyncCompute;
+    s_async.drawCount = static_cast<uint32_t>(draws.size());
+
+    std::vector<glm::vec4> bounds = scg::computeDrawBounds(s_geom, draws);
+    scg::uploadSharedBuffer(s_device, s_command, bounds.data(), sizeof(glm::vec4) * bounds.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, s_async.boundsBuffer, s_async.boundsBufferMemory);
+
+    std::vector<VkDrawIndexedIndirectCommand> commands(draws.size());
+    for (size_t i = 0; i < draws.size(); i++) {
+        commands[i].indexCount = draws[i].indexCount;
+        commands[i].instanceCount = 1;
+        commands[i].firstIndex = draws[i].firstIndex;
+        commands[i].vertexOffset = 0;
+        commands[i].firstInstance = draws[i].materialIndex;
+    }
+    VkDeviceSize commandsSize = sizeof(VkDrawIndexedIndirectCommand) * commands.size();
+    scg::uploadSharedBuffer(s_device, s_command, commands.data(), commandsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, s_async.unculledBuffer, s_async.unculledBufferMemory);
+
+    s_async.paramsBuffers.resize(s_inst.maxFramesInFlight);
+    s_async.paramsBuffersMemory.resize(s_inst.maxFramesInFlight);
+    s_async.paramsMapped.resize(s_inst.maxFramesInFlight);
+    s_async.drawBuffers.resize(s_inst.maxFramesInFlight);
+    s_async.drawBuffersMemory.resize(s_inst.maxFramesInFlight);
+    for (int i = 0; i < s_inst.maxFramesInFlight; i++) {
+        // only ever touched by the queue the culling runs on
+        scg::createBuffer(s_device, sizeof(scg::sCullParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                s_async.paramsBuffers[i], s_async.paramsBuffersMemory[i]);
+        vkMapMemory(s_device.device, s_async.paramsBuffersMemory[i], 0, sizeof(scg::sCullParams), 0, &(s_async.paramsMapped[i]));
+        scg::createSharedBuffer(s_device, commandsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                s_async.drawBuffers[i], s_async.drawBuffersMemory[i]);
+    }
+
+    scg::createCullDescriptorSets(s_inst, s_device, s_async);
+    scg::createCullPipeline(s_device, s_pcache, s_shaderlib, s_async);
+    if (s_async.separateQueue) {
+        scg::createCullCommandBuffers(s_inst, s_device, s_async);
+    }
+    std::cout << "GPU culling " << s_async.drawCount << " draws on the " << (s_async.separateQueue ? "async compute queue" : "graphics queue") << std::endl;
+}
+
+// spheres around the bounding box of each draw, in object space
+std::vector<glm::vec4> scg::computeDrawBounds(scg::sGeometry& s_geom, const std::vector<scg::sDrawRange>& draws) {
+    std::vector<glm::vec4> bounds(draws.size());
+    for (size_t i = 0; i < draws.size(); i++) {
+        glm::vec3 lower(std::numeric_limits<float>::max());
+        glm::vec3 upper(-std::numeric_limits<float>::max());
+        for (uint32_t index = draws[i].firstIndex; index < draws[i].firstIndex + draws[i].indexCount; index++) {
+            const glm::vec3& pos = s_geom.vertices[s_geom.indices[index]].pos;
+            lower = glm::min(lower, pos);
+            upper = glm::max(upper, pos);
+        }
+        glm::vec3 center = (lower + upper) * 0.5f;
+        float radius = 0.0f;
+        for (uint32_t index = draws[i].firstIndex; index < draws[i].firstIndex + draws[i].indexCount; index++) {
+            radius = std::max(radius, glm::length(s_geom.vertices[s_geom.indices[index]].pos - center));
+        }
+        bounds[i] = glm::vec4(center, radius);
+    }
+    return bounds;
+}
+
+// scg::createDeviceLocalBuffer for buffers the compute queue reads as well
+void scg::uploadSharedBuffer(scg::sDevice& s_device, scg::sCommand& s_command, const void* contents, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    scg::createBuffer(s_device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+    void* data;
+    vkMapMemory(s_device.device, stagingBufferMemory, 0, size, 0, &data);
+    memcpy(data, contents, (size_t) size);
+    vkUnmapMemory(s_device.device, stagingBufferMemory);
+
+    scg::createSharedBuffer(s_device, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, bufferMemory);
+    scg::copyBuffer(s_device, s_command, stagingBuffer, buffer, size);
+
+    vkDestroyBuffer(s_device.device, stagingBuffer, nullptr);
+    vkFreeMemory(s_device.device, stagingBufferMemory, nullptr);
+}
+
+void scg::createCullDescriptorSets(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sAsyncCompute& s_async) {
+    // params, bounds, the unculled commands and the culled commands
+    std::array<VkDescriptorSetLayoutBinding, 4> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorCount = 1;
+        bindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(s_device.device, &layoutInfo, nullptr, &(s_async.descriptorSetLayout)) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create culling descriptor set layout!");
+    }
+
+    uint32_t frames = static_cast<uint32_t>(s_inst.maxFramesInFlight);
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].descriptorCount = frames;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = frames * 3;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = frames;
+
+    if (vkCreateDescriptorPool(s_device.device, &poolInfo, nullptr, &(s_async.descriptorPool)) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create culling descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(frames, s_async.descriptorSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = s_async.descriptorPool;
+    allocInfo.descriptorSetCount = frames;
+    allocInfo.pSetLayouts = layouts.data();
+
+    s_async.descriptorSets.resize(frames);
+    if (vkAllocateDescriptorSets(s_device.device, &allocInfo, s_async.descriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate culling descriptor sets!");
+    }
+
+    VkDeviceSize commandsSize = sizeof(VkDrawIndexedIndirectCommand) * s_async.drawCount;
+    for (uint32_t i = 0; i < frames; i++) {
+        std::array<VkDescriptorBufferInfo, 4> bufferInfos{};
+        bufferInfos[0] = {s_async.paramsBuffers[i], 0, sizeof(scg::sCullParams)};
+        bufferInfos[1] = {s_async.boundsBuffer, 0, sizeof(glm::vec4) * s_async.drawCount};
+        bufferInfos[2] = {s_async.unculledBuffer, 0, commandsSize};
+        bufferInfos[3] = {s_async.drawBuffers[i], 0, commandsSize};
+
+        std::array<VkWriteDescriptorSet, 4> descriptorWrites{};
+        for (uint32_t b = 0; b < descriptorWrites.size(); b++) {
+            descriptorWrites[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[b].dstSet = s_async.descriptorSets[i];
+            descriptorWrites[b].dstBinding = b;
+            descriptorWrites[b].descriptorType = bindings[b].descriptorType;
+            descriptorWrites[b].descriptorCount = 1;
+            descriptorWrites[b].pBufferInfo = &bufferInfos[b];
+        }
+        vkUpdateDescriptorSets(s_device.device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+}
+
+void scg::createCullPipeline(scg::sDevice& s_device, scg::sPipelineCache& s_pcache, scg::sShaderLibrary& s_shaderlib, scg::sAsyncCompute& s_async) {
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &(s_async.descriptorSetLayout);
+
+    if (vkCreatePipelineLayout(s_device.device, &pipelineLayoutInfo, nullptr, &(s_async.pipelineLayout)) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create culling pipeline layout!");
+    }
+
+    // the module stays owned by the shader library
+    uint64_t hash = scg::acquireShaderModule(s_device, s_shaderlib, "shaders/cull_comp.spv");
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = s_shaderlib.modules[hash].module;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = s_async.pipelineLayout;
+
+    if (vkCreateComputePipelines(s_device.device, s_pcache.pipelineCache, 1, &pipelineInfo, nullptr, &(s_async.pipeline)) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create culling pipeline!");
+    }
+}
+
+// everything a frame's culling reads is in its own buffers, so its command buffer never changes
+void scg::createCullCommandBuffers(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sAsyncCompute& s_async) {
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = s_device.computeFamily;
+
+    if (vkCreateCommandPool(s_device.device, &poolInfo, nullptr, &(s_async.commandPool)) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create compute command pool!");
+    }
+
+    s_async.commandBuffers.resize(s_inst.maxFramesInFlight);
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = s_async.commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = static_cast<uint32_t>(s_async.commandBuffers.size());
+
+    if (vkAllocateCommandBuffers(s_device.device, &allocInfo, s_async.commandBuffers.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate compute command buffers!");
+    }
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    s_async.cullFinishedSemaphores.resize(s_inst.maxFramesInFlight);
+
+    for (uint32_t i = 0; i < s_async.commandBuffers.size(); i++) {
+        if (vkCreateSemaphore(s_device.device, &semaphoreInfo, nullptr, &(s_async.cullFinishedSemaphores[i])) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create culling semaphore!");
+        }
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        if (vkBeginCommandBuffer(s_async.commandBuffers[i], &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording compute command buffer!");
+        }
+        scg::recordCulling(s_async.commandBuffers[i], s_async, i);
+        if (vkEndCommandBuffer(s_async.commandBuffers[i]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record compute command buffer!");
+        }
+    }
+}
+
+// on the graphics queue the draws are ordered after the dispatch by a barrier, across queues by the semaphore
+void scg::recordCulling(VkCommandBuffer commandBuffer, scg::sAsyncCompute& s_async, uint32_t frame) {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, s_async.pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, s_async.pipelineLayout, 0, 1, &(s_async.descriptorSets[frame]), 0, nullptr);
+    vkCmdDispatch(commandBuffer, (s_async.drawCount + 63) / 64, 1, 1);
+
+    if (s_async.separateQueue) {
+        return;
+    }
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = s_async.drawBuffers[frame];
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+// the side planes only, so reversed Z with its infinite far plane needs no special case; the model
+// matrix is rigid, which keeps the normalized planes valid in object space
+void scg::updateCullParams(scg::sAsyncCompute& s_async, const glm::mat4& modelViewProj, uint32_t frame) {
+    if (!s_async.enabled) {
+        return;
+    }
+    glm::mat4 rows = glm::transpose(modelViewProj);
+    scg::sCullParams params{};
+    params.planes[0] = rows[3] + rows[0];
+    params.planes[1] = rows[3] - rows[0];
+    params.planes[2] = rows[3] + rows[1];
+    params.planes[3] = rows[3] - rows[1];
+    for (auto& plane : params.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    params.drawCount = s_async.drawCount;
+    memcpy(s_async.paramsMapped[frame], &params, sizeof(params));
+}
+
+// the frame slot's previous culling has completed, the frame that waited on its semaphore has
+VkSemaphore scg::submitCulling(scg::sDevice& s_device, scg::sAsyncCompute& s_async, uint32_t frame) {
+    if (!s_async.enabled || !s_async.separateQueue) {
+        return VK_NULL_HANDLE;
+    }
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &(s_async.commandBuffers[frame]);
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &(s_async.cullFinishedSemaphores[frame]);
+
+    if (vkQueueSubmit(s_device.computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit culling command buffer!");
+    }
+    return s_async.cullFinishedSemaphores[frame];
+}
+
+void scg::recordCulledDraws(VkCommandBuffer commandBuffer, scg::sAsyncCompute& s_async, uint32_t frame) {
+    vkCmdDrawIndexedIndirect(commandBuffer, s_async.drawBuffers[frame], 0, s_async.drawCount, sizeof(VkDrawIndexedIndirectCommand));
+}
+
+void scg::destroyAsyncCompute(scg::sDevice& s_device, scg::sAsyncCompute& s_async) {
+    if (!s_async.enabled) {
+        return;
+    }
+    if (s_async.commandPool != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(s_device.device, s_async.commandPool, nullptr);
+    }
+    for (auto semaphore : s_async.cullFinishedSemaphores) {
+        vkDestroySemaphore(s_device.device, semaphore, nullptr);
+    }
+    vkDestroyPipeline(s_device.device, s_async.pipeline, nullptr);
+    vkDestroyPipelineLayout(s_device.device, s_async.pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(s_device.device, s_async.descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(s_device.device, s_async.descriptorSetLayout, nullptr);
+
+    for (size_t i = 0; i < s_async.paramsBuffers.size(); i++) {
+        vkDestroyBuffer(s_device.device, s_async.paramsBuffers[i], nullptr);
+        vkFreeMemory(s_device.device, s_async.paramsBuffersMemory[i], nullptr);
+        vkDestroyBuffer(s_device.device, s_async.drawBuffers[i], nullptr);
+        vkFreeMemory(s_device.device, s_async.drawBuffersMemory[i], nullptr);
+    }
+    vkDestroyBuffer(s_device.device, s_async.boundsBuffer, nullptr);
+    vkFreeMemory(s_device.device, s_async.boundsBufferMemory, nullptr);
+    vkDestroyBuffer(s_device.device, s_async.unculledBuffer, nullptr);
+    vkFreeMemory(s_device.device, s_async.unculledBufferMemory, nullptr);
+}
@@ -0,0 +1,299 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+#include <iostream>
+
+#include "container.h"
+#include "zones.h"
+#include "texture.h"
+
+// Packs the small textures of a multi-material model into shared RGBA8 atlas pages with a
+// skyline bottom-left packer, then rewrites the texcoords in sGeometry to point into the pages.
+// Only textures whose texcoords stay inside [0, 1] are eligible, since REPEAT can not wrap a tile.
+namespace scg {
+    bool packSkyline(std::vector<scg::sSkylineNode>& skyline, uint32_t pageSize, uint32_t width, uint32_t height, uint32_t& x, uint32_t& y);
+    void buildTextureAtlas(scg::sInstance& s_inst, scg::sGeometry& s_geom, scg::sMaterialTable& s_mtable);
+    void mergeMaterialRanges(scg::sGeometry& s_geom, scg::sMaterialTable& s_mtable);
+}
+
+namespace scg {
+    struct sAtlasPlacement {
+        bool atlased{false};
+        uint32_t page;
+        uint32_t x, y;
+        uint32_t width, height;
+    };
+}
+
+bool scg::packSkyline(std::vector<scg::sSkylineNode>& skyline, uint32_t pageSize, uint32_t width, uint32_t height, uint32_t& x, uint32_t& y) {
+    size_t bestIndex = skyline.size();
+    uint32_t bestTop = UINT32_MAX;
+    uint32_t bestWidth = UINT32_MAX;
+
+    for (size_t i = 0; i < skyline.size(); i++) {
+        if (skyline[i].x + width > pageSize) {
+            break;
+        }
+
+        // the rect rests on the highest node it spans
+        uint32_t top = 0;
+        uint32_t remaining = width;
+        for (size_t j = i; j < skyline.size(); j++) {
+            top = std::max(top, skyline[j].y);
+            if (skyline[j].width >= remaining) {
+                break;
+            }
+            remaining -= skyline[j].width;
+        }
+
+        if (top + height > pageSize) {
+            continue;
+        }
+
+        if (top + height < bestTop || (top + height == bestTop && skyline[i].width < bestWidth)) {
+            bestIndex = i;
+            bestTop = top + height;
+            bestWidth = skyline[i].width;
+            x = skyline[i].x;
+            y = top;
+        }
+    }
+
+    if (bestIndex == skyline.size()) {
+        return false;
+    }
+
+    scg::sSkylineNode node{x, y + height, width};
+    skyline.insert(skyline.begin() + bestIndex, node);
+
+    // trim the nodes now covered by the new one
+    size_t i = bestIndex + 1;
+    while (i < skyline.size() && skyline[i].x < node.x + node.width) {
+        uint32_t overlap = node.x + node.width - skyline[i].x;
+        if (skyline[i].width <= overlap) {
+            skyline.erase(skyline.begin() + i);
+            continue;
+        }
+        skyline[i].x += overlap;
+        skyline[i].width -= overlap;
+        break;
+    }
+
+    for (size_t j = 0; j + 1 < skyline.size();) {
+        if (skyline[j].y == skyline[j + 1].y) {
+            skyline[j].width += skyline[j + 1].width;
+            skyline.erase(skyline.begin() + j + 1);
+        } else {
+            j++;
+        }
+    }
+
+    return true;
+}
+
+void scg::buildTextureAtlas(scg::sInstance& s_inst, scg::sGeometry& s_geom, scg::sMaterialTable& s_mtable) {
+    SCG_FUNCTION_ZONE();
+    size_t slotCount = s_mtable.texturePaths.size();
+    if (slotCount <= 1) {
+        return;
+    }
+
+    uint32_t padding = s_inst.atlasPadding;
+
+    // slot 0 also backs the non-bindless path, so it always keeps its own image
+    std::vector<scg::sAtlasPlacement> placements(slotCount);
+    for (size_t t = 1; t < slotCount; t++) {
+        int width, height, channels;
+        if (!stbi_info(s_mtable.texturePaths[t].c_str(), &width, &height, &channels)) {
+            continue;
+        }
+        placements[t].width = static_cast<uint32_t>(width);
+        placements[t].height = static_cast<uint32_t>(height);
+        placements[t].atlased = placements[t].width <= s_inst.atlasMaxTextureSize && placements[t].height <= s_inst.atlasMaxTextureSize
+            && placements[t].width + 2 * padding <= s_inst.atlasPageSize && placements[t].height + 2 * padding <= s_inst.atlasPageSize;
+    }
+
+    for (const auto& range : s_geom.drawRanges) {
+        uint32_t t = s_mtable.materials[range.materialIndex].textureIndex;
+        if (!placements[t].atlased) {
+            continue;
+        }
+        for (uint32_t k = range.firstIndex; k < range.firstIndex + range.indexCount; k++) {
+            const glm::vec2& uv = s_geom.vertices[s_geom.indices[k]].texCoord;
+            if (uv.x < 0.0f || uv.x > 1.0f || uv.y < 0.0f || uv.y > 1.0f) {
+                placements[t].atlased = false;
+                break;
+            }
+        }
+    }
+
+    std::vector<uint32_t> order;
+    for (uint32_t t = 1; t < slotCount; t++) {
+        if (placements[t].atlased) {
+            order.push_back(t);
+        }
+    }
+    if (order.empty()) {
+        return;
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return placements[a].height > placements[b].height; });
+
+    uint32_t pageSize = s_inst.atlasPageSize;
+    s_mtable.atlasPageSize = pageSize;
+
+    for (uint32_t t : order) {
+        auto& placement = placements[t];
+        uint32_t paddedWidth = placement.width + 2 * padding;
+        uint32_t paddedHeight = placement.height + 2 * padding;
+
+        bool packed = false;
+        for (uint32_t p = 0; p < s_mtable.atlasPages.size() && !packed; p++) {
+            packed = scg::packSkyline(s_mtable.atlasPages[p].skyline, pageSize, paddedWidth, paddedHeight, placement.x, placement.y);
+            placement.page = p;
+        }
+        if (!packed) {
+            scg::sAtlasPage page{};
+            page.pixels.resize(static_cast<size_t>(pageSize) * pageSize * 4, 0);
+            page.skyline.push_back({0, 0, pageSize});
+            s_mtable.atlasPages.push_back(std::move(page));
+            placement.page = static_cast<uint32_t>(s_mtable.atlasPages.size() - 1);
+            scg::packSkyline(s_mtable.atlasPages.back().skyline, pageSize, paddedWidth, paddedHeight, placement.x, placement.y);
+        }
+
+        int width, height, channels;
+        stbi_uc* pixels = stbi_load(s_mtable.texturePaths[t].c_str(), &width, &height, &channels, STBI_rgb_alpha);
+        if (!pixels) {
+            throw std::runtime_error("failed to load texture image " + s_mtable.texturePaths[t] + "!");
+        }
+
+        // copy the tile and extrude its edges into the padding so filtering clamps to the tile
+        auto& page = s_mtable.atlasPages[placement.page];
+        for (uint32_t py = 0; py < paddedHeight; py++) {
+            uint32_t sy = std::min<uint32_t>(py < padding ? 0 : py - padding, placement.height - 1);
+            for (uint32_t px = 0; px < paddedWidth; px++) {
+                uint32_t sx = std::min<uint32_t>(px < padding ? 0 : px - padding, placement.width - 1);
+                size_t dst = (static_cast<size_t>(placement.y + py) * pageSize + placement.x + px) * 4;
+                size_t src = (static_cast<size_t>(sy) * placement.width + sx) * 4;
+                memcpy(&page.pixels[dst], &pixels[src], 4);
+            }
+        }
+        stbi_image_free(pixels);
+
+        placement.x += padding;
+        placement.y += padding;
+    }
+
+    // compact the file backed slots, atlas pages follow them
+    std::vector<uint32_t> slotRemap(slotCount);
+    std::vector<std::string> texturePaths;
+    for (uint32_t t = 0; t < slotCount; t++) {
+        if (!placements[t].atlased) {
+            slotRemap[t] = static_cast<uint32_t>(texturePaths.size());
+            texturePaths.push_back(s_mtable.texturePaths[t]);
+        }
+    }
+    for (uint32_t t = 0; t < slotCount; t++) {
+        if (placements[t].atlased) {
+            slotRemap[t] = static_cast<uint32_t>(texturePaths.size()) + placements[t].page;
+        }
+    }
+
+    // vertices are shared between materials by the dedup in loadModel, so a vertex reached
+    // through a second texture is duplicated instead of being rewritten twice
+    std::vector<glm::vec2> originalTexCoords(s_geom.vertices.size());
+    for (size_t v = 0; v < s_geom.vertices.size(); v++) {
+        originalTexCoords[v] = s_geom.vertices[v].texCoord;
+    }
+    std::vector<int64_t> owner(s_geom.vertices.size(), -1);
+    std::unordered_map<uint64_t, uint32_t> duplicates;
+
+    for (const auto& range : s_geom.drawRanges) {
+        uint32_t t = s_mtable.materials[range.materialIndex].textureIndex;
+        const auto& placement = placements[t];
+
+        auto remapTexCoord = [&](glm::vec2 uv) {
+            if (!placement.atlased) {
+                return uv;
+            }
+            return glm::vec2(
+                (placement.x + uv.x * placement.width) / static_cast<float>(pageSize),
+                (placement.y + uv.y * placement.height) / static_cast<float>(pageSize)
+            );
+        };
+
+        for (uint32_t k = range.firstIndex; k < range.firstIndex + range.indexCount; k++) {
+            uint32_t v = s_geom.indices[k];
+            if (owner[v] == -1) {
+                owner[v] = t;
+                s_geom.vertices[v].texCoord = remapTexCoord(originalTexCoords[v]);
+            } else if (owner[v] != t) {
+                uint64_t key = (static_cast<uint64_t>(t) << 32) | v;
+                if (duplicates.count(key) == 0) {
+                    scg::Vertex vertex = s_geom.vertices[v];
+                    vertex.texCoord = remapTexCoord(originalTexCoords[v]);
+                    duplicates[key] = static_cast<uint32_t>(s_geom.vertices.size());
+                    s_geom.vertices.push_back(vertex);
+                }
+                s_geom.indices[k] = duplicates[key];
+            }
+        }
+    }
+
+    for (auto& material : s_mtable.materials) {
+        material.textureIndex = slotRemap[material.textureIndex];
+    }
+    s_mtable.texturePaths = texturePaths;
+
+    std::cout << "packed " << order.size() << " textures into " << s_mtable.atlasPages.size() << " atlas pages" << std::endl;
+
+    scg::mergeMaterialRanges(s_geom, s_mtable);
+}
+
+// materials that sample the same slot with the same tint collapse into one, which merges their draw ranges
+void scg::mergeMaterialRanges(scg::sGeometry& s_geom, scg::sMaterialTable& s_mtable) {
+    std::vector<scg::Material> materials;
+    std::vector<uint32_t> materialRemap(s_mtable.materials.size());
+
+    for (size_t m = 0; m < s_mtable.materials.size(); m++) {
+        const auto& material = s_mtable.materials[m];
+        auto match = std::find_if(materials.begin(), materials.end(), [&](const scg::Material& other) {
+            return other.textureIndex == material.textureIndex && other.baseColor == material.baseColor;
+        });
+        if (match == materials.end()) {
+            materialRemap[m] = static_cast<uint32_t>(materials.size());
+            materials.push_back(material);
+        } else {
+            materialRemap[m] = static_cast<uint32_t>(match - materials.begin());
+        }
+    }
+
+    if (materials.size() == s_mtable.materials.size()) {
+        return;
+    }
+
+    std::vector<std::vector<uint32_t>> indicesByMaterial(materials.size());
+    for (const auto& range : s_geom.drawRanges) {
+        auto& bucket = indicesByMaterial[materialRemap[range.materialIndex]];
+        bucket.insert(bucket.end(), s_geom.indices.begin() + range.firstIndex, s_geom.indices.begin() + range.firstIndex + range.indexCount);
+    }
+
+    s_geom.indices.clear();
+    s_geom.drawRanges.clear();
+    for (uint32_t m = 0; m < indicesByMaterial.size(); m++) {
+        if (indicesByMaterial[m].empty()) {
+            continue;
+        }
+        s_geom.drawRanges.push_back({static_cast<uint32_t>(s_geom.indices.size()), static_cast<uint32_t>(indicesByMaterial[m].size()), m});
+        s_geom.indices.insert(s_geom.indices.end(), indicesByMaterial[m].begin(), indicesByMaterial[m].end());
+    }
+
+    std::cout << "merged " << s_mtable.materials.size() << " materials into " << materials.size() << std::endl;
+    s_mtable.materials = materials;
+}
@@ -0,0 +1,354 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#include "container.h"
+#include "zones.h"
+#include "buffer.h"
+
+// Batch rendering of an image sequence. Every frame of a turntable around the model is copied at
+// the end of its command buffer into the next buffer of a ring of persistently mapped readback
+// buffers. Once the frame's timeline value has passed, the buffer goes to a pool of encoder threads
+// and is only handed out again when its image has been written, so rendering, the copy and the
+// encoding of different frames all overlap. The render thread only waits when every buffer of the
+// ring is still being encoded, which is reported as a stall.
+namespace scg {
+    void createBatchRender(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sSwapchain& s_swapchain, scg::sBatchRender& s_batch);
+    void destroyBatchRender(scg::sDevice& s_device, scg::sBatchRender& s_batch);
+    void sequenceState(scg::sBatchRender& s_batch, uint64_t frame, scg::sSimulationState& state);
+    void acquireReadbackSlot(scg::sBatchRender& s_batch, uint64_t frame, uint64_t completedValue);
+    void recordReadback(VkCommandBuffer commandBuffer, scg::sBatchRender& s_batch, VkImage image);
+    void submitReadback(scg::sBatchRender& s_batch, uint64_t timelineValue);
+    void dispatchReadbacks(scg::sBatchRender& s_batch, uint64_t completedValue);
+    void finishBatchRender(scg::sBatchRender& s_batch);
+    void encodeWorker(scg::sBatchRender& s_batch, uint32_t index);
+    void encodeFrame(scg::sBatchRender& s_batch, const scg::sReadbackSlot& slot);
+    bool writeExr(const std::string& path, uint32_t width, uint32_t height, const unsigned char* bgra);
+}
+
+void scg::createBatchRender(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sSwapchain& s_swapchain, scg::sBatchRender& s_batch) {
+    SCG_FUNCTION_ZONE();
+    if (s_inst.sequencePath.empty()) {
+        return;
+    }
+    s_batch.enabled = true;
+    s_batch.directory = s_inst.sequencePath;
+    s_batch.exr = s_inst.sequenceFormat == "exr";
+    s_batch.frameCount = s_inst.frameLimit;
+    s_batch.width = s_swapchain.swapchainExtent.width;
+    s_batch.height = s_swapchain.swapchainExtent.height;
+    std::filesystem::create_directories(s_batch.directory);
+
+    // a slot is reused once its frame slot has been waited for, so the ring covers the frames in flight
+    uint32_t slotCount = std::max(s_inst.readbackRingSize, static_cast<uint32_t>(s_inst.maxFramesInFlight));
+    VkDeviceSize size = static_cast<VkDeviceSize>(s_batch.width) * s_batch.height * 4;
+    s_batch.slots.resize(slotCount);
+    for (auto& slot : s_batch.slots) {
+        scg::createBuffer(s_device, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, slot.buffer, slot.memory);
+        vkMapMemory(s_device.device, slot.memory, 0, size, 0, &(slot.mapped));
+    }
+
+    uint32_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t workerCount = s_inst.encodeThreadCount != 0 ? s_inst.encodeThreadCount : std::max(1u, hardwareThreads - std::min(hardwareThreads, 2u));
+    for (uint32_t i = 0; i < workerCount; i++) {
+        s_batch.workers.push_back(std::thread(scg::encodeWorker, std::ref(s_batch), i));
+    }
+
+    s_batch.start = std::chrono::steady_clock::now();
+    std::cout << "rendering " << s_batch.frameCount << " frames to " << s_batch.directory.string() << " through " << slotCount
+        << " readback buffers and " << workerCount << " encoders" << std::endl;
+}
+
+void scg::destroyBatchRender(scg::sDevice& s_device, scg::sBatchRender& s_batch) {
+    if (!s_batch.enabled) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(s_batch.mutex);
+        s_batch.stopping = true;
+    }
+    s_batch.workReady.notify_all();
+    for (auto& worker : s_batch.workers) {
+        worker.join();
+    }
+    s_batch.workers.clear();
+
+    for (auto& slot : s_batch.slots) {
+        vkUnmapMemory(s_device.device, slot.memory);
+        vkDestroyBuffer(s_device.device, slot.buffer, nullptr);
+        vkFreeMemory(s_device.device, slot.memory, nullptr);
+    }
+    s_batch.slots.clear();
+}
+
+// one full turn around the model over the sequence, from where the interactive camera starts
+void scg::sequenceState(scg::sBatchRender& s_batch, uint64_t frame, scg::sSimulationState& state) {
+    float angle = glm::radians(45.0f) + glm::radians(360.0f) * static_cast<float>(frame) / static_cast<float>(std::max<uint64_t>(s_batch.frameCount, 1));
+    float radius = std::sqrt(8.0f);
+    glm::vec3 eye = glm::vec3(radius * std::cos(angle), radius * std::sin(angle), 2.0f);
+
+    state.time = static_cast<float>(frame);
+    state.model = glm::mat4(1.0f);
+    state.view = glm::lookAt(eye, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+}
+
+// waits only while the encoders still hold the slot, the GPU is done with it once its frame slot was waited for
+void scg::acquireReadbackSlot(scg::sBatchRender& s_batch, uint64_t frame, uint64_t completedValue) {
+    SCG_FUNCTION_ZONE();
+    scg::dispatchReadbacks(s_batch, completedValue);
+
+    uint32_t index = static_cast<uint32_t>(frame % s_batch.slots.size());
+    auto waitStart = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(s_batch.mutex);
+    s_batch.slotFreed.wait(lock, [&s_batch, index]() {
+        return !s_batch.slots[index].inFlight && !s_batch.slots[index].encoding;
+    });
+    s_batch.stallMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - waitStart).count();
+
+    s_batch.currentSlot = index;
+    s_batch.slots[index].frame = frame;
+}
+
+// the render graph leaves the image in TRANSFER_SRC_OPTIMAL, the copy only has to wait for the color writes
+void scg::recordReadback(VkCommandBuffer commandBuffer, scg::sBatchRender& s_batch, VkImage image) {
+    VkImageMemoryBarrier imageBarrier{};
+    imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imageBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.image = image;
+    imageBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+    VkBufferImageCopy region{};
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageExtent = {s_batch.width, s_batch.height, 1};
+    vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, s_batch.slots[s_batch.currentSlot].buffer, 1, &region);
+
+    // the timeline signal alone does not make the copy visible to the host
+    VkBufferMemoryBarrier bufferBarrier{};
+    bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.buffer = s_batch.slots[s_batch.currentSlot].buffer;
+    bufferBarrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+}
+
+void scg::submitReadback(scg::sBatchRender& s_batch, uint64_t timelineValue) {
+    std::lock_guard<std::mutex> lock(s_batch.mutex);
+    scg::sReadbackSlot& slot = s_batch.slots[s_batch.currentSlot];
+    slot.timelineValue = timelineValue;
+    slot.inFlight = true;
+    s_batch.submitted++;
+}
+
+// hands every slot whose frame has completed to the encoders
+void scg::dispatchReadbacks(scg::sBatchRender& s_batch, uint64_t completedValue) {
+    uint32_t dispatched = 0;
+    {
+        std::lock_guard<std::mutex> lock(s_batch.mutex);
+        for (uint32_t i = 0; i < s_batch.slots.size(); i++) {
+            scg::sReadbackSlot& slot = s_batch.slots[i];
+            if (slot.inFlight && slot.timelineValue <= completedValue) {
+                slot.inFlight = false;
+                slot.encoding = true;
+                s_batch.queue.push_back(i);
+                dispatched++;
+            }
+        }
+    }
+    if (dispatched != 0) {
+        s_batch.workReady.notify_all();
+    }
+}
+
+// called with the device idle, so every submitted frame can be encoded
+void scg::finishBatchRender(scg::sBatchRender& s_batch) {
+    if (!s_batch.enabled) {
+        return;
+    }
+    scg::dispatchReadbacks(s_batch, UINT64_MAX);
+    {
+        std::unique_lock<std::mutex> lock(s_batch.mutex);
+        s_batch.slotFreed.wait(lock, [&s_batch]() {
+            return s_batch.encoded == s_batch.submitted;
+        });
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - s_batch.start).count();
+    std::cout << "sequence: " << s_batch.encoded << " frames written in " << seconds << " s, " << s_batch.encoded / seconds
+        << " fps sustained, " << (s_batch.encoded != 0 ? s_batch.encodeMs / s_batch.encoded : 0.0) << " ms encoding per frame, "
+        << s_batch.stallMs << " ms waiting for encoders" << std::endl;
+}
+
+void scg::encodeWorker(scg::sBatchRender& s_batch, uint32_t index) {
+    scg::nameZoneThread("encode worker " + std::to_string(index));
+    while (true) {
+        uint32_t slotIndex;
+        {
+            std::unique_lock<std::mutex> lock(s_batch.mutex);
+            s_batch.workReady.wait(lock, [&s_batch]() {
+                return s_batch.stopping || !s_batch.queue.empty();
+            });
+            if (s_batch.queue.empty()) {
+                return;
+            }
+            slotIndex = s_batch.queue.front();
+            s_batch.queue.pop_front();
+        }
+
+        auto encodeStart = std::chrono::steady_clock::now();
+        {
+            SCG_ZONE("encode frame");
+            scg::encodeFrame(s_batch, s_batch.slots[slotIndex]);
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - encodeStart).count();
+
+        {
+            std::lock_guard<std::mutex> lock(s_batch.mutex);
+            s_batch.slots[slotIndex].encoding = false;
+            s_batch.encoded++;
+            s_batch.encodeMs += ms;
+        }
+        s_batch.slotFreed.notify_all();
+    }
+}
+
+// the offscreen images are B8G8R8A8, PNG wants RGBA
+void scg::encodeFrame(scg::sBatchRender& s_batch, const scg::sReadbackSlot& slot) {
+    char name[32];
+    snprintf(name, sizeof(name), "frame_%05llu.%s", static_cast<unsigned long long>(slot.frame), s_batch.exr ? "exr" : "png");
+    std::string path = (s_batch.directory / name).string();
+    const unsigned char* bgra = static_cast<const unsigned char*>(slot.mapped);
+
+    bool written;
+    if (s_batch.exr) {
+        written = scg::writeExr(path, s_batch.width, s_batch.height, bgra);
+    } else {
+        size_t pixelCount = static_cast<size_t>(s_batch.width) * s_batch.height;
+        std::vector<unsigned char> rgba(pixelCount * 4);
+        for (size_t i = 0; i < pixelCount; i++) {
+            rgba[i * 4 + 0] = bgra[i * 4 + 2];
+            rgba[i * 4 + 1] = bgra[i * 4 + 1];
+            rgba[i * 4 + 2] = bgra[i * 4 + 0];
+            rgba[i * 4 + 3] = bgra[i * 4 + 3];
+        }
+        written = stbi_write_png(path.c_str(), s_batch.width, s_batch.height, 4, rgba.data(), s_batch.width * 4) != 0;
+    }
+    if (!written) {
+        std::cout << "failed to write " << path << std::endl;
+    }
+}
+
+// An uncompressed scanline OpenEXR file with 32 bit float B, G and R channels, which is all a
+// linear image needs. The sRGB bytes are decoded back to linear values first.
+bool scg::writeExr(const std::string& path, uint32_t width, uint32_t height, const unsigned char* bgra) {
+    std::vector<char> header;
+    auto bytes = [&header](const void* data, size_t size) {
+        header.insert(header.end(), static_cast<const char*>(data), static_cast<const char*>(data) + size);
+    };
+    auto text = [&bytes](const char* value) {
+        bytes(value, strlen(value) + 1);
+    };
+    auto i32 = [&bytes](int32_t value) {
+        bytes(&value, sizeof(value));
+    };
+    auto f32 = [&bytes](float value) {
+        bytes(&value, sizeof(value));
+    };
+    auto attribute = [&text, &i32](const char* name, const char* type, int32_t size) {
+        text(name);
+        text(type);
+        i32(size);
+    };
+
+    const unsigned char magic[] = {0x76, 0x2f, 0x31, 0x01, 2, 0, 0, 0};
+    bytes(magic, sizeof(magic));
+
+    // channels are listed, and stored, in alphabetical order
+    const char* channels[] = {"B", "G", "R"};
+    attribute("channels", "chlist", 3 * 18 + 1);
+    for (const char* channel : channels) {
+        text(channel);
+        i32(2);
+        i32(0);
+        i32(1);
+        i32(1);
+    }
+    text("");
+    attribute("compression", "compression", 1);
+    header.push_back(0);
+    attribute("dataWindow", "box2i", 16);
+    i32(0); i32(0); i32(static_cast<int32_t>(width) - 1); i32(static_cast<int32_t>(height) - 1);
+    attribute("displayWindow", "box2i", 16);
+    i32(0); i32(0); i32(static_cast<int32_t>(width) - 1); i32(static_cast<int32_t>(height) - 1);
+    attribute("lineOrder", "lineOrder", 1);
+    header.push_back(0);
+    attribute("pixelAspectRatio", "float", 4);
+    f32(1.0f);
+    attribute("screenWindowCenter", "v2f", 8);
+    f32(0.0f); f32(0.0f);
+    attribute("screenWindowWidth", "float", 4);
+    f32(1.0f);
+    text("");
+
+    float linear[256];
+    for (int i = 0; i < 256; i++) {
+        float c = i / 255.0f;
+        linear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    // one scanline per block, each block is its y, its size and the channels one after the other
+    uint32_t lineBytes = width * 3 * sizeof(float);
+    uint64_t offset = header.size() + static_cast<uint64_t>(height) * sizeof(uint64_t);
+    std::vector<uint64_t> offsets(height);
+    for (uint32_t y = 0; y < height; y++) {
+        offsets[y] = offset + static_cast<uint64_t>(y) * (8 + lineBytes);
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    file.write(header.data(), header.size());
+    file.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+
+    std::vector<float> line(width * 3);
+    for (uint32_t y = 0; y < height; y++) {
+        const unsigned char* row = bgra + static_cast<size_t>(y) * width * 4;
+        for (uint32_t x = 0; x < width; x++) {
+            line[x] = linear[row[x * 4 + 0]];
+            line[width + x] = linear[row[x * 4 + 1]];
+            line[width * 2 + x] = linear[row[x * 4 + 2]];
+        }
+        int32_t block[2] = {static_cast<int32_t>(y), static_cast<int32_t>(lineBytes)};
+        file.write(reinterpret_cast<const char*>(block), sizeof(block));
+        file.write(reinterpret_cast<const char*>(line.data()), lineBytes);
+    }
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#include "container.h"
+#include "zones.h"
+
+// A benchmark run renders a fixed number of frames after a warm-up, with the scene advanced by a
+// fixed timestep per frame instead of by the clock, so every run draws the same frames. CPU frame
+// time (the frame minus the wait for its slot), GPU frame time (the profiler's frame scope) and the
+// interval between presents, which headless is the interval between submits, are written as JSON.
+// With a baseline report the mean, p50 and p95 of each are compared and the run fails when any of
+// them got slower by more than the threshold. Run headless it only needs a software ICD.
+namespace scg {
+    void createBenchmark(scg::sInstance& s_inst, scg::sBenchmark& s_bench);
+    float benchmarkTime(scg::sBenchmark& s_bench, uint64_t frame);
+    void noteBenchmarkSubmit(scg::sBenchmark& s_bench, uint32_t slot, uint64_t frame);
+    void noteBenchmarkGpu(scg::sBenchmark& s_bench, scg::sGpuProfiler& s_gprof, uint32_t slot);
+    void noteBenchmarkFrame(scg::sBenchmark& s_bench, uint64_t frame, std::chrono::steady_clock::time_point cpuStart);
+    scg::sBenchmarkStats summarizeSamples(std::vector<double> samples);
+    void writeBenchmarkStats(std::ostream& out, const std::string& name, const scg::sBenchmarkStats& stats);
+    bool readBaselineValue(const std::string& report, const std::string& metric, const std::string& field, double& value);
+    void finishBenchmark(scg::sDevice& s_device, scg::sBenchmark& s_bench);
+}
+
+void scg::createBenchmark(scg::sInstance& s_inst, scg::sBenchmark& s_bench) {
+    SCG_FUNCTION_ZONE();
+    if (s_inst.benchmarkPath.empty()) {
+        return;
+    }
+    s_bench.enabled = true;
+    s_bench.reportPath = s_inst.benchmarkPath;
+    s_bench.baselinePath = s_inst.baselinePath;
+    s_bench.threshold = s_inst.regressionThreshold;
+    s_bench.warmupFrames = s_inst.warmupFrames;
+    s_bench.slotFrames.assign(s_inst.maxFramesInFlight, UINT64_MAX);
+
+    uint64_t measured = s_inst.frameLimit - s_inst.warmupFrames;
+    s_bench.cpuMs.reserve(measured);
+    s_bench.gpuMs.reserve(measured);
+    s_bench.presentMs.reserve(measured);
+    s_bench.lastPresent = std::chrono::steady_clock::now();
+    std::cout << "benchmark: " << s_inst.warmupFrames << " warm-up frames, then " << measured << " measured frames" << std::endl;
+}
+
+float scg::benchmarkTime(scg::sBenchmark& s_bench, uint64_t frame) {
+    return static_cast<float>(frame * s_bench.timestep);
+}
+
+void scg::noteBenchmarkSubmit(scg::sBenchmark& s_bench, uint32_t slot, uint64_t frame) {
+    if (!s_bench.enabled) {
+        return;
+    }
+    s_bench.slotFrames[slot] = frame;
+}
+
+// right after the profiler collected the slot, whatever it resolved belongs to the slot's last frame
+void scg::noteBenchmarkGpu(scg::sBenchmark& s_bench, scg::sGpuProfiler& s_gprof, uint32_t slot) {
+    if (!s_bench.enabled || s_gprof.frameMs < 0.0) {
+        return;
+    }
+    uint64_t frame = s_bench.slotFrames[slot];
+    if (frame != UINT64_MAX && frame >= s_bench.warmupFrames) {
+        s_bench.gpuMs.push_back(s_gprof.frameMs);
+    }
+    s_gprof.frameMs = -1.0;
+}
+
+void scg::noteBenchmarkFrame(scg::sBenchmark& s_bench, uint64_t frame, std::chrono::steady_clock::time_point cpuStart) {
+    if (!s_bench.enabled) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (frame >= s_bench.warmupFrames) {
+        s_bench.cpuMs.push_back(std::chrono::duration<double, std::milli>(now - cpuStart).count());
+        s_bench.presentMs.push_back(std::chrono::duration<double, std::milli>(now - s_bench.lastPresent).count());
+    }
+    s_bench.lastPresent = now;
+}
+
+// nearest rank percentiles
+scg::sBenchmarkStats scg::summarizeSamples(std::vector<double> samples) {
+    scg::sBenchmarkStats stats{};
+    if (samples.empty()) {
+        return stats;
+    }
+    std::sort(samples.begin(), samples.end());
+    double sum = 0.0;
+    for (double sample : samples) {
+        sum += sample;
+    }
+    auto percentile = [&samples](size_t p) {
+        return samples[(samples.size() * p + 99) / 100 - 1];
+    };
+
+    stats.valid = true;
+    stats.mean = sum / samples.size();
+    stats.p50 = percentile(50);
+    stats.p95 = percentile(95);
+    stats.p99 = percentile(99);
+    stats.max = samples.back();
+    return stats;
+}
+
+void scg::writeBenchmarkStats(std::ostream& out, const std::string& name, const scg::sBenchmarkStats& stats) {
+    out << "  \"" << name << "\": ";
+    if (!stats.valid) {
+        out << "null";
+        return;
+    }
+    out << "{\"mean\": " << stats.mean << ", \"p50\": " << stats.p50 << ", \"p95\": " << stats.p95
+        << ", \"p99\": " << stats.p99 << ", \"max\": " << stats.max << "}";
+}
+
+// only has to read reports this file wrote, which keep every metric on its own line
+bool scg::readBaselineValue(const std::string& report, const std::string& metric, const std::string& field, double& value) {
+    size_t metricPos = report.find("\"" + metric + "\"");
+    if (metricPos == std::string::npos) {
+        return false;
+    }
+    size_t end = report.find('\n', metricPos);
+    size_t fieldPos = report.find("\"" + field + "\":", metricPos);
+    if (fieldPos == std::string::npos || fieldPos > end) {
+        return false;
+    }
+    value = std::strtod(report.c_str() + fieldPos + field.size() + 3, nullptr);
+    return true;
+}
+
+void scg::finishBenchmark(scg::sDevice& s_device, scg::sBenchmark& s_bench) {
+    if (!s_bench.enabled) {
+        return;
+    }
+    const VkPhysicalDeviceProperties& properties = s_device.caps.properties;
+
+    std::vector<std::string> names = {"cpu_frame_ms", "gpu_frame_ms", "present_interval_ms"};
+    std::vector<scg::sBenchmarkStats> stats = {scg::summarizeSamples(s_bench.cpuMs), scg::summarizeSamples(s_bench.gpuMs), scg::summarizeSamples(s_bench.presentMs)};
+
+    std::ostringstream report;
+    report << "{\n  \"device\": \"" << properties.deviceName << "\",\n  \"warmup_frames\": " << s_bench.warmupFrames
+        << ",\n  \"frames\": " << s_bench.cpuMs.size() << ",\n  \"timestep_ms\": " << s_bench.timestep * 1000.0 << ",\n";
+    for (size_t i = 0; i < names.size(); i++) {
+        scg::writeBenchmarkStats(report, names[i], stats[i]);
+        report << (i + 1 < names.size() ? ",\n" : "\n");
+    }
+    report << "}\n";
+
+    std::ofstream file(s_bench.reportPath);
+    if (!file) {
+        throw std::runtime_error("failed to write benchmark report " + s_bench.reportPath + "!");
+    }
+    file << report.str();
+    std::cout << report.str();
+
+    if (s_bench.baselinePath.empty()) {
+        return;
+    }
+    std::ifstream baselineFile(s_bench.baselinePath);
+    if (!baselineFile) {
+        throw std::runtime_error("failed to read benchmark baseline " + s_bench.baselinePath + "!");
+    }
+    std::stringstream baseline;
+    baseline << baselineFile.rdbuf();
+
+    std::vector<std::string> fields = {"mean", "p50", "p95"};
+    for (size_t i = 0; i < names.size(); i++) {
+        if (!stats[i].valid) {
+            continue;
+        }
+        std::vector<double> current = {stats[i].mean, stats[i].p50, stats[i].p95};
+        for (size_t f = 0; f < fields.size(); f++) {
+            double previous;
+            if (!scg::readBaselineValue(baseline.str(), names[i], fields[f], previous) || previous <= 0.0) {
+                continue;
+            }
+            double change = (current[f] - previous) / previous * 100.0;
+            bool regressed = change > s_bench.threshold;
+            std::cout << "baseline " << names[i] << " " << fields[f] << ": " << previous << " -> " << current[f] << " ms ("
+                << (change >= 0.0 ? "+" : "") << change << "%)" << (regressed ? " REGRESSED" : "") << std::endl;
+            s_bench.regressed = s_bench.regressed || regressed;
+        }
+    }
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <array>
+#include <stdexcept>
+
+#include "container.h"
+#include "zones.h"
+#include "buffer.h"
+#include "texture.h"
+
+// Bindless material path: one update-after-bind descriptor set (set = 1) holds the material
+// storage buffer and a partially bound array of every texture the model references. Each draw
+// range picks its material through firstInstance, so the whole model is one indirect draw.
+namespace scg {
+    void createBindlessDescriptorSetLayout(scg::sDevice& s_device, scg::sDescriptor& s_descriptor);
+    void createBindlessDescriptorPool(scg::sDevice& s_device, scg::sDescriptor& s_descriptor);
+    void createBindlessDescriptorSet(scg::sDevice& s_device, scg::sDescriptor& s_descriptor, scg::sTexture& s_texture, scg::sMaterialTable& s_mtable);
+    void createMaterialTextures(scg::sDevice& s_device, scg::sCommand& s_command, scg::sMaterialTable& s_mtable);
+    void createMaterialBuffer(scg::sDevice& s_device, scg::sCommand& s_command, scg::sMaterialTable& s_mtable);
+    void createIndirectBuffer(scg::sDevice& s_device, scg::sCommand& s_command, scg::sGeometry& s_geom, scg::sMaterialTable& s_mtable);
+    void recordBindlessDraws(VkCommandBuffer commandBuffer, scg::sDevice& s_device, scg::sGeometry& s_geom, scg::sMaterialTable& s_mtable);
+    void destroyBindless(scg::sDevice& s_device, scg::sDescriptor& s_descriptor, scg::sMaterialTable& s_mtable);
+}
+
+void scg::createBindlessDescriptorSetLayout(scg::sDevice& s_device, scg::sDescriptor& s_descriptor) {
+    SCG_FUNCTION_ZONE();
+    VkDescriptorSetLayoutBinding materialLayoutBinding{};
+    materialLayoutBinding.binding = 0;
+    materialLayoutBinding.descriptorCount = 1;
+    materialLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    materialLayoutBinding.pImmutableSamplers = nullptr;
+    materialLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    // the variable sized array has to be the highest binding in the set
+    VkDescriptorSetLayoutBinding texturesLayoutBinding{};
+    texturesLayoutBinding.binding = 1;
+    texturesLayoutBinding.descriptorCount = s_device.maxBindlessTextures;
+    texturesLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    texturesLayoutBinding.pImmutableSamplers = nullptr;
+    texturesLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {materialLayoutBinding, texturesLayoutBinding};
+    std::array<VkDescriptorBindingFlagsEXT, 2> bindingFlags = {
+        0,
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT
+    };
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo{};
+    bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+    bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+    bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = &bindingFlagsInfo;
+    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(s_device.device, &layoutInfo, nullptr, &(s_descriptor.bindlessSetLayout)) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create bindless descriptor set layout!");
+    }
+}
+
+void scg::createBindlessDescriptorPool(scg::sDevice& s_device, scg::sDescriptor& s_descriptor) {
+    SCG_FUNCTION_ZONE();
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[0].descriptorCount = 1;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[1].descriptorCount = s_device.maxBindlessTextures;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = 1;
+
+    if (vkCreateDescriptorPool(s_device.device, &poolInfo, nullptr, &(s_descriptor.bindlessPool)) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create bindless descriptor pool!");
+    }
+}
+
+void scg::createBindlessDescriptorSet(scg::sDevice& s_device, scg::sDescriptor& s_descriptor, scg::sTexture& s_texture, scg::sMaterialTable& s_mtable) {
+    SCG_FUNCTION_ZONE();
+    uint32_t textureCount = static_cast<uint32_t>(s_mtable.texturePaths.size() + s_mtable.atlasPages.size());
+    if (textureCount > s_device.maxBindlessTextures) {
+        throw std::runtime_error("model references more textures than the bindless table holds!");
+    }
+
+    VkDescriptorSetVariableDescriptorCountAllocateInfoEXT variableCountInfo{};
+    variableCountInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO_EXT;
+    variableCountInfo.descriptorSetCount = 1;
+    variableCountInfo.pDescriptorCounts = &(s_device.maxBindlessTextures);
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.pNext = &variableCountInfo;
+    allocInfo.descriptorPool = s_descriptor.bindlessPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &(s_descriptor.bindlessSetLayout);
+
+    if (vkAllocateDescriptorSets(s_device.device, &allocInfo, &(s_descriptor.bindlessSet)) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate bindless descriptor set!");
+    }
+
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = s_mtable.materialBuffer;
+    bufferInfo.offset = 0;
+    bufferInfo.range = sizeof(scg::Material) * s_mtable.materials.size();
+
+    // slot 0 aliases the default texture, every slot shares its sampler
+    std::vector<VkDescriptorImageInfo> imageInfos(textureCount);
+    for (uint32_t i = 0; i < textureCount; i++) {
+        imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfos[i].imageView = i == 0 ? s_texture.textureImageView : s_mtable.textures[i].textureImageView;
+        imageInfos[i].sampler = s_texture.textureSampler;
+    }
+
+    std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+
+    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[0].dstSet = s_descriptor.bindlessSet;
+    descriptorWrites[0].dstBinding = 0;
+    descriptorWrites[0].dstArrayElement = 0;
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrites[0].descriptorCount = 1;
+    descriptorWrites[0].pBufferInfo = &bufferInfo;
+
+    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[1].dstSet = s_descriptor.bindlessSet;
+    descriptorWrites[1].dstBinding = 1;
+    descriptorWrites[1].dstArrayElement = 0;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrites[1].descriptorCount = textureCount;
+    descriptorWrites[1].pImageInfo = imageInfos.data();
+
+    vkUpdateDescriptorSets(s_device.device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+void scg::createMaterialTextures(scg::sDevice& s_device, scg::sCommand& s_command, scg::sMaterialTable& s_mtable) {
+    SCG_FUNCTION_ZONE();
+    s_mtable.textures.resize(s_mtable.texturePaths.size() + s_mtable.atlasPages.size());
+
+    // slot 0 is s_texture, loaded by createTextureImage
+    for (size_t i = 1; i < s_mtable.texturePaths.size(); i++) {
+        scg::loadTextureImage(s_device, s_command, s_mtable.texturePaths[i], s_mtable.textures[i].textureImage, s_mtable.textures[i].textureImageMemory);
+        s_mtable.textures[i].textureImageView = scg::createImageView(s_device, s_mtable.textures[i].textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
+    }
+
+    for (size_t p = 0; p < s_mtable.atlasPages.size(); p++) {
+        auto& texture = s_mtable.textures[s_mtable.texturePaths.size() + p];
+        scg::createTextureImageFromPixels(s_device, s_command, s_mtable.atlasPages[p].pixels.data(), s_mtable.atlasPageSize, s_mtable.atlasPageSize, texture.textureImage, texture.textureImageMemory);
+        texture.textureImageView = scg::createImageView(s_device, texture.textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
+    }
+
+    // the pixels live on the GPU now
+    s_mtable.atlasPages.clear();
+    s_mtable.atlasPages.shrink_to_fit();
+}
+
+void scg::createMaterialBuffer(scg::sDevice& s_device, scg::sCommand& s_command, scg::sMaterialTable& s_mtable) {
+    SCG_FUNCTION_ZONE();
+    VkDeviceSize bufferSize = sizeof(scg::Material) * s_mtable.materials.size();
+    scg::createDeviceLocalBuffer(s_device, s_command, s_mtable.materials.data(), bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, s_mtable.materialBuffer, s_mtable.materialBufferMemory);
+}
+
+void scg::createIndirectBuffer(scg::sDevice& s_device, scg::sCommand& s_command, scg::sGeometry& s_geom, scg::sMaterialTable& s_mtable) {
+    SCG_FUNCTION_ZONE();
+    std::vector<VkDrawIndexedIndirectCommand> commands(s_geom.drawRanges.size());
+
+    for (size_t i = 0; i < s_geom.drawRanges.size(); i++) {
+        commands[i].indexCount = s_geom.drawRanges[i].indexCount;
+        commands[i].instanceCount = 1;
+        commands[i].firstIndex = s_geom.drawRanges[i].firstIndex;
+        commands[i].vertexOffset = 0;
+        // the vertex shader forwards gl_InstanceIndex as the material index
+        commands[i].firstInstance = s_geom.drawRanges[i].materialIndex;
+    }
+
+    VkDeviceSize bufferSize = sizeof(VkDrawIndexedIndirectCommand) * commands.size();
+    scg::createDeviceLocalBuffer(s_device, s_command, commands.data(), bufferSize, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, s_mtable.indirectBuffer, s_mtable.indirectBufferMemory);
+}
+
+void scg::recordBindlessDraws(VkCommandBuffer commandBuffer, scg::sDevice& s_device, scg::sGeometry& s_geom, scg::sMaterialTable& s_mtable) {
+    uint32_t drawCount = static_cast<uint32_t>(s_geom.drawRanges.size());
+
+    if (s_device.drawIndirectFirstInstance && (s_device.multiDrawIndirect || drawCount <= 1)) {
+        vkCmdDrawIndexedIndirect(commandBuffer, s_mtable.indirectBuffer, 0, drawCount, sizeof(VkDrawIndexedIndirectCommand));
+        return;
+    }
+
+    // firstInstance is always honoured by direct draws, so this stays correct without the features
+    for (const auto& range : s_geom.drawRanges) {
+        vkCmdDrawIndexed(commandBuffer, range.indexCount, 1, range.firstIndex, 0, range.materialIndex);
+    }
+}
+
+void scg::destroyBindless(scg::sDevice& s_device, scg::sDescriptor& s_descriptor, scg::sMaterialTable& s_mtable) {
+    vkDestroyDescriptorPool(s_device.device, s_descriptor.bindlessPool, nullptr);
+    vkDestroyDescriptorSetLayout(s_device.device, s_descriptor.bindlessSetLayout, nullptr);
+
+    for (size_t i = 1; i < s_mtable.textures.size(); i++) {
+        vkDestroyImageView(s_device.device, s_mtable.textures[i].textureImageView, nullptr);
+        vkDestroyImage(s_device.device, s_mtable.textures[i].textureImage, nullptr);
+        vkFreeMemory(s_device.device, s_mtable.textures[i].textureImageMemory, nullptr);
+    }
+
+    vkDestroyBuffer(s_device.device, s_mtable.indirectBuffer, nullptr);
+    vkFreeMemory(s_device.device, s_mtable.indirectBufferMemory, nullptr);
+
+    vkDestroyBuffer(s_device.device, s_mtable.materialBuffer, nullptr);
+    vkFreeMemory(s_device.device, s_mtable.materialBufferMemory, nullptr);
+}
@@ -3,11 +3,21 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include <array>
+#include <mutex>
+#include <chrono>
+
 #include "container.h"
+#include "zones.h"
 #include "helper.h"
+#include "format.h"
+#include "synchronization.h"
 
 namespace scg {
     void createBuffer(scg::sDevice& s_device, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+    void allocateBufferMemory(scg::sDevice& s_device, VkMemoryPropertyFlags properties, VkBuffer buffer, VkDeviceMemory& bufferMemory);
+    void createSharedBuffer(scg::sDevice& s_device, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+    void createDeviceLocalBuffer(scg::sDevice& s_device, scg::sCommand& s_command, const void* contents, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
     void copyBuffer(sDevice& s_device, sCommand& s_command, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
     void copyBufferToImage(scg::sDevice& s_device, scg::sCommand& s_command, VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
     
@@ -19,6 +29,7 @@ namespace scg {
     void createUniformBuffers(sInstance& s_inst, sDevice& s_device, sUniformBuffer& s_ubuf);
     void createIndexBuffer(sDevice& s_device, sCommand& s_command, sGeometry& s_geom);
     void createVertexBuffer(sDevice& s_device, sCommand& s_command, sGeometry& s_geom);
+    void createPositionBuffer(sDevice& s_device, sCommand& s_command, sGeometry& s_geom);
 }
 
 void scg::createBuffer(scg::sDevice& s_device, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
@@ -30,18 +41,63 @@ void scg::createBuffer(scg::sDevice& s_device, VkDeviceSize size, VkBufferUsageF
     if (vkCreateBuffer(s_device.device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
         throw std::runtime_error("failed to create buffer!");
     }
+    scg::allocateBufferMemory(s_device, properties, buffer, bufferMemory);
+}
+
+// used by both the graphics and the compute queue without ownership transfers
+void scg::createSharedBuffer(scg::sDevice& s_device, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+    if (!s_device.asyncCompute) {
+        scg::createBuffer(s_device, size, usage, properties, buffer, bufferMemory);
+        return;
+    }
+    uint32_t queueFamilyIndices[] = {s_device.caps.queueIndices.graphicsFamily.value(), s_device.computeFamily};
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    bufferInfo.queueFamilyIndexCount = 2;
+    bufferInfo.pQueueFamilyIndices = queueFamilyIndices;
+    if (vkCreateBuffer(s_device.device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create shared buffer!");
+    }
+    scg::allocateBufferMemory(s_device, properties, buffer, bufferMemory);
+}
+
+void scg::allocateBufferMemory(scg::sDevice& s_device, VkMemoryPropertyFlags properties, VkBuffer buffer, VkDeviceMemory& bufferMemory) {
     VkMemoryRequirements memRequirements;
     vkGetBufferMemoryRequirements(s_device.device, buffer, &memRequirements);
     VkMemoryAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = scg::findMemoryType(s_device.physicalDevice, memRequirements.memoryTypeBits, properties);
+    allocInfo.memoryTypeIndex = scg::findMemoryType(s_device, memRequirements.memoryTypeBits, properties);
     if (vkAllocateMemory(s_device.device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
         throw std::runtime_error("failed to allocate buffer memory!");
     }
     vkBindBufferMemory(s_device.device, buffer, bufferMemory, 0);
 }
 
+// uploads contents through a staging buffer into a new DEVICE_LOCAL buffer
+void scg::createDeviceLocalBuffer(scg::sDevice& s_device, scg::sCommand& s_command, const void* contents, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+    SCG_FUNCTION_ZONE();
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    scg::createBuffer(s_device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+    void* data;
+    vkMapMemory(s_device.device, stagingBufferMemory, 0, size, 0, &data);
+    memcpy(data, contents, (size_t) size);
+    vkUnmapMemory(s_device.device, stagingBufferMemory);
+
+    scg::createBuffer(s_device, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, bufferMemory);
+
+    copyBuffer(s_device, s_command, stagingBuffer, buffer, size);
+
+    vkDestroyBuffer(s_device.device, stagingBuffer, nullptr);
+    vkFreeMemory(s_device.device, stagingBufferMemory, nullptr);
+}
+
     void scg::copyBuffer(sDevice& s_device, sCommand& s_command, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
         VkCommandBuffer commandBuffer = beginSingleTimeCommands(s_device, s_command);
 
@@ -53,6 +109,7 @@ void scg::createBuffer(scg::sDevice& s_device, VkDeviceSize size, VkBufferUsageF
     }
 
 void scg::transitionImageLayout(scg::sDevice& s_device, scg::sCommand& s_command, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
+    SCG_FUNCTION_ZONE();
     VkCommandBuffer commandBuffer = beginSingleTimeCommands(s_device, s_command);
 
     VkImageMemoryBarrier barrier{};
@@ -68,24 +125,18 @@ void scg::transitionImageLayout(scg::sDevice& s_device, scg::sCommand& s_command
     barrier.subresourceRange.baseArrayLayer = 0;
     barrier.subresourceRange.layerCount = 1;
 
+    if (format == VK_FORMAT_D32_SFLOAT || scg::hasStencilComponent(format)) {
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+        if (scg::hasStencilComponent(format)) {
+            barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+        }
+    }
+
     VkPipelineStageFlags sourceStage;
     VkPipelineStageFlags destinationStage;
-
-    if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-        sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    } else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-        sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-        destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    } else {
-        throw std::invalid_argument("unsupported layout transition!");
-    }
+    scg::getLayoutAccess(oldLayout, sourceStage, barrier.srcAccessMask);
+    scg::getLayoutAccess(newLayout, destinationStage, barrier.dstAccessMask);
+    barrier.srcAccessMask = scg::writeAccessMask(barrier.srcAccessMask);
 
     vkCmdPipelineBarrier(
             commandBuffer,
@@ -100,6 +151,7 @@ void scg::transitionImageLayout(scg::sDevice& s_device, scg::sCommand& s_command
 }
 
 void scg::copyBufferToImage(scg::sDevice& s_device, scg::sCommand& s_command, VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
+    SCG_FUNCTION_ZONE();
     VkCommandBuffer commandBuffer = scg::beginSingleTimeCommands(s_device, s_command);
 
     VkBufferImageCopy region{};
@@ -122,7 +174,10 @@ void scg::copyBufferToImage(scg::sDevice& s_device, scg::sCommand& s_command, Vk
     scg::endSingleTimeCommands(s_device, s_command, commandBuffer);
 }
 
+// initialization tasks upload from several threads, the pool stays locked until endSingleTimeCommands
 VkCommandBuffer scg::beginSingleTimeCommands(scg::sDevice& s_device, scg::sCommand& s_command) {
+    s_command.poolMutex.lock();
+
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
@@ -138,24 +193,38 @@ VkCommandBuffer scg::beginSingleTimeCommands(scg::sDevice& s_device, scg::sComma
 
     vkBeginCommandBuffer(commandBuffer, &beginInfo);
 
+    // the profiler's upload pair, read back right after the wait in endSingleTimeCommands
+    if (s_command.uploadQueryPool != VK_NULL_HANDLE) {
+        vkCmdResetQueryPool(commandBuffer, s_command.uploadQueryPool, s_command.uploadQuery, 2);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, s_command.uploadQueryPool, s_command.uploadQuery);
+    }
+
     return commandBuffer;
 }
 
 void scg::endSingleTimeCommands(scg::sDevice& s_device, scg::sCommand& s_command, VkCommandBuffer commandBuffer) {
+    SCG_FUNCTION_ZONE();
+    if (s_command.uploadQueryPool != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, s_command.uploadQueryPool, s_command.uploadQuery + 1);
+    }
     vkEndCommandBuffer(commandBuffer);
 
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
+    auto submitTime = std::chrono::steady_clock::now();
+    scg::submitAndWait(s_device, commandBuffer);
 
-    vkQueueSubmit(s_device.graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(s_device.graphicsQueue);
+    std::array<uint64_t, 2> timestamps{};
+    if (s_command.uploadQueryPool != VK_NULL_HANDLE &&
+            vkGetQueryPoolResults(s_device.device, s_command.uploadQueryPool, s_command.uploadQuery, 2, sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+        double gpuMs = static_cast<double>((timestamps[1] - timestamps[0]) & s_command.timestampMask) * s_command.timestampPeriod / 1000000.0;
+        s_command.uploadTimings.push_back({submitTime, gpuMs});
+    }
 
     vkFreeCommandBuffers(s_device.device, s_command.commandPool, 1, &commandBuffer);
+    s_command.poolMutex.unlock();
 }
 
 void scg::createVertexBuffer(sDevice& s_device, sCommand& s_command, sGeometry& s_geom) {
+    SCG_FUNCTION_ZONE();
     VkDeviceSize bufferSize = sizeof(s_geom.vertices[0]) * s_geom.vertices.size();
 
     VkBuffer stagingBuffer;
@@ -176,6 +245,7 @@ void scg::createVertexBuffer(sDevice& s_device, sCommand& s_command, sGeometry&
 }
 
 void scg::createIndexBuffer(sDevice& s_device, sCommand& s_command, sGeometry& s_geom) {
+    SCG_FUNCTION_ZONE();
     VkDeviceSize bufferSize = sizeof(s_geom.indices[0]) * s_geom.indices.size();
 
     VkBuffer stagingBuffer;
@@ -196,6 +266,7 @@ void scg::createIndexBuffer(sDevice& s_device, sCommand& s_command, sGeometry& s
 }
 
 void scg::createUniformBuffers(sInstance& s_inst, sDevice& s_device, sUniformBuffer& s_ubuf) {
+    SCG_FUNCTION_ZONE();
     VkDeviceSize bufferSize = sizeof(scg::UniformBufferObject);
 
     s_ubuf.uniformBuffers.resize(s_inst.maxFramesInFlight);
@@ -205,3 +276,15 @@ void scg::createUniformBuffers(sInstance& s_inst, sDevice& s_device, sUniformBuf
         createBuffer(s_device, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, s_ubuf.uniformBuffers[i], s_ubuf.uniformBuffersMemory[i]);
     }
 }
+
+// the depth prepass only fetches positions, a third of the interleaved vertex
+void scg::createPositionBuffer(scg::sDevice& s_device, scg::sCommand& s_command, scg::sGeometry& s_geom) {
+    SCG_FUNCTION_ZONE();
+    std::vector<glm::vec3> positions;
+    positions.reserve(s_geom.vertices.size());
+    for (const auto& vertex : s_geom.vertices) {
+        positions.push_back(vertex.pos);
+    }
+
+    scg::createDeviceLocalBuffer(s_device, s_command, positions.data(), sizeof(positions[0]) * positions.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, s_geom.positionBuffer, s_geom.positionBufferMemory);
+}
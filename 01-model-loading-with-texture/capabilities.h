@@ -0,0 +1,199 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "container.h"
+#include "helper.h"
+#include "zones.h"
+
+// Everything the app asks the driver about a physical device is queried once, when the devices are
+// compared, and kept in sDevice::caps for the one that is picked: properties and limits, features,
+// memory types and heaps, queue families, extensions and the optional features the renderer can use.
+// The format properties of the core formats are added for the picked device only. Devices are
+// ranked by type first, then by device local memory, queue layout and optional features, and
+// --device picks one by index or name instead.
+namespace scg {
+    void buildDeviceCapabilities(VkPhysicalDevice physicalDevice, uint32_t index, VkSurfaceKHR& surface, std::vector<const char*>& deviceExtensions, scg::sDeviceCapabilities& caps);
+    void queryOptionalFeatures(scg::sDeviceCapabilities& caps);
+    void cacheFormatProperties(scg::sDeviceCapabilities& caps);
+    bool hasDeviceExtension(const scg::sDeviceCapabilities& caps, const char* name);
+    int64_t scoreDevice(const scg::sDeviceCapabilities& caps);
+    bool matchesPreferredDevice(const scg::sDeviceCapabilities& caps, const std::string& preferred);
+    VkFormatProperties getFormatProperties(const scg::sDeviceCapabilities& caps, VkFormat format);
+}
+
+void scg::buildDeviceCapabilities(VkPhysicalDevice physicalDevice, uint32_t index, VkSurfaceKHR& surface, std::vector<const char*>& deviceExtensions, scg::sDeviceCapabilities& caps) {
+    SCG_FUNCTION_ZONE();
+    caps.physicalDevice = physicalDevice;
+    caps.index = index;
+    vkGetPhysicalDeviceProperties(physicalDevice, &caps.properties);
+    vkGetPhysicalDeviceFeatures(physicalDevice, &caps.features);
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &caps.memory);
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    caps.queueFamilies.resize(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, caps.queueFamilies.data());
+
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+    for (const auto& extension : extensions) {
+        caps.extensions.insert(extension.extensionName);
+    }
+
+    caps.queueIndices = scg::findQueueFamilies(caps, surface);
+    caps.queueIndices.computeFamily = caps.queueIndices.graphicsFamily;
+    for (uint32_t i = 0; i < caps.queueFamilies.size(); i++) {
+        const VkQueueFamilyProperties& family = caps.queueFamilies[i];
+        bool graphics = (family.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+        bool compute = (family.queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+        if (compute && !graphics && !caps.dedicatedCompute) {
+            caps.queueIndices.computeFamily = i;
+        }
+        caps.dedicatedCompute = caps.dedicatedCompute || (compute && !graphics);
+        caps.dedicatedTransfer = caps.dedicatedTransfer || ((family.queueFlags & VK_QUEUE_TRANSFER_BIT) && !graphics && !compute);
+    }
+
+    for (uint32_t i = 0; i < caps.memory.memoryHeapCount; i++) {
+        if (caps.memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+            caps.deviceLocalBytes += caps.memory.memoryHeaps[i].size;
+        }
+    }
+
+    scg::queryOptionalFeatures(caps);
+    caps.suitable = scg::isDeviceSuitable(caps, surface, deviceExtensions);
+    caps.score = scg::scoreDevice(caps);
+}
+
+// one features and one properties query with every optional structure the device has the extension for
+void scg::queryOptionalFeatures(scg::sDeviceCapabilities& caps) {
+    if (caps.properties.apiVersion < VK_API_VERSION_1_1) {
+        return;
+    }
+    bool indexingExtensions = scg::hasDeviceExtension(caps, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) && scg::hasDeviceExtension(caps, VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+    bool libraryExtensions = scg::hasDeviceExtension(caps, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) && scg::hasDeviceExtension(caps, VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+    bool timelineExtension = scg::hasDeviceExtension(caps, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures{};
+    indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT libraryFeatures{};
+    libraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures{};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    if (indexingExtensions) {
+        indexingFeatures.pNext = features.pNext;
+        features.pNext = &indexingFeatures;
+    }
+    if (libraryExtensions) {
+        libraryFeatures.pNext = features.pNext;
+        features.pNext = &libraryFeatures;
+    }
+    if (timelineExtension) {
+        timelineFeatures.pNext = features.pNext;
+        features.pNext = &timelineFeatures;
+    }
+    vkGetPhysicalDeviceFeatures2(caps.physicalDevice, &features);
+
+    caps.indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+    VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT libraryProperties{};
+    libraryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT;
+
+    VkPhysicalDeviceProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    if (indexingExtensions) {
+        caps.indexingProperties.pNext = properties.pNext;
+        properties.pNext = &caps.indexingProperties;
+    }
+    if (libraryExtensions) {
+        libraryProperties.pNext = properties.pNext;
+        properties.pNext = &libraryProperties;
+    }
+    vkGetPhysicalDeviceProperties2(caps.physicalDevice, &properties);
+    caps.indexingProperties.pNext = nullptr;
+
+    // only the features the bindless texture table relies on
+    caps.descriptorIndexing = indexingExtensions
+        && indexingFeatures.shaderSampledImageArrayNonUniformIndexing
+        && indexingFeatures.runtimeDescriptorArray
+        && indexingFeatures.descriptorBindingPartiallyBound
+        && indexingFeatures.descriptorBindingSampledImageUpdateAfterBind
+        && indexingFeatures.descriptorBindingVariableDescriptorCount;
+    // only worth it when linking is fast, otherwise monolithic pipelines on the workers are just as good
+    caps.graphicsPipelineLibrary = libraryExtensions && libraryFeatures.graphicsPipelineLibrary && libraryProperties.graphicsPipelineLibraryFastLinking;
+    caps.timelineSemaphore = timelineExtension && timelineFeatures.timelineSemaphore;
+}
+
+// indexed by VkFormat, the extension formats have large values and are queried when asked for
+void scg::cacheFormatProperties(scg::sDeviceCapabilities& caps) {
+    SCG_FUNCTION_ZONE();
+    caps.formats.resize(VK_FORMAT_ASTC_12x12_SRGB_BLOCK + 1);
+    for (uint32_t format = 0; format < caps.formats.size(); format++) {
+        vkGetPhysicalDeviceFormatProperties(caps.physicalDevice, static_cast<VkFormat>(format), &caps.formats[format]);
+    }
+}
+
+bool scg::hasDeviceExtension(const scg::sDeviceCapabilities& caps, const char* name) {
+    return caps.extensions.count(name) != 0;
+}
+
+// the device type outweighs everything else, the rest only orders devices of the same type
+int64_t scg::scoreDevice(const scg::sDeviceCapabilities& caps) {
+    if (!caps.suitable) {
+        return -1;
+    }
+    int64_t score = 0;
+    switch (caps.properties.deviceType) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            score += 100000;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            score += 10000;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            score += 1000;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:
+            score += 100;
+            break;
+        default:
+            break;
+    }
+    score += static_cast<int64_t>(caps.deviceLocalBytes >> 30) * 100;
+    if (caps.queueIndices.graphicsFamily == caps.queueIndices.presentFamily) {
+        score += 100;
+    }
+    score += caps.dedicatedCompute ? 50 : 0;
+    score += caps.dedicatedTransfer ? 50 : 0;
+    score += caps.timelineSemaphore ? 100 : 0;
+    score += caps.descriptorIndexing ? 100 : 0;
+    score += caps.graphicsPipelineLibrary ? 50 : 0;
+    score += caps.features.multiDrawIndirect ? 25 : 0;
+    return score;
+}
+
+// an index when the whole string is digits, otherwise part of the device name
+bool scg::matchesPreferredDevice(const scg::sDeviceCapabilities& caps, const std::string& preferred) {
+    if (!preferred.empty() && preferred.find_first_not_of("0123456789") == std::string::npos) {
+        return std::stoul(preferred) == caps.index;
+    }
+    return std::string(caps.properties.deviceName).find(preferred) != std::string::npos;
+}
+
+VkFormatProperties scg::getFormatProperties(const scg::sDeviceCapabilities& caps, VkFormat format) {
+    if (static_cast<size_t>(format) < caps.formats.size()) {
+        return caps.formats[format];
+    }
+    VkFormatProperties properties{};
+    vkGetPhysicalDeviceFormatProperties(caps.physicalDevice, format, &properties);
+    return properties;
+}
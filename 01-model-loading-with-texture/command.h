@@ -3,17 +3,20 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include <mutex>
 #include <stdexcept>
 
 #include "container.h"
+#include "zones.h"
 
 namespace scg {
-    void createCommandPool(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sCommand& s_command);
+    void createCommandPool(scg::sDevice& s_device, scg::sCommand& s_command);
     void createCommandBuffers(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sCommand& s_command);
 }
 
-void scg::createCommandPool(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sCommand& s_command) {
-    QueueFamilyIndices queueFamilyIndices = findQueueFamilies(s_device.physicalDevice, s_inst.surface);
+void scg::createCommandPool(scg::sDevice& s_device, scg::sCommand& s_command) {
+    SCG_FUNCTION_ZONE();
+    QueueFamilyIndices queueFamilyIndices = s_device.caps.queueIndices;
 
     VkCommandPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -26,6 +29,7 @@ void scg::createCommandPool(scg::sInstance& s_inst, scg::sDevice& s_device, scg:
 }
 
 void scg::createCommandBuffers(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sCommand& s_command) {
+    SCG_FUNCTION_ZONE();
     s_command.commandBuffers.resize(s_inst.maxFramesInFlight);
 
     VkCommandBufferAllocateInfo allocInfo{};
@@ -34,6 +38,7 @@ void scg::createCommandBuffers(scg::sInstance& s_inst, scg::sDevice& s_device, s
     allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
     allocInfo.commandBufferCount = (uint32_t) s_command.commandBuffers.size();
 
+    std::lock_guard<std::mutex> lock(s_command.poolMutex);
     if (vkAllocateCommandBuffers(s_device.device, &allocInfo, s_command.commandBuffers.data()) != VK_SUCCESS) {
         throw std::runtime_error("failed to allocate command buffers!");
     }
@@ -0,0 +1,108 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <mutex>
+#include <iostream>
+#include <stdexcept>
+
+#include "container.h"
+#include "zones.h"
+#include "deletion.h"
+
+// Keeps one recorded primary command buffer per frame in flight and swapchain image. Only the
+// uniform buffer changes from frame to frame and it is written through mapped memory, so a buffer
+// recorded once can be submitted again as is. Every buffer carries a valid flag that is cleared
+// whenever something it recorded changes: the swapchain, the pipelines, the pipeline key or the
+// render extent. A cleared buffer is recorded again the next time its slot comes up.
+namespace scg {
+    void createCommandCache(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sSwapchain& s_swapchain, scg::sCommand& s_command, scg::sCommandCache& s_ccache);
+    void destroyCommandCache(scg::sDevice& s_device, scg::sCommand& s_command, scg::sCommandCache& s_ccache);
+    void retireCommandCache(scg::sDevice& s_device, scg::sCommand& s_command, scg::sCommandCache& s_ccache, scg::sDeletionQueue& s_deletion, uint64_t frame);
+    void invalidateCommandCache(scg::sCommandCache& s_ccache);
+    void updateCommandState(scg::sCommandCache& s_ccache, const scg::sCommandState& state);
+    VkCommandBuffer getCachedCommandBuffer(scg::sCommandCache& s_ccache, uint32_t frame, uint32_t imageIndex, bool& needsRecording);
+}
+
+// follows the swapchain, so it is created again whenever the image count may have changed
+void scg::createCommandCache(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sSwapchain& s_swapchain, scg::sCommand& s_command, scg::sCommandCache& s_ccache) {
+    SCG_FUNCTION_ZONE();
+    s_ccache.enabled = s_inst.cacheCommandBuffers;
+    if (!s_ccache.enabled) {
+        return;
+    }
+
+    s_ccache.imageCount = static_cast<uint32_t>(s_swapchain.swapchainImages.size());
+    s_ccache.commandBuffers.resize(s_inst.maxFramesInFlight * s_ccache.imageCount);
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = s_command.commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = static_cast<uint32_t>(s_ccache.commandBuffers.size());
+
+    std::lock_guard<std::mutex> lock(s_command.poolMutex);
+    if (vkAllocateCommandBuffers(s_device.device, &allocInfo, s_ccache.commandBuffers.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate cached command buffers!");
+    }
+    scg::invalidateCommandCache(s_ccache);
+}
+
+// the device has to be idle
+void scg::destroyCommandCache(scg::sDevice& s_device, scg::sCommand& s_command, scg::sCommandCache& s_ccache) {
+    if (s_ccache.commandBuffers.empty()) {
+        return;
+    }
+    vkFreeCommandBuffers(s_device.device, s_command.commandPool, static_cast<uint32_t>(s_ccache.commandBuffers.size()), s_ccache.commandBuffers.data());
+    s_ccache.commandBuffers.clear();
+    s_ccache.valid.clear();
+}
+
+// the cached buffers may still be pending on the GPU, so they are freed once their frames complete
+void scg::retireCommandCache(scg::sDevice& s_device, scg::sCommand& s_command, scg::sCommandCache& s_ccache, scg::sDeletionQueue& s_deletion, uint64_t frame) {
+    if (s_ccache.commandBuffers.empty()) {
+        return;
+    }
+    VkDevice device = s_device.device;
+    VkCommandPool commandPool = s_command.commandPool;
+    std::vector<VkCommandBuffer> commandBuffers = s_ccache.commandBuffers;
+    scg::deferDeletion(s_deletion, frame, [device, commandPool, commandBuffers]() {
+        vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+    });
+    s_ccache.commandBuffers.clear();
+    s_ccache.valid.clear();
+}
+
+void scg::invalidateCommandCache(scg::sCommandCache& s_ccache) {
+    s_ccache.valid.assign(s_ccache.commandBuffers.size(), false);
+}
+
+// a handle that changed means the old pipeline is retired and possibly already queued for deletion
+void scg::updateCommandState(scg::sCommandCache& s_ccache, const scg::sCommandState& state) {
+    bool changed = state.key != s_ccache.state.key || state.pipeline != s_ccache.state.pipeline || state.depthPipeline != s_ccache.state.depthPipeline ||
+        state.sceneExtent.width != s_ccache.state.sceneExtent.width || state.sceneExtent.height != s_ccache.state.sceneExtent.height;
+    if (changed) {
+        scg::invalidateCommandCache(s_ccache);
+        s_ccache.state = state;
+    }
+}
+
+// the caller records into the returned buffer when needsRecording is set, it counts as valid afterwards
+VkCommandBuffer scg::getCachedCommandBuffer(scg::sCommandCache& s_ccache, uint32_t frame, uint32_t imageIndex, bool& needsRecording) {
+    uint32_t slot = frame * s_ccache.imageCount + imageIndex;
+    needsRecording = !s_ccache.valid[slot];
+    s_ccache.valid[slot] = true;
+
+    s_ccache.submitted++;
+    if (needsRecording) {
+        s_ccache.recorded++;
+    }
+    if (s_ccache.submitted == s_ccache.reportInterval) {
+        std::cout << "command cache: recorded " << s_ccache.recorded << " of the last " << s_ccache.submitted << " frames" << std::endl;
+        s_ccache.submitted = 0;
+        s_ccache.recorded = 0;
+    }
+    return s_ccache.commandBuffers[slot];
+}
@@ -11,8 +11,21 @@
 #include <glm/gtx/hash.hpp>
 
 #include <vector>
+#include <array>
 #include <string>
 #include <optional>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#include <functional>
+#include <filesystem>
+#include <atomic>
+#include <memory>
+#include <exception>
 
 namespace scg {
     struct Vertex {
@@ -40,12 +53,29 @@ namespace scg {
         alignas(16) glm::mat4 view;
         alignas(16) glm::mat4 proj;
     };
+
+    // what the update thread hands to the renderer, everything but the swapchain dependent projection
+    struct sSimulationState {
+        glm::mat4 model;
+        glm::mat4 view;
+        float time;
+        uint64_t tick;
+    };
+
+    // matches the std430 layout of Material in shaders/bindless.frag
+    struct Material {
+        alignas(16) glm::vec4 baseColor;
+        uint32_t textureIndex;
+        uint32_t padding[3];
+    };
 }
 
 namespace scg {
     struct QueueFamilyIndices {
         std::optional<uint32_t> graphicsFamily;
         std::optional<uint32_t> presentFamily;
+        // a family without graphics when the device has one, otherwise the graphics family
+        std::optional<uint32_t> computeFamily;
 
         bool isComplete() {
             return graphicsFamily.has_value() && presentFamily.has_value();
@@ -63,9 +93,10 @@ namespace scg {
 
 namespace scg {
     struct sInstance {
-        GLFWwindow* window;
+        // both stay null when running headless
+        GLFWwindow* window{nullptr};
         VkInstance instance;
-        VkSurfaceKHR surface;
+        VkSurfaceKHR surface{VK_NULL_HANDLE};
         VkDebugUtilsMessengerEXT debugMessenger;
 
         std::string appName{"Vulkan Application"};
@@ -79,57 +110,408 @@ namespace scg {
         };
 
         bool enableValidationLayers;
+        bool enableBindless{true};
+        uint32_t maxBindlessTextures{4096};
+
+        bool enableAtlas{true};
+        uint32_t atlasPageSize{2048};
+        uint32_t atlasMaxTextureSize{256};
+        // The pages have a single mip, so the padding only has to cover the filter footprint: one
+        // texel for bilinear taps, one more for taps that anisotropic filtering spreads past the edge.
+        uint32_t atlasPadding{2};
+
+        bool enableGraphicsPipelineLibrary{true};
+        uint32_t pipelineWorkerCount{2};
+        bool alphaTest{false};
+        bool doubleSided{false};
+
+        bool enableShaderHotReload{true};
+
+        // lay down depth in a position only pass so the color pass shades each pixel once
+        bool depthPrepass{false};
+        // depth 1 at the near plane and 0 at infinity, pairs with a floating point depth buffer
+        bool reversedZ{false};
+
+        // requested MSAA sample count, lowered to what the device supports
+        uint32_t msaaSamples{1};
+
+        // render the scene below swapchain resolution when the GPU runs over budget
+        bool enableDynamicResolution{false};
+        float gpuBudgetMs{16.0f};
+        float minResolutionScale{0.5f};
+        float maxResolutionScale{1.0f};
+
+        bool enablePipelineCache{true};
+        std::string pipelineCachePath{"pipeline_cache.bin"};
+
+        // keep a recorded command buffer per frame slot and swapchain image, re-record on changes
+        bool cacheCommandBuffers{false};
+        // run the simulation on its own thread at a fixed rate, with an artificial cost per tick
+        bool enableUpdateThread{false};
+        float updateRate{120.0f};
+        float simulationCostMs{0.0f};
+
+        // threads recording secondary command buffers for the forward pass, 0 records inline
+        uint32_t recordThreadCount{0};
+        // split the model into this many draws to stress command recording
+        uint32_t syntheticDrawCount{0};
 
         int maxFramesInFlight{2};
+        bool enableTimelineSemaphore{true};
+        // frustum cull the draws in a compute shader, on a queue of its own when the device has one
+        bool enableGpuCulling{false};
+        bool enableAsyncCompute{true};
+        // asked for first, with a fallback when the surface does not offer it (cycle with P)
+        VkPresentModeKHR presentMode{VK_PRESENT_MODE_MAILBOX_KHR};
+        // 0 asks for one more than the surface minimum
+        uint32_t swapchainImageCount{0};
+        // wait for the previous frame before sampling input, trading throughput for latency
+        bool waitBeforeInput{false};
+        bool reportLatency{false};
+        // render into offscreen images without GLFW, a surface or a swapchain
+        bool headless{false};
+        // stop after this many frames, 0 runs until the window is closed
+        uint64_t frameLimit{0};
+        // render a turntable into numbered images in this directory, implies headless
+        std::string sequencePath;
+        std::string sequenceFormat{"png"};
+        uint32_t readbackRingSize{6};
+        uint32_t encodeThreadCount{0};
+        // a device index or part of its name, used instead of the best scoring device
+        std::string preferredDevice;
+        // threads the initialization tasks run on, 0 uses every core and 1 runs them one by one
+        uint32_t initThreadCount{0};
+        // a reproducible run: fixed timestep, warm-up frames and a JSON report, optionally checked against a baseline
+        std::string benchmarkPath;
+        uint64_t warmupFrames{60};
+        std::string baselinePath;
+        double regressionThreshold{10.0};
+        // drain the GPU before a new swapchain is created, the old behaviour kept for comparison
+        bool waitIdleOnResize{false};
+        // resize the window this many times and report the hitch every resize causes
+        uint32_t resizeStormCount{0};
+        // time named scopes on the GPU, and write them with the CPU scopes as a Chrome trace
+        bool enableGpuProfiler{false};
+        std::string tracePath;
 
         std::string texturePath{"textures/viking_room.png"};
         std::string modelPath{"models/viking_room.obj"};
     };
 
+    // everything about a physical device the app asks the driver for, queried once when the
+    // devices are compared and kept for the chosen one
+    struct sDeviceCapabilities {
+        VkPhysicalDevice physicalDevice{VK_NULL_HANDLE};
+        uint32_t index{0};
+        VkPhysicalDeviceProperties properties{};
+        VkPhysicalDeviceFeatures features{};
+        VkPhysicalDeviceMemoryProperties memory{};
+        std::vector<VkQueueFamilyProperties> queueFamilies;
+        scg::QueueFamilyIndices queueIndices;
+        std::unordered_set<std::string> extensions;
+        // the core formats, indexed by VkFormat
+        std::vector<VkFormatProperties> formats;
+
+        bool descriptorIndexing{false};
+        bool graphicsPipelineLibrary{false};
+        bool timelineSemaphore{false};
+        VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties{};
+        bool dedicatedCompute{false};
+        bool dedicatedTransfer{false};
+        VkDeviceSize deviceLocalBytes{0};
+
+        bool suitable{false};
+        int64_t score{-1};
+    };
+
     struct sDevice {
         VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
         VkDevice device;
+        scg::sDeviceCapabilities caps;
 
         VkQueue graphicsQueue;
         VkQueue presentQueue;
+        // the graphics queue itself unless the compute queue comes from a family of its own
+        VkQueue computeQueue;
+        uint32_t computeFamily{0};
+        bool asyncCompute{false};
+
+        bool descriptorIndexing{false};
+        bool multiDrawIndirect{false};
+        bool drawIndirectFirstInstance{false};
+        bool graphicsPipelineLibrary{false};
+        uint32_t maxBindlessTextures{0};
+
+        // Every submission to the graphics queue signals the next value of this counter, so GPU
+        // progress is one number. Without VK_KHR_timeline_semaphore the value is still counted and
+        // completion is learned from the frame fences instead.
+        bool timelineSemaphore{false};
+        VkSemaphore graphicsTimeline{VK_NULL_HANDLE};
+        uint64_t graphicsTimelineValue{0};
+        uint64_t completedTimelineValue{0};
+        PFN_vkWaitSemaphoresKHR waitSemaphores{nullptr};
+        PFN_vkGetSemaphoreCounterValueKHR getSemaphoreCounterValue{nullptr};
     };
 
     struct sSwapchain {
-        VkSwapchainKHR swapchain;
+        // handed to the next swapchain as oldSwapchain, so it starts out null
+        VkSwapchainKHR swapchain{VK_NULL_HANDLE};
         std::vector<VkImage> swapchainImages;
         VkFormat swapchainImageFormat;
         VkExtent2D swapchainExtent;
         std::vector<VkImageView> swapchainImageViews;
+        VkPresentModeKHR presentMode;
+        // the layout a finished frame is left in, for presentation or, headless, to be copied out
+        VkImageLayout finalLayout{VK_IMAGE_LAYOUT_PRESENT_SRC_KHR};
+        // headless only, the swapchain images are then ordinary images the app owns
+        std::vector<VkDeviceMemory> offscreenMemory;
     };
 
     struct sRenderPass {
         VkRenderPass renderPass;
+        // a single swapchain format color attachment, for full screen passes
+        VkRenderPass colorRenderPass;
+        // the depth prepass pipelines are built against this one
+        VkRenderPass depthRenderPass;
+        VkFormat depthFormat;
+        // of the scene color and depth attachments, resolved before anything samples them
+        VkSampleCountFlagBits samples{VK_SAMPLE_COUNT_1_BIT};
+    };
+
+    // a chain of pools for sets of one shape, a full pool is set aside and the next one taken
+    struct sDescriptorAllocator {
+        // descriptors of each type one set takes
+        std::vector<VkDescriptorPoolSize> setSizes;
+        // sets the next new pool holds, doubled for every pool created
+        uint32_t setsPerPool{0};
+        VkDescriptorPool currentPool{VK_NULL_HANDLE};
+        std::vector<VkDescriptorPool> fullPools;
+        // reset and waiting to be taken again
+        std::vector<VkDescriptorPool> freePools;
+    };
+
+    // what the frame set's update template reads, in binding order
+    struct sFrameDescriptorData {
+        VkDescriptorBufferInfo uniformBuffer;
+        VkDescriptorImageInfo texture;
+    };
+
+    // the layout handle and the template data the set was written from
+    struct sCachedDescriptorSet {
+        std::vector<unsigned char> key;
+        VkDescriptorSet set;
     };
 
     struct sDescriptor {
         VkDescriptorSetLayout descriptorSetLayout;
-        VkDescriptorPool descriptorPool;
         std::vector<VkDescriptorSet> descriptorSets;
+        VkDescriptorUpdateTemplate frameTemplate{VK_NULL_HANDLE};
+
+        // sets that live until cleanup
+        scg::sDescriptorAllocator persistentAllocator;
+        // Sets that live as long as one recording of a primary command buffer, by frame slot and, with
+        // cached command buffers, swapchain image. A chain is reset when its buffer is recorded again.
+        std::vector<std::vector<scg::sDescriptorAllocator>> transientAllocators;
+        std::vector<VkDescriptorPoolSize> transientSetSizes;
+        // immutable sets by a hash of their layout and contents, the bytes are compared on a hit
+        std::unordered_map<uint64_t, std::vector<scg::sCachedDescriptorSet>> cachedSets;
+
+        bool useBindless{false};
+        VkDescriptorSetLayout bindlessSetLayout;
+        VkDescriptorPool bindlessPool;
+        VkDescriptorSet bindlessSet;
+    };
+
+    // everything a pipeline variant may differ in, packed into a few bits for hashing
+    struct sPipelineKey {
+        bool alphaTest{false};
+        bool doubleSided{false};
+        // depth comes from the prepass, test EQUAL and leave it unwritten
+        bool depthPrepass{false};
+        VkSampleCountFlagBits samples{VK_SAMPLE_COUNT_1_BIT};
+
+        uint32_t pack() const {
+            return (alphaTest ? 1u : 0u) | (doubleSided ? 2u : 0u) | (depthPrepass ? 4u : 0u) | (static_cast<uint32_t>(samples) << 3);
+        }
     };
 
     struct sGraphicsPipeline {
         VkPipelineLayout pipelineLayout;
+        // built synchronously at startup, bound while other variants compile
         VkPipeline graphicsPipeline;
+        scg::sPipelineKey defaultKey;
+        bool reversedZ{false};
+
+        VkShaderModule vertShaderModule;
+        VkShaderModule fragShaderModule;
+
+        // position only, no fragment shader, indexed by doubleSided
+        VkShaderModule depthShaderModule;
+        std::array<VkPipeline, 2> depthPipelines{};
+    };
+
+    // a pipeline, or a shader module builds may still be compiling from
+    struct sRetiredPipeline {
+        VkPipeline pipeline;
+        uint32_t generation;
+        VkShaderModule module{VK_NULL_HANDLE};
+        // timeline value of the last frame that may use it, UINT64_MAX until the render loop stamps it
+        uint64_t frame{UINT64_MAX};
+    };
+
+    struct sPipelineManager {
+        std::unordered_map<uint32_t, VkPipeline> pipelines;
+        // graphics pipeline library parts, keyed by part bit and the key bits that part depends on
+        std::unordered_map<uint64_t, VkPipeline> libraries;
+        // fast linked variants replaced by their optimized build, stale builds, replaced libraries and
+        // released shader modules, destroyed once the GPU and every build up to their generation are done
+        std::vector<scg::sRetiredPipeline> retiredPipelines;
+        // builds in progress per generation, each holds the libraries of its generation
+        std::unordered_map<uint32_t, uint32_t> activeBuilds;
+
+        std::deque<scg::sPipelineKey> queue;
+        std::unordered_set<uint32_t> requested;
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stopping{false};
+        // bumped whenever the shaders change, builds started before that are thrown away
+        uint32_t generation{0};
+    };
+
+    // One writer and one reader exchange whole states without locks. The writer fills its back slot
+    // and swaps it with the middle one, the reader swaps its front slot with the middle one when that
+    // holds a state it has not seen, so neither side ever waits for the other.
+    struct sTripleBuffer {
+        std::array<scg::sSimulationState, 3> slots;
+        // index of the middle slot, with bit 2 set while it holds an unread state
+        std::atomic<uint32_t> middle{1};
+        uint32_t back{0};
+        uint32_t front{2};
+    };
+
+    struct sSimulation {
+        bool enabled{false};
+        std::thread thread;
+        std::atomic<bool> stopping{false};
+        scg::sTripleBuffer buffer;
+
+        float tickRate;
+        float costMs;
+        std::chrono::steady_clock::time_point startTime;
+    };
+
+    struct sDeletionQueue {
+        // frame number the resource was retired in, and how to destroy it
+        std::deque<std::pair<uint64_t, std::function<void()>>> entries;
+    };
+
+    struct sReflectedBinding {
+        uint32_t set;
+        uint32_t binding;
+        VkDescriptorType descriptorType;
+        // 0 for runtime sized arrays
+        uint32_t descriptorCount;
+
+        bool operator==(const sReflectedBinding& other) const {
+            return set == other.set && binding == other.binding && descriptorType == other.descriptorType && descriptorCount == other.descriptorCount;
+        }
+    };
+
+    struct sShaderReflection {
+        VkShaderStageFlags stage{0};
+        std::vector<scg::sReflectedBinding> bindings;
+        uint32_t pushConstantSize{0};
+    };
+
+    struct sShaderModule {
+        VkShaderModule module;
+        scg::sShaderReflection reflection;
+        uint32_t references{0};
+    };
+
+    struct sShaderSource {
+        uint64_t hash;
+        std::filesystem::file_time_type writeTime;
+        // a changed write time has to be seen twice before reloading, so half written files are skipped
+        std::filesystem::file_time_type pendingWriteTime;
+    };
+
+    struct sShaderLibrary {
+        // modules are shared between paths with identical SPIR-V
+        std::unordered_map<uint64_t, scg::sShaderModule> modules;
+        std::unordered_map<std::string, scg::sShaderSource> sources;
+
+        std::string vertPath;
+        std::string fragPath;
+        std::string depthPath;
+        uint64_t vertHash{0};
+        uint64_t fragHash{0};
+        uint64_t depthHash{0};
+
+        bool hotReload{true};
+        std::chrono::steady_clock::time_point lastPoll;
+
+        // a reload compiles the default pipeline on its own thread and is swapped in at a frame boundary
+        std::thread reloadThread;
+        std::atomic<bool> reloadDone{false};
+        bool reloading{false};
+        bool reloadFailed{false};
+        uint64_t stagedVertHash{0};
+        uint64_t stagedFragHash{0};
+        uint64_t stagedDepthHash{0};
+        // the default and the depth prepass pipelines built from the staged modules
+        scg::sGraphicsPipeline staged;
+    };
+
+    struct sPipelineCache {
+        VkPipelineCache pipelineCache;
+        // bytes of validated data the cache was seeded with, 0 on a cold start
+        size_t loadedSize{0};
+    };
+
+    // a finished one-off upload, start is when it was submitted
+    struct sUploadTiming {
+        std::chrono::steady_clock::time_point start;
+        double gpuMs;
     };
 
     struct sCommand {
         VkCommandPool commandPool;
         std::vector<VkCommandBuffer> commandBuffers;
+        // the pool and the graphics queue are externally synchronized, held from allocating a
+        // command buffer from the pool until the one-off submit that used it has completed
+        std::mutex poolMutex;
+
+        // timestamp pair the one-off uploads write when the GPU profiler is on, owned by the profiler
+        VkQueryPool uploadQueryPool{VK_NULL_HANDLE};
+        uint32_t uploadQuery{0};
+        float timestampPeriod{1.0f};
+        uint64_t timestampMask{~0ull};
+        std::vector<scg::sUploadTiming> uploadTimings;
     };
 
-    struct sDepth {
-        VkImage depthImage;
-        VkDeviceMemory depthImageMemory;
-        VkImageView depthImageView;
+    // everything recorded into a frame's command buffer that can change between frames
+    struct sCommandState {
+        uint32_t key{0};
+        VkPipeline pipeline{VK_NULL_HANDLE};
+        VkPipeline depthPipeline{VK_NULL_HANDLE};
+        VkExtent2D sceneExtent{0, 0};
     };
 
-    struct sFramebuffer {
-        std::vector<VkFramebuffer> swapchainFramebuffers;
+    struct sCommandCache {
+        bool enabled{false};
+        // one primary per frame in flight and swapchain image, at frame * imageCount + image
+        std::vector<VkCommandBuffer> commandBuffers;
+        // cleared by scg::invalidateCommandCache, set once the buffer has been recorded
+        std::vector<bool> valid;
+        uint32_t imageCount{0};
+        // what the valid buffers were recorded with
+        scg::sCommandState state;
+
+        uint32_t submitted{0};
+        uint32_t recorded{0};
+        uint32_t reportInterval{300};
     };
 
     struct sTexture {
@@ -140,9 +522,135 @@ namespace scg {
     };
 
     struct sSynch {
+        // headless frames neither wait for an acquired image nor signal a present
+        bool presenting{true};
         std::vector<VkSemaphore> imageAvailableSemaphores;
         std::vector<VkSemaphore> renderFinishedSemaphores;
+        // only created without timeline semaphores
         std::vector<VkFence> inFlightFences;
+        // the timeline value the last submission of each frame in flight signals
+        std::vector<uint64_t> frameTimelineValues;
+    };
+
+    struct sFramePacing {
+        // when the input of the frame being built was sampled
+        std::chrono::steady_clock::time_point inputTime;
+        // the same per frame in flight once submitted, until the frame is seen complete
+        std::vector<std::chrono::steady_clock::time_point> submittedInputTimes;
+        std::vector<bool> pending;
+
+        bool report{false};
+        double latencySumMs{0.0};
+        double latencyMaxMs{0.0};
+        uint32_t latencySamples{0};
+        std::chrono::steady_clock::time_point lastReport;
+    };
+
+    struct sResizeStorm {
+        bool enabled{false};
+        uint32_t remaining{0};
+        uint32_t framesBetween{8};
+        uint32_t framesSinceResize{0};
+        bool shrunk{false};
+        int width{0};
+        int height{0};
+
+        // set by the swapchain recreation, the frame it happened in counts as a hitch
+        bool recreated{false};
+        double recreateMs{0.0};
+        std::chrono::steady_clock::time_point lastFrame;
+
+        double steadySumMs{0.0};
+        double steadyMaxMs{0.0};
+        uint32_t steadyFrames{0};
+        double hitchSumMs{0.0};
+        double hitchMaxMs{0.0};
+        double recreateSumMs{0.0};
+        double recreateMaxMs{0.0};
+        uint32_t hitches{0};
+    };
+
+    struct sTraceEvent {
+        std::string name;
+        std::string category;
+        uint32_t track;
+        double startUs;
+        double durationUs;
+    };
+
+    // Chrome trace events, written as JSON at exit, times are relative to origin
+    struct sTrace {
+        bool enabled{false};
+        std::string path;
+        std::chrono::steady_clock::time_point origin;
+        std::vector<std::string> trackNames;
+        std::vector<scg::sTraceEvent> events;
+        std::mutex mutex;
+    };
+
+    struct sZoneEvent {
+        const char* name;
+        int64_t startNs;
+        int64_t endNs;
+    };
+
+    // one per thread that closed a zone, only that thread writes to it
+    struct sZoneBuffer {
+        std::string threadName;
+        std::vector<scg::sZoneEvent> events;
+        // events below count are complete and never written again
+        std::atomic<uint32_t> count{0};
+        std::atomic<uint32_t> dropped{0};
+    };
+
+    struct sZoneRegistry {
+        std::atomic<bool> enabled{false};
+        // guards buffers, taken once per thread on its first zone and when collecting
+        std::mutex mutex;
+        std::vector<std::unique_ptr<scg::sZoneBuffer>> buffers;
+        uint32_t capacity{65536};
+    };
+
+    struct sGpuScope {
+        std::string name;
+        uint32_t beginQuery;
+        uint32_t endQuery;
+        uint32_t depth;
+    };
+
+    // the scopes one frame in flight recorded, in the order they were opened
+    struct sGpuProfilerFrame {
+        std::vector<scg::sGpuScope> scopes;
+        std::vector<uint32_t> open;
+        uint32_t nextQuery{0};
+        bool pending{false};
+        std::chrono::steady_clock::time_point submitTime;
+    };
+
+    // the last window samples of one scope, in milliseconds
+    struct sGpuScopeStats {
+        std::vector<double> samples;
+        uint32_t next{0};
+    };
+
+    struct sGpuProfiler {
+        bool enabled{false};
+        VkQueryPool queryPool{VK_NULL_HANDLE};
+        uint32_t queriesPerFrame{64};
+        float timestampPeriod{1.0f};
+        uint64_t timestampMask{~0ull};
+        std::vector<scg::sGpuProfilerFrame> frames;
+
+        std::vector<std::string> scopeOrder;
+        std::unordered_map<std::string, scg::sGpuScopeStats> stats;
+        uint32_t window{240};
+        uint32_t resolvedFrames{0};
+        uint32_t reportInterval{300};
+        // where the GPU track of the trace is, frames are laid out after their submit and never overlap
+        uint32_t traceTrack{0};
+        double gpuCursorUs{0.0};
+        // the outermost scope of the last resolved frame, negative until the next one is resolved
+        double frameMs{-1.0};
     };
 
     struct sUniformBuffer {
@@ -150,12 +658,355 @@ namespace scg {
         std::vector<VkDeviceMemory> uniformBuffersMemory;
     };
 
+    struct sDrawRange {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        uint32_t materialIndex;
+    };
+
     struct sGeometry {
         std::vector<scg::Vertex> vertices;
         std::vector<uint32_t> indices;
+        std::vector<scg::sDrawRange> drawRanges;
         VkBuffer vertexBuffer;
         VkDeviceMemory vertexBufferMemory;
+        // tightly packed positions for the depth prepass
+        VkBuffer positionBuffer;
+        VkDeviceMemory positionBufferMemory;
         VkBuffer indexBuffer;
         VkDeviceMemory indexBufferMemory;
     };
+
+    struct sRecordWorker {
+        std::thread thread;
+        // one pool per frame in flight, reset as a whole once that frame has completed
+        std::vector<VkCommandPool> commandPools;
+        std::vector<VkCommandBuffer> commandBuffers;
+        bool recorded{false};
+    };
+
+    struct sRecorder {
+        std::vector<std::unique_ptr<scg::sRecordWorker>> workers;
+        // the draws the workers split between them
+        std::vector<scg::sDrawRange> draws;
+
+        std::mutex mutex;
+        std::condition_variable workReady;
+        std::condition_variable workDone;
+        bool stopping{false};
+        // bumped for every batch of work, workers record once per value
+        uint64_t batch{0};
+        uint32_t pending{0};
+        uint32_t frame{0};
+        VkCommandBufferInheritanceInfo inheritance{};
+        std::function<void(VkCommandBuffer, uint32_t, uint32_t)> record;
+
+        // average CPU time of recordCommandBuffer, reported every reportInterval frames
+        double recordMs{0.0};
+        uint32_t recordedFrames{0};
+        uint32_t reportInterval{300};
+    };
+
+    struct sSkylineNode {
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+    };
+
+    struct sAtlasPage {
+        std::vector<unsigned char> pixels;
+        std::vector<scg::sSkylineNode> skyline;
+    };
+
+    struct sMaterialTable {
+        std::vector<scg::Material> materials;
+        // slot 0 is always sInstance::texturePath, shared with s_texture
+        std::vector<std::string> texturePaths;
+        // atlas pages take the texture slots right after texturePaths
+        std::vector<scg::sAtlasPage> atlasPages;
+        uint32_t atlasPageSize{0};
+        std::vector<scg::sTexture> textures;
+
+        VkBuffer materialBuffer;
+        VkDeviceMemory materialBufferMemory;
+        VkBuffer indirectBuffer;
+        VkDeviceMemory indirectBufferMemory;
+    };
+
+    struct sGraphResourceState {
+        VkImageLayout layout{VK_IMAGE_LAYOUT_UNDEFINED};
+        VkPipelineStageFlags writeStages{0};
+        VkAccessFlags writeAccess{0};
+        // readers since the last write, a later write only needs an execution dependency on them
+        VkPipelineStageFlags readStages{0};
+        VkAccessFlags readAccess{0};
+    };
+
+    struct sGraphImage {
+        std::string name;
+        VkFormat format;
+        VkExtent2D extent;
+        VkSampleCountFlagBits samples{VK_SAMPLE_COUNT_1_BIT};
+        VkImageAspectFlags aspect;
+        VkImageUsageFlags usage{0};
+        VkImage image{VK_NULL_HANDLE};
+        VkImageView view{VK_NULL_HANDLE};
+
+        // imported images live outside the graph, transient ones are owned and aliased by it
+        bool imported{false};
+        scg::sGraphResourceState initialState;
+        VkImageLayout finalLayout{VK_IMAGE_LAYOUT_UNDEFINED};
+
+        uint32_t firstPass{UINT32_MAX};
+        uint32_t lastPass{0};
+    };
+
+    struct sGraphBuffer {
+        std::string name;
+        VkBuffer buffer;
+        scg::sGraphResourceState initialState;
+        bool output{false};
+    };
+
+    struct sGraphAttachment {
+        uint32_t image;
+        VkAttachmentLoadOp loadOp;
+        VkClearValue clearValue;
+        VkImageLayout layout;
+    };
+
+    struct sGraphAccess {
+        uint32_t resource;
+        bool buffer{false};
+        bool write{false};
+        VkPipelineStageFlags stages;
+        VkAccessFlags access;
+        VkImageLayout layout{VK_IMAGE_LAYOUT_UNDEFINED};
+    };
+
+    struct sGraphPass {
+        std::string name;
+        // color attachments in declaration order, then at most one depth attachment
+        std::vector<scg::sGraphAttachment> colorAttachments;
+        // empty, or one single sample target per color attachment
+        std::vector<scg::sGraphAttachment> resolveAttachments;
+        std::optional<scg::sGraphAttachment> depthAttachment;
+        std::vector<scg::sGraphAccess> accesses;
+        std::function<void(VkCommandBuffer)> execute;
+        // part of the attachments that is rendered, zero means all of it
+        VkExtent2D renderArea{0, 0};
+        // execute only calls vkCmdExecuteCommands inside the render pass
+        bool secondaryContents{false};
+
+        // filled in by scg::compileRenderGraph
+        bool culled{false};
+        VkRenderPass renderPass{VK_NULL_HANDLE};
+        VkFramebuffer framebuffer{VK_NULL_HANDLE};
+        VkExtent2D extent{0, 0};
+        VkPipelineStageFlags srcStages{0};
+        VkPipelineStageFlags dstStages{0};
+        VkMemoryBarrier memoryBarrier{};
+        std::vector<VkImageMemoryBarrier> imageBarriers;
+    };
+
+    struct sTransientImage {
+        VkImage image;
+        VkImageView view;
+        // every stage and access that touches the memory block, aliases included
+        VkPipelineStageFlags aliasStages;
+        VkAccessFlags aliasAccess;
+    };
+
+    struct sRenderGraph {
+        // declared again every frame
+        std::vector<scg::sGraphImage> images;
+        std::vector<scg::sGraphBuffer> buffers;
+        std::vector<scg::sGraphPass> passes;
+        VkPipelineStageFlags finalSrcStages{0};
+        std::vector<VkImageMemoryBarrier> finalBarriers;
+        // the pass scg::executeRenderGraph is inside of
+        uint32_t executingPass{0};
+
+        // kept across frames while the declarations stay the same
+        std::unordered_map<std::string, VkRenderPass> renderPasses;
+        std::unordered_map<std::string, VkFramebuffer> framebuffers;
+        std::string transientSignature;
+        std::vector<scg::sTransientImage> transientImages;
+        std::vector<VkDeviceMemory> transientMemory;
+        uint32_t culledPasses{UINT32_MAX};
+    };
+
+    struct sDynamicResolution {
+        bool enabled{false};
+
+        // a timestamp pair around every frame in flight
+        VkQueryPool queryPool{VK_NULL_HANDLE};
+        float timestampPeriod{1.0f};
+        uint64_t timestampMask{~0ull};
+        std::vector<bool> queryPending;
+
+        float budgetMs;
+        float minScale;
+        float maxScale;
+        float scale{1.0f};
+        float gpuMs{0.0f};
+        float smoothedGpuMs{0.0f};
+        std::chrono::steady_clock::time_point lastReport;
+
+        VkSampler sampler;
+        VkDescriptorSetLayout descriptorSetLayout;
+        // the scene view is written into a transient set every time the pass is recorded
+        VkDescriptorUpdateTemplate updateTemplate;
+        VkPipelineLayout pipelineLayout;
+        VkPipeline pipeline;
+    };
+
+    struct sReadbackSlot {
+        VkBuffer buffer{VK_NULL_HANDLE};
+        VkDeviceMemory memory{VK_NULL_HANDLE};
+        void* mapped{nullptr};
+        // the sequence frame the buffer holds and the timeline value that wrote it
+        uint64_t frame{0};
+        uint64_t timelineValue{0};
+        // submitted and waiting for the GPU, then owned by an encoder until it is free again
+        bool inFlight{false};
+        bool encoding{false};
+    };
+
+    struct sBatchRender {
+        bool enabled{false};
+        std::filesystem::path directory;
+        bool exr{false};
+        uint64_t frameCount{0};
+        uint32_t width{0};
+        uint32_t height{0};
+
+        std::vector<scg::sReadbackSlot> slots;
+        // the slot the frame being recorded copies into
+        uint32_t currentSlot{0};
+
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable workReady;
+        std::condition_variable slotFreed;
+        // slots whose frame has completed on the GPU, in frame order
+        std::deque<uint32_t> queue;
+        bool stopping{false};
+
+        std::chrono::steady_clock::time_point start;
+        uint64_t submitted{0};
+        uint64_t encoded{0};
+        double encodeMs{0.0};
+        // render thread time spent waiting for an encoder to free a slot
+        double stallMs{0.0};
+    };
+
+    struct sBenchmarkStats {
+        bool valid{false};
+        double mean{0.0};
+        double p50{0.0};
+        double p95{0.0};
+        double p99{0.0};
+        double max{0.0};
+    };
+
+    struct sBenchmark {
+        bool enabled{false};
+        std::string reportPath;
+        std::string baselinePath;
+        double threshold{10.0};
+        uint64_t warmupFrames{0};
+        // the scene advances by this much every frame, however long the frame took
+        double timestep{1.0 / 60.0};
+
+        // the benchmark frame each frame in flight last submitted, its GPU time arrives a few frames later
+        std::vector<uint64_t> slotFrames;
+        std::chrono::steady_clock::time_point lastPresent;
+        std::vector<double> cpuMs;
+        std::vector<double> gpuMs;
+        std::vector<double> presentMs;
+        bool regressed{false};
+    };
+
+    struct sMicrobenchRow {
+        std::string path;
+        uint64_t size;
+        double ms;
+        double throughput;
+        std::string unit;
+    };
+
+    // the CPU microbenchmarks built by make microbench, nothing here touches the GPU
+    struct sMicrobench {
+        uint64_t maxTriangles{10000000};
+        std::string csvPath;
+        std::string texturePath{"textures/viking_room.png"};
+        std::vector<scg::sMicrobenchRow> rows;
+        // results are folded in here so the compiler cannot drop the work
+        uint64_t sink{0};
+    };
+
+    struct sInitTask {
+        std::string name;
+        std::function<void()> run;
+        std::vector<uint32_t> dependencies;
+        std::vector<uint32_t> dependents;
+        // dependencies that have not finished yet, the task is ready at 0
+        uint32_t waitingOn{0};
+        // milliseconds since the graph started
+        double startMs{0.0};
+        double endMs{0.0};
+        uint32_t thread{0};
+    };
+
+    struct sInitGraph {
+        std::vector<scg::sInitTask> tasks;
+        std::unordered_map<std::string, uint32_t> taskIndices;
+
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<uint32_t> ready;
+        uint32_t finished{0};
+        // the first task to throw stops the graph, the exception is rethrown on the main thread
+        std::exception_ptr error;
+        std::chrono::steady_clock::time_point start;
+        double wallMs{0.0};
+    };
+
+    // std140, the planes are in object space so the bounding spheres never need transforming
+    struct sCullParams {
+        alignas(16) glm::vec4 planes[4];
+        uint32_t drawCount;
+    };
+
+    struct sAsyncCompute {
+        bool enabled{false};
+        // on its own queue the culling is a separate submission, otherwise it opens the frame's command buffer
+        bool separateQueue{false};
+        uint32_t drawCount{0};
+
+        VkCommandPool commandPool{VK_NULL_HANDLE};
+        // one per frame in flight, recorded once since everything that changes lives in the params buffers
+        std::vector<VkCommandBuffer> commandBuffers;
+        // signalled by the culling, waited on by the frame's draws
+        std::vector<VkSemaphore> cullFinishedSemaphores;
+
+        VkDescriptorSetLayout descriptorSetLayout;
+        VkDescriptorPool descriptorPool;
+        std::vector<VkDescriptorSet> descriptorSets;
+        VkPipelineLayout pipelineLayout;
+        VkPipeline pipeline;
+
+        // a bounding sphere and the unculled command of every draw
+        VkBuffer boundsBuffer;
+        VkDeviceMemory boundsBufferMemory;
+        VkBuffer unculledBuffer;
+        VkDeviceMemory unculledBufferMemory;
+        // per frame in flight, the host written planes and the culled commands the frame draws with
+        std::vector<VkBuffer> paramsBuffers;
+        std::vector<VkDeviceMemory> paramsBuffersMemory;
+        std::vector<void*> paramsMapped;
+        std::vector<VkBuffer> drawBuffers;
+        std::vector<VkDeviceMemory> drawBuffersMemory;
+    };
 }
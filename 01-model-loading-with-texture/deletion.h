@@ -0,0 +1,36 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <functional>
+
+#include "container.h"
+
+// Resources replaced while frames are in flight are destroyed once the graphics timeline passes the
+// value they were retired at, see scg::getPendingTimelineValue, instead of stalling the queue with
+// vkDeviceWaitIdle.
+namespace scg {
+    void deferDeletion(scg::sDeletionQueue& s_deletion, uint64_t frame, std::function<void()> destroy);
+    void flushDeletionQueue(scg::sDeletionQueue& s_deletion, uint64_t completedFrame);
+    void drainDeletionQueue(scg::sDeletionQueue& s_deletion);
+}
+
+void scg::deferDeletion(scg::sDeletionQueue& s_deletion, uint64_t frame, std::function<void()> destroy) {
+    s_deletion.entries.emplace_back(frame, std::move(destroy));
+}
+
+// entries are pushed in frame order, so everything up to completedFrame sits at the front
+void scg::flushDeletionQueue(scg::sDeletionQueue& s_deletion, uint64_t completedFrame) {
+    while (!s_deletion.entries.empty() && s_deletion.entries.front().first <= completedFrame) {
+        s_deletion.entries.front().second();
+        s_deletion.entries.pop_front();
+    }
+}
+
+void scg::drainDeletionQueue(scg::sDeletionQueue& s_deletion) {
+    for (auto& entry : s_deletion.entries) {
+        entry.second();
+    }
+    s_deletion.entries.clear();
+}
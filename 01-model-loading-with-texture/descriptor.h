@@ -4,35 +4,35 @@
 #include <GLFW/glfw3.h>
 
 #include <iostream>
+#include <cstddef>
+#include <cstring>
 
 #include "container.h"
+#include "zones.h"
+#include "descriptorallocator.h"
 //#include "device.h"
 
 namespace scg {
     void createDescriptorSetLayout(scg::sDevice& s_device, scg::sDescriptor& s_descriptor);
     void createDescriptorSets(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sDescriptor& s_descriptor, scg::sUniformBuffer& s_ubuf, scg::sTexture& s_texture);
-    void createDescriptorPool(sInstance& s_inst, sDevice& s_device, sDescriptor& s_descriptor);
+    void createDescriptorAllocators(scg::sInstance& s_inst, scg::sDescriptor& s_descriptor);
+    void destroyDescriptorAllocators(scg::sDevice& s_device, scg::sDescriptor& s_descriptor);
 }
 
-    void scg::createDescriptorPool(sInstance& s_inst, sDevice& s_device, sDescriptor& s_descriptor) {
-        std::array<VkDescriptorPoolSize, 2> poolSizes{};
-        poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        poolSizes[0].descriptorCount = static_cast<uint32_t>(s_inst.maxFramesInFlight);
-        poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        poolSizes[1].descriptorCount = static_cast<uint32_t>(s_inst.maxFramesInFlight);
-
-        VkDescriptorPoolCreateInfo poolInfo{};
-        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-        poolInfo.pPoolSizes = poolSizes.data();
-        poolInfo.maxSets = static_cast<uint32_t>(s_inst.maxFramesInFlight);
-
-        if (vkCreateDescriptorPool(s_device.device, &poolInfo, nullptr, &(s_descriptor.descriptorPool)) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create descriptor pool!");
-        }
-    }
+// The persistent chain holds sets of the frame layout, a uniform buffer and a texture, and starts
+// with room for the frame sets. Transient sets are the full screen passes' sampled images.
+void scg::createDescriptorAllocators(scg::sInstance& s_inst, scg::sDescriptor& s_descriptor) {
+    std::vector<VkDescriptorPoolSize> setSizes = {
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1}
+    };
+    scg::initDescriptorAllocator(s_descriptor.persistentAllocator, setSizes, static_cast<uint32_t>(s_inst.maxFramesInFlight));
+    s_descriptor.transientSetSizes = {{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1}};
+    s_descriptor.transientAllocators.resize(s_inst.maxFramesInFlight);
+}
 
 void scg::createDescriptorSetLayout(scg::sDevice& s_device, scg::sDescriptor& s_descriptor) {
+    SCG_FUNCTION_ZONE();
     VkDescriptorSetLayoutBinding uboLayoutBinding{};
     uboLayoutBinding.binding = 0;
     uboLayoutBinding.descriptorCount = 1;
@@ -58,52 +58,46 @@ void scg::createDescriptorSetLayout(scg::sDevice& s_device, scg::sDescriptor& s_
     }
 }
 
-    void scg::createDescriptorSets(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sDescriptor& s_descriptor, scg::sUniformBuffer& s_ubuf, scg::sTexture& s_texture) {
-        std::vector<VkDescriptorSetLayout> layouts(s_inst.maxFramesInFlight, s_descriptor.descriptorSetLayout);
-        VkDescriptorSetAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        allocInfo.descriptorPool = s_descriptor.descriptorPool;
-        allocInfo.descriptorSetCount = static_cast<uint32_t>(s_inst.maxFramesInFlight);
-        allocInfo.pSetLayouts = layouts.data();
-
-        std::cout << "init size of layouts and allocInfo{}" << std::endl;
-
-        s_descriptor.descriptorSets.resize(s_inst.maxFramesInFlight);
-        if (vkAllocateDescriptorSets(s_device.device, &allocInfo, s_descriptor.descriptorSets.data()) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate descriptor sets!");
-        }
-
-        std::cout << "resized and allocated memory for s_descriptor.descriptorSets" << std::endl;
-
-        for (size_t i = 0; i < s_inst.maxFramesInFlight; i++) {
-            VkDescriptorBufferInfo bufferInfo{};
-            bufferInfo.buffer = s_ubuf.uniformBuffers[i];
-            bufferInfo.offset = 0;
-            bufferInfo.range = sizeof(scg::UniformBufferObject);
-
-            VkDescriptorImageInfo imageInfo{};
-            imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            imageInfo.imageView = s_texture.textureImageView;
-            imageInfo.sampler = s_texture.textureSampler;
-
-            std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
-
-            descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[0].dstSet = s_descriptor.descriptorSets[i];
-            descriptorWrites[0].dstBinding = 0;
-            descriptorWrites[0].dstArrayElement = 0;
-            descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            descriptorWrites[0].descriptorCount = 1;
-            descriptorWrites[0].pBufferInfo = &bufferInfo;
-
-            descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[1].dstSet = s_descriptor.descriptorSets[i];
-            descriptorWrites[1].dstBinding = 1;
-            descriptorWrites[1].dstArrayElement = 0;
-            descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            descriptorWrites[1].descriptorCount = 1;
-            descriptorWrites[1].pImageInfo = &imageInfo;
+// The frame sets only differ in their uniform buffer and never change, so they come from the
+// cache and are written through the update template.
+void scg::createDescriptorSets(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sDescriptor& s_descriptor, scg::sUniformBuffer& s_ubuf, scg::sTexture& s_texture) {
+    SCG_FUNCTION_ZONE();
+    std::vector<VkDescriptorUpdateTemplateEntry> entries(2);
+    entries[0].dstBinding = 0;
+    entries[0].descriptorCount = 1;
+    entries[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    entries[0].offset = offsetof(scg::sFrameDescriptorData, uniformBuffer);
+    entries[0].stride = sizeof(scg::sFrameDescriptorData);
+    entries[1].dstBinding = 1;
+    entries[1].descriptorCount = 1;
+    entries[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    entries[1].offset = offsetof(scg::sFrameDescriptorData, texture);
+    entries[1].stride = sizeof(scg::sFrameDescriptorData);
+    s_descriptor.frameTemplate = scg::createDescriptorUpdateTemplate(s_device, s_descriptor.descriptorSetLayout, entries);
+
+    s_descriptor.descriptorSets.resize(s_inst.maxFramesInFlight);
+    for (int i = 0; i < s_inst.maxFramesInFlight; i++) {
+        scg::sFrameDescriptorData data;
+        std::memset(&data, 0, sizeof(data));
+        data.uniformBuffer.buffer = s_ubuf.uniformBuffers[i];
+        data.uniformBuffer.offset = 0;
+        data.uniformBuffer.range = sizeof(scg::UniformBufferObject);
+        data.texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        data.texture.imageView = s_texture.textureImageView;
+        data.texture.sampler = s_texture.textureSampler;
+
+        s_descriptor.descriptorSets[i] = scg::getCachedDescriptorSet(s_device, s_descriptor, s_descriptor.descriptorSetLayout, s_descriptor.frameTemplate, &data, sizeof(data));
+    }
+}
 
-            vkUpdateDescriptorSets(s_device.device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+void scg::destroyDescriptorAllocators(scg::sDevice& s_device, scg::sDescriptor& s_descriptor) {
+    for (auto& chains : s_descriptor.transientAllocators) {
+        for (auto& s_alloc : chains) {
+            scg::destroyDescriptorAllocator(s_device, s_alloc);
         }
     }
+    s_descriptor.transientAllocators.clear();
+    scg::destroyDescriptorAllocator(s_device, s_descriptor.persistentAllocator);
+    s_descriptor.cachedSets.clear();
+    vkDestroyDescriptorUpdateTemplate(s_device.device, s_descriptor.frameTemplate, nullptr);
+}
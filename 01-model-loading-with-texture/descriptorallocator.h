@@ -0,0 +1,170 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+
+#include "container.h"
+#include "zones.h"
+#include "shaderlibrary.h"
+
+// Descriptor sets come from chains of pools instead of one pool sized up front. When a pool runs
+// out the allocator sets it aside and takes the next one, creating it with twice the sets of the
+// last, so any number of sets can be allocated. A chain is reset wholesale, never freed set by
+// set. Transient sets come from a chain per primary command buffer, reset when that buffer is
+// recorded again, which is only after the wait for its frame slot. Sets whose contents never
+// change are cached by a hash of their layout and contents, so asking for the same set again
+// costs a lookup. Sets are written through update templates, one call for all of a set's bindings.
+namespace scg {
+    void initDescriptorAllocator(scg::sDescriptorAllocator& s_alloc, const std::vector<VkDescriptorPoolSize>& setSizes, uint32_t setsPerPool);
+    VkDescriptorPool takeDescriptorPool(scg::sDevice& s_device, scg::sDescriptorAllocator& s_alloc);
+    VkDescriptorSet allocateDescriptorSet(scg::sDevice& s_device, scg::sDescriptorAllocator& s_alloc, VkDescriptorSetLayout layout);
+    void resetDescriptorAllocator(scg::sDevice& s_device, scg::sDescriptorAllocator& s_alloc);
+    void destroyDescriptorAllocator(scg::sDevice& s_device, scg::sDescriptorAllocator& s_alloc);
+    VkDescriptorUpdateTemplate createDescriptorUpdateTemplate(scg::sDevice& s_device, VkDescriptorSetLayout layout, const std::vector<VkDescriptorUpdateTemplateEntry>& entries);
+    VkDescriptorSet getCachedDescriptorSet(scg::sDevice& s_device, scg::sDescriptor& s_descriptor, VkDescriptorSetLayout layout, VkDescriptorUpdateTemplate updateTemplate, const void* data, size_t size);
+    scg::sDescriptorAllocator& getTransientAllocator(scg::sDescriptor& s_descriptor, uint32_t frame, uint32_t image);
+    void beginTransientDescriptors(scg::sDevice& s_device, scg::sDescriptor& s_descriptor, uint32_t frame, uint32_t image);
+    VkDescriptorSet allocateTransientDescriptorSet(scg::sDevice& s_device, scg::sDescriptor& s_descriptor, uint32_t frame, uint32_t image, VkDescriptorSetLayout layout, VkDescriptorUpdateTemplate updateTemplate, const void* data);
+}
+
+// pools are only created when the first set is allocated
+void scg::initDescriptorAllocator(scg::sDescriptorAllocator& s_alloc, const std::vector<VkDescriptorPoolSize>& setSizes, uint32_t setsPerPool) {
+    s_alloc.setSizes = setSizes;
+    s_alloc.setsPerPool = std::max(1u, setsPerPool);
+}
+
+VkDescriptorPool scg::takeDescriptorPool(scg::sDevice& s_device, scg::sDescriptorAllocator& s_alloc) {
+    if (!s_alloc.freePools.empty()) {
+        VkDescriptorPool pool = s_alloc.freePools.back();
+        s_alloc.freePools.pop_back();
+        return pool;
+    }
+
+    std::vector<VkDescriptorPoolSize> poolSizes = s_alloc.setSizes;
+    for (auto& poolSize : poolSizes) {
+        poolSize.descriptorCount *= s_alloc.setsPerPool;
+    }
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = s_alloc.setsPerPool;
+
+    VkDescriptorPool pool;
+    if (vkCreateDescriptorPool(s_device.device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor pool!");
+    }
+    s_alloc.setsPerPool = std::min(s_alloc.setsPerPool * 2, 4096u);
+    return pool;
+}
+
+// a pool that is out of memory or too fragmented is done until the chain is reset
+VkDescriptorSet scg::allocateDescriptorSet(scg::sDevice& s_device, scg::sDescriptorAllocator& s_alloc, VkDescriptorSetLayout layout) {
+    if (s_alloc.currentPool == VK_NULL_HANDLE) {
+        s_alloc.currentPool = scg::takeDescriptorPool(s_device, s_alloc);
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = s_alloc.currentPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+
+    VkDescriptorSet set;
+    VkResult result = vkAllocateDescriptorSets(s_device.device, &allocInfo, &set);
+    if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+        s_alloc.fullPools.push_back(s_alloc.currentPool);
+        s_alloc.currentPool = scg::takeDescriptorPool(s_device, s_alloc);
+        allocInfo.descriptorPool = s_alloc.currentPool;
+        result = vkAllocateDescriptorSets(s_device.device, &allocInfo, &set);
+    }
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate descriptor set!");
+    }
+    return set;
+}
+
+// every set of the chain goes at once, the pools are kept for the next round
+void scg::resetDescriptorAllocator(scg::sDevice& s_device, scg::sDescriptorAllocator& s_alloc) {
+    if (s_alloc.currentPool == VK_NULL_HANDLE) {
+        return;
+    }
+    s_alloc.fullPools.push_back(s_alloc.currentPool);
+    s_alloc.currentPool = VK_NULL_HANDLE;
+    for (VkDescriptorPool pool : s_alloc.fullPools) {
+        vkResetDescriptorPool(s_device.device, pool, 0);
+        s_alloc.freePools.push_back(pool);
+    }
+    s_alloc.fullPools.clear();
+}
+
+void scg::destroyDescriptorAllocator(scg::sDevice& s_device, scg::sDescriptorAllocator& s_alloc) {
+    scg::resetDescriptorAllocator(s_device, s_alloc);
+    for (VkDescriptorPool pool : s_alloc.freePools) {
+        vkDestroyDescriptorPool(s_device.device, pool, nullptr);
+    }
+    s_alloc.freePools.clear();
+}
+
+VkDescriptorUpdateTemplate scg::createDescriptorUpdateTemplate(scg::sDevice& s_device, VkDescriptorSetLayout layout, const std::vector<VkDescriptorUpdateTemplateEntry>& entries) {
+    VkDescriptorUpdateTemplateCreateInfo templateInfo{};
+    templateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+    templateInfo.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+    templateInfo.pDescriptorUpdateEntries = entries.data();
+    templateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+    templateInfo.descriptorSetLayout = layout;
+
+    VkDescriptorUpdateTemplate updateTemplate;
+    if (vkCreateDescriptorUpdateTemplate(s_device.device, &templateInfo, nullptr, &updateTemplate) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor update template!");
+    }
+    return updateTemplate;
+}
+
+// The data is hashed as bytes, padding included, so callers zero it before filling it in. Only for
+// sets whose resources live until cleanup, a destroyed resource's handle may come back.
+VkDescriptorSet scg::getCachedDescriptorSet(scg::sDevice& s_device, scg::sDescriptor& s_descriptor, VkDescriptorSetLayout layout, VkDescriptorUpdateTemplate updateTemplate, const void* data, size_t size) {
+    std::vector<unsigned char> key(sizeof(layout) + size);
+    std::memcpy(key.data(), &layout, sizeof(layout));
+    std::memcpy(key.data() + sizeof(layout), data, size);
+    std::vector<scg::sCachedDescriptorSet>& bucket = s_descriptor.cachedSets[scg::hashBytes(key.data(), key.size())];
+    for (const auto& cached : bucket) {
+        if (cached.key.size() == key.size() && std::memcmp(cached.key.data(), key.data(), key.size()) == 0) {
+            return cached.set;
+        }
+    }
+
+    VkDescriptorSet set = scg::allocateDescriptorSet(s_device, s_descriptor.persistentAllocator, layout);
+    vkUpdateDescriptorSetWithTemplate(s_device.device, set, updateTemplate, data);
+    bucket.push_back({std::move(key), set});
+    return set;
+}
+
+// the swapchain image count may grow when the swapchain is recreated, new chains are added on demand
+scg::sDescriptorAllocator& scg::getTransientAllocator(scg::sDescriptor& s_descriptor, uint32_t frame, uint32_t image) {
+    std::vector<scg::sDescriptorAllocator>& chains = s_descriptor.transientAllocators[frame];
+    while (chains.size() <= image) {
+        chains.emplace_back();
+        scg::initDescriptorAllocator(chains.back(), s_descriptor.transientSetSizes, 8);
+    }
+    return chains[image];
+}
+
+// Right before the command buffer is recorded again. The frame slot has been waited for, so the
+// last submission of that buffer, and every set it bound, is no longer in use.
+void scg::beginTransientDescriptors(scg::sDevice& s_device, scg::sDescriptor& s_descriptor, uint32_t frame, uint32_t image) {
+    scg::resetDescriptorAllocator(s_device, scg::getTransientAllocator(s_descriptor, frame, image));
+}
+
+VkDescriptorSet scg::allocateTransientDescriptorSet(scg::sDevice& s_device, scg::sDescriptor& s_descriptor, uint32_t frame, uint32_t image, VkDescriptorSetLayout layout, VkDescriptorUpdateTemplate updateTemplate, const void* data) {
+    VkDescriptorSet set = scg::allocateDescriptorSet(s_device, scg::getTransientAllocator(s_descriptor, frame, image), layout);
+    vkUpdateDescriptorSetWithTemplate(s_device.device, set, updateTemplate, data);
+    return set;
+}
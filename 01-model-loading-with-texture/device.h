@@ -4,22 +4,35 @@
 #include <GLFW/glfw3.h>
 
 #include <vector>
+#include <cstring>
+#include <algorithm>
 #include <stdexcept>
+#include <iostream>
 
 #include "container.h"
+#include "capabilities.h"
+#include "zones.h"
 
 namespace scg {
     void createDevice(scg::sInstance& s_inst, scg::sDevice& s_device);
-    void pickPhysicalDevice(scg::sInstance& s_inst, VkPhysicalDevice& physicalDevice);
+    void pickPhysicalDevice(scg::sInstance& s_inst, scg::sDevice& s_device);
     void createLogicalDevice(scg::sInstance& s_inst, scg::sDevice& s_device);
 }
 
 void scg::createDevice(scg::sInstance& s_inst, scg::sDevice& s_device) {
-    scg::pickPhysicalDevice(s_inst, s_device.physicalDevice);
+    SCG_FUNCTION_ZONE();
+    // without a surface there is no swapchain, and software drivers may not offer the extension
+    if (s_inst.headless) {
+        s_inst.deviceExtensions.erase(std::remove_if(s_inst.deviceExtensions.begin(), s_inst.deviceExtensions.end(), [](const char* extension) {
+            return strcmp(extension, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0;
+        }), s_inst.deviceExtensions.end());
+    }
+    scg::pickPhysicalDevice(s_inst, s_device);
     scg::createLogicalDevice(s_inst, s_device);
 }
 
-void scg::pickPhysicalDevice(sInstance& s_inst, VkPhysicalDevice& physicalDevice) {
+// every candidate is logged with its score, --device overrides the ranking but not suitability
+void scg::pickPhysicalDevice(sInstance& s_inst, sDevice& s_device) {
     uint32_t deviceCount{0};
     vkEnumeratePhysicalDevices(s_inst.instance, &deviceCount, nullptr);
 
@@ -30,24 +43,48 @@ void scg::pickPhysicalDevice(sInstance& s_inst, VkPhysicalDevice& physicalDevice
     std::vector<VkPhysicalDevice> devices(deviceCount);
     vkEnumeratePhysicalDevices(s_inst.instance, &deviceCount, devices.data());
 
-    for (auto& pdevice : devices) {
-        if (scg::isDeviceSuitable(pdevice, s_inst.surface, s_inst.deviceExtensions)) {
-            physicalDevice = pdevice;
-            break;
+    std::vector<scg::sDeviceCapabilities> candidates(deviceCount);
+    int64_t best = -1;
+    for (uint32_t i = 0; i < deviceCount; i++) {
+        scg::sDeviceCapabilities& caps = candidates[i];
+        scg::buildDeviceCapabilities(devices[i], i, s_inst.surface, s_inst.deviceExtensions, caps);
+        std::cout << "GPU " << i << ": " << caps.properties.deviceName << ", " << (caps.deviceLocalBytes >> 20) << " MiB device local, "
+            << (caps.suitable ? "score " + std::to_string(caps.score) : std::string("unsuitable")) << std::endl;
+
+        bool preferred = !s_inst.preferredDevice.empty() && scg::matchesPreferredDevice(caps, s_inst.preferredDevice);
+        if (!s_inst.preferredDevice.empty() && !preferred) {
+            continue;
+        }
+        if (preferred && !caps.suitable) {
+            throw std::runtime_error("failed to use GPU " + s_inst.preferredDevice + ", it is not suitable!");
+        }
+        if (caps.suitable && (best < 0 || caps.score > candidates[best].score)) {
+            best = i;
         }
     }
 
-    if (physicalDevice == VK_NULL_HANDLE) {
+    if (best < 0 && !s_inst.preferredDevice.empty()) {
+        throw std::runtime_error("failed to find GPU " + s_inst.preferredDevice + "!");
+    }
+    if (best < 0) {
         throw std::runtime_error("failed to find a suitable GPU!");
     }
+
+    s_device.caps = std::move(candidates[best]);
+    s_device.physicalDevice = s_device.caps.physicalDevice;
+    scg::cacheFormatProperties(s_device.caps);
+    std::cout << "using GPU " << s_device.caps.index << ": " << s_device.caps.properties.deviceName << std::endl;
 }
 
 void scg::createLogicalDevice(sInstance& s_inst, sDevice& s_device) {
-    scg::QueueFamilyIndices indices = findQueueFamilies(s_device.physicalDevice, s_inst.surface);
+    scg::QueueFamilyIndices indices = s_device.caps.queueIndices;
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 
     std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+    s_device.asyncCompute = s_inst.enableAsyncCompute && indices.computeFamily != indices.graphicsFamily;
+    s_device.computeFamily = s_device.asyncCompute ? indices.computeFamily.value() : indices.graphicsFamily.value();
+    uniqueQueueFamilies.insert(s_device.computeFamily);
 
     float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -59,19 +96,79 @@ void scg::createLogicalDevice(sInstance& s_inst, sDevice& s_device) {
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    const VkPhysicalDeviceFeatures& supportedFeatures = s_device.caps.features;
+
     VkPhysicalDeviceFeatures deviceFeatures{};
     deviceFeatures.samplerAnisotropy = VK_TRUE;
+    deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+    deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+    s_device.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+    s_device.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
+    std::vector<const char*> deviceExtensions = s_inst.deviceExtensions;
+
+    // only the features the bindless texture table relies on
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures{};
+    indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+    if (s_inst.enableBindless && s_device.caps.descriptorIndexing) {
+        deviceExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+        deviceExtensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+
+        indexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+        indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+        indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+        indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        indexingFeatures.descriptorBindingVariableDescriptorCount = VK_TRUE;
+        createInfo.pNext = &indexingFeatures;
+
+        const VkPhysicalDeviceDescriptorIndexingPropertiesEXT& indexingProperties = s_device.caps.indexingProperties;
+        s_device.descriptorIndexing = true;
+        s_device.maxBindlessTextures = std::min({
+            s_inst.maxBindlessTextures,
+            indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+            indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+            indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers
+        });
+    }
+
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT libraryFeatures{};
+    libraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+
+    if (s_inst.enableGraphicsPipelineLibrary && s_device.caps.graphicsPipelineLibrary) {
+        deviceExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+        deviceExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+
+        libraryFeatures.graphicsPipelineLibrary = VK_TRUE;
+        libraryFeatures.pNext = const_cast<void*>(createInfo.pNext);
+        createInfo.pNext = &libraryFeatures;
+
+        s_device.graphicsPipelineLibrary = true;
+    }
+
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures{};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+
+    if (s_inst.enableTimelineSemaphore && s_device.caps.timelineSemaphore) {
+        deviceExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+
+        timelineFeatures.timelineSemaphore = VK_TRUE;
+        timelineFeatures.pNext = const_cast<void*>(createInfo.pNext);
+        createInfo.pNext = &timelineFeatures;
+
+        s_device.timelineSemaphore = true;
+    }
+
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
     createInfo.pEnabledFeatures = &deviceFeatures;
 
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(s_inst.deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = s_inst.deviceExtensions.data();
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
     if (s_inst.enableValidationLayers) {
         createInfo.enabledLayerCount = static_cast<uint32_t>(s_inst.validationLayers.size());
@@ -86,4 +183,24 @@ void scg::createLogicalDevice(sInstance& s_inst, sDevice& s_device) {
 
     vkGetDeviceQueue(s_device.device, indices.graphicsFamily.value(), 0, &(s_device.graphicsQueue));
     vkGetDeviceQueue(s_device.device, indices.presentFamily.value(), 0, &(s_device.presentQueue));
+    vkGetDeviceQueue(s_device.device, s_device.computeFamily, 0, &(s_device.computeQueue));
+
+    if (s_device.timelineSemaphore) {
+        s_device.waitSemaphores = (PFN_vkWaitSemaphoresKHR) vkGetDeviceProcAddr(s_device.device, "vkWaitSemaphoresKHR");
+        s_device.getSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValueKHR) vkGetDeviceProcAddr(s_device.device, "vkGetSemaphoreCounterValueKHR");
+
+        VkSemaphoreTypeCreateInfoKHR typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+        typeInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+
+        if (vkCreateSemaphore(s_device.device, &semaphoreInfo, nullptr, &(s_device.graphicsTimeline)) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create graphics timeline semaphore!");
+        }
+    }
+    std::cout << (s_device.timelineSemaphore ? "tracking GPU progress with a timeline semaphore" : "timeline semaphores unavailable, tracking GPU progress with fences") << std::endl;
 }
@@ -29,8 +29,7 @@ bool scg::hasStencilComponent(VkFormat format) {
 
 VkFormat scg::findSupportedFormat(scg::sDevice& s_device, const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) {
     for (VkFormat format : candidates) {
-        VkFormatProperties props;
-        vkGetPhysicalDeviceFormatProperties(s_device.physicalDevice, format, &props);
+        VkFormatProperties props = scg::getFormatProperties(s_device.caps, format);
 
         if (tiling == VK_IMAGE_TILING_LINEAR && (props.linearTilingFeatures & features) == features) {
             return format;
@@ -0,0 +1,213 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#include "helper.h"
+#include "container.h"
+#include "zones.h"
+#include "trace.h"
+
+// Named GPU scopes, each a timestamp pair, that nest inside a frame's command buffer. Every frame
+// in flight owns a range of one query pool and the range is read once that frame has completed,
+// so reading the results never waits on the GPU. The last pair of the pool belongs to the one-off
+// uploads, which wait for the GPU anyway. Durations feed a rolling window per scope name that is
+// reported as min, average and p99, and with a trace they are laid out on a GPU track. GPU ticks
+// are not calibrated against the CPU clock, so a GPU frame is placed at its submit time, or right
+// after the previous GPU frame if that ends later.
+namespace scg {
+    void createGpuProfiler(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sCommand& s_command, scg::sTrace& s_trace, scg::sGpuProfiler& s_gprof);
+    void destroyGpuProfiler(scg::sDevice& s_device, scg::sCommand& s_command, scg::sGpuProfiler& s_gprof);
+    void beginGpuProfilerFrame(VkCommandBuffer commandBuffer, scg::sGpuProfiler& s_gprof, uint32_t frame);
+    void beginGpuScope(VkCommandBuffer commandBuffer, scg::sGpuProfiler& s_gprof, uint32_t frame, const std::string& name);
+    void endGpuScope(VkCommandBuffer commandBuffer, scg::sGpuProfiler& s_gprof, uint32_t frame);
+    void submitGpuProfilerFrame(scg::sGpuProfiler& s_gprof, uint32_t frame);
+    void collectGpuProfilerFrame(scg::sDevice& s_device, scg::sCommand& s_command, scg::sTrace& s_trace, scg::sGpuProfiler& s_gprof, uint32_t frame);
+    void addGpuScopeSample(scg::sTrace& s_trace, scg::sGpuProfiler& s_gprof, const std::string& name, double startUs, double ms);
+    void reportGpuProfiler(scg::sGpuProfiler& s_gprof);
+}
+
+void scg::createGpuProfiler(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sCommand& s_command, scg::sTrace& s_trace, scg::sGpuProfiler& s_gprof) {
+    SCG_FUNCTION_ZONE();
+    if (!s_inst.enableGpuProfiler) {
+        return;
+    }
+
+    const VkPhysicalDeviceProperties& properties = s_device.caps.properties;
+    uint32_t validBits = s_device.caps.queueFamilies[s_device.caps.queueIndices.graphicsFamily.value()].timestampValidBits;
+
+    if (!properties.limits.timestampComputeAndGraphics || validBits == 0) {
+        std::cout << "timestamps unsupported, GPU profiler disabled" << std::endl;
+        return;
+    }
+    s_gprof.timestampPeriod = properties.limits.timestampPeriod;
+    s_gprof.timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = s_gprof.queriesPerFrame * static_cast<uint32_t>(s_inst.maxFramesInFlight) + 2;
+
+    if (vkCreateQueryPool(s_device.device, &queryPoolInfo, nullptr, &(s_gprof.queryPool)) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create profiler query pool!");
+    }
+    s_gprof.frames.resize(s_inst.maxFramesInFlight);
+    s_gprof.traceTrack = scg::addTraceTrack(s_trace, "GPU graphics queue");
+    s_gprof.enabled = true;
+
+    s_command.uploadQueryPool = s_gprof.queryPool;
+    s_command.uploadQuery = queryPoolInfo.queryCount - 2;
+    s_command.timestampPeriod = s_gprof.timestampPeriod;
+    s_command.timestampMask = s_gprof.timestampMask;
+}
+
+void scg::destroyGpuProfiler(scg::sDevice& s_device, scg::sCommand& s_command, scg::sGpuProfiler& s_gprof) {
+    if (s_gprof.queryPool == VK_NULL_HANDLE) {
+        return;
+    }
+    vkDestroyQueryPool(s_device.device, s_gprof.queryPool, nullptr);
+    s_gprof.queryPool = VK_NULL_HANDLE;
+    s_command.uploadQueryPool = VK_NULL_HANDLE;
+}
+
+// recorded outside of any render pass, before the first scope of the frame
+void scg::beginGpuProfilerFrame(VkCommandBuffer commandBuffer, scg::sGpuProfiler& s_gprof, uint32_t frame) {
+    if (!s_gprof.enabled) {
+        return;
+    }
+    scg::sGpuProfilerFrame& profilerFrame = s_gprof.frames[frame];
+    profilerFrame.scopes.clear();
+    profilerFrame.open.clear();
+    profilerFrame.nextQuery = 0;
+    vkCmdResetQueryPool(commandBuffer, s_gprof.queryPool, frame * s_gprof.queriesPerFrame, s_gprof.queriesPerFrame);
+}
+
+// scopes past the frame's query range are still matched with their end, they just do not write
+void scg::beginGpuScope(VkCommandBuffer commandBuffer, scg::sGpuProfiler& s_gprof, uint32_t frame, const std::string& name) {
+    if (!s_gprof.enabled) {
+        return;
+    }
+    scg::sGpuProfilerFrame& profilerFrame = s_gprof.frames[frame];
+
+    scg::sGpuScope scope{};
+    scope.name = name;
+    scope.depth = static_cast<uint32_t>(profilerFrame.open.size());
+    scope.beginQuery = UINT32_MAX;
+    scope.endQuery = UINT32_MAX;
+    if (profilerFrame.nextQuery + 2 <= s_gprof.queriesPerFrame) {
+        scope.beginQuery = profilerFrame.nextQuery++;
+        scope.endQuery = profilerFrame.nextQuery++;
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, s_gprof.queryPool, frame * s_gprof.queriesPerFrame + scope.beginQuery);
+    }
+
+    profilerFrame.open.push_back(static_cast<uint32_t>(profilerFrame.scopes.size()));
+    profilerFrame.scopes.push_back(scope);
+}
+
+void scg::endGpuScope(VkCommandBuffer commandBuffer, scg::sGpuProfiler& s_gprof, uint32_t frame) {
+    if (!s_gprof.enabled) {
+        return;
+    }
+    scg::sGpuProfilerFrame& profilerFrame = s_gprof.frames[frame];
+    const scg::sGpuScope& scope = profilerFrame.scopes[profilerFrame.open.back()];
+    profilerFrame.open.pop_back();
+    if (scope.endQuery != UINT32_MAX) {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, s_gprof.queryPool, frame * s_gprof.queriesPerFrame + scope.endQuery);
+    }
+}
+
+// cached command buffers write their timestamps without being recorded again, so this goes with the submit
+void scg::submitGpuProfilerFrame(scg::sGpuProfiler& s_gprof, uint32_t frame) {
+    if (!s_gprof.enabled) {
+        return;
+    }
+    s_gprof.frames[frame].pending = true;
+    s_gprof.frames[frame].submitTime = std::chrono::steady_clock::now();
+}
+
+// the frame has completed, so its queries are available and reading them does not wait
+void scg::collectGpuProfilerFrame(scg::sDevice& s_device, scg::sCommand& s_command, scg::sTrace& s_trace, scg::sGpuProfiler& s_gprof, uint32_t frame) {
+    if (!s_gprof.enabled) {
+        return;
+    }
+
+    for (const auto& upload : s_command.uploadTimings) {
+        scg::addGpuScopeSample(s_trace, s_gprof, "upload", std::max(scg::traceMicroseconds(s_trace, upload.start), s_gprof.gpuCursorUs), upload.gpuMs);
+    }
+    s_command.uploadTimings.clear();
+
+    scg::sGpuProfilerFrame& profilerFrame = s_gprof.frames[frame];
+    if (!profilerFrame.pending || profilerFrame.nextQuery == 0) {
+        return;
+    }
+    profilerFrame.pending = false;
+
+    std::vector<uint64_t> timestamps(profilerFrame.nextQuery);
+    if (vkGetQueryPoolResults(s_device.device, s_gprof.queryPool, frame * s_gprof.queriesPerFrame, profilerFrame.nextQuery, timestamps.size() * sizeof(uint64_t),
+            timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+        return;
+    }
+
+    // the first scope opened is the outermost one, everything else is placed relative to it
+    uint64_t origin = timestamps[profilerFrame.scopes.front().beginQuery];
+    double frameStartUs = std::max(scg::traceMicroseconds(s_trace, profilerFrame.submitTime), s_gprof.gpuCursorUs);
+    for (const auto& scope : profilerFrame.scopes) {
+        if (scope.beginQuery == UINT32_MAX) {
+            continue;
+        }
+        double offsetMs = static_cast<double>((timestamps[scope.beginQuery] - origin) & s_gprof.timestampMask) * s_gprof.timestampPeriod / 1000000.0;
+        double ms = static_cast<double>((timestamps[scope.endQuery] - timestamps[scope.beginQuery]) & s_gprof.timestampMask) * s_gprof.timestampPeriod / 1000000.0;
+        scg::addGpuScopeSample(s_trace, s_gprof, scope.name, frameStartUs + offsetMs * 1000.0, ms);
+        if (scope.depth == 0) {
+            s_gprof.frameMs = ms;
+        }
+    }
+
+    s_gprof.resolvedFrames++;
+    if (s_gprof.resolvedFrames == s_gprof.reportInterval) {
+        scg::reportGpuProfiler(s_gprof);
+        s_gprof.resolvedFrames = 0;
+    }
+}
+
+void scg::addGpuScopeSample(scg::sTrace& s_trace, scg::sGpuProfiler& s_gprof, const std::string& name, double startUs, double ms) {
+    auto found = s_gprof.stats.find(name);
+    if (found == s_gprof.stats.end()) {
+        found = s_gprof.stats.emplace(name, scg::sGpuScopeStats{}).first;
+        s_gprof.scopeOrder.push_back(name);
+    }
+    scg::sGpuScopeStats& stats = found->second;
+    if (stats.samples.size() < s_gprof.window) {
+        stats.samples.push_back(ms);
+    } else {
+        stats.samples[stats.next] = ms;
+        stats.next = (stats.next + 1) % s_gprof.window;
+    }
+
+    scg::addTraceEvent(s_trace, name, "gpu", s_gprof.traceTrack, startUs, ms * 1000.0);
+    s_gprof.gpuCursorUs = std::max(s_gprof.gpuCursorUs, startUs + ms * 1000.0);
+}
+
+void scg::reportGpuProfiler(scg::sGpuProfiler& s_gprof) {
+    for (const auto& name : s_gprof.scopeOrder) {
+        std::vector<double> samples = s_gprof.stats[name].samples;
+        if (samples.empty()) {
+            continue;
+        }
+        std::sort(samples.begin(), samples.end());
+        double sum = 0.0;
+        for (double sample : samples) {
+            sum += sample;
+        }
+        size_t p99 = (samples.size() * 99 + 99) / 100 - 1;
+        std::cout << "gpu " << name << ": min " << samples.front() << " ms, avg " << sum / samples.size() << " ms, p99 " << samples[p99]
+            << " ms over the last " << samples.size() << " samples" << std::endl;
+    }
+}
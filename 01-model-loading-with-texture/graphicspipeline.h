@@ -4,39 +4,193 @@
 #include <GLFW/glfw3.h>
 
 #include <vector>
+#include <array>
+#include <cstring>
 #include <string>
-#include <fstream>
+#include <chrono>
+#include <iostream>
 #include <stdexcept>
 
 #include "container.h"
+#include "zones.h"
 #include "vertex.h"
 
 namespace scg {
-    void createGraphicsPipeline(scg::sDevice& s_device, scg::sDescriptor& s_descriptor, scg::sRenderPass& s_rpass, scg::sGraphicsPipeline& s_gpipeline);
-    std::vector<char> readSpvFile(const std::string& filename);
-    VkShaderModule createShaderModule(const std::vector<char>& code, VkDevice& device);
+    void createGraphicsPipeline(scg::sDevice& s_device, scg::sDescriptor& s_descriptor, scg::sRenderPass& s_rpass, scg::sPipelineCache& s_pcache, scg::sGraphicsPipeline& s_gpipeline);
+    void createDepthPipelines(scg::sDevice& s_device, scg::sRenderPass& s_rpass, scg::sPipelineCache& s_pcache, scg::sGraphicsPipeline& s_gpipeline);
+    VkCompareOp getDepthCompareOp(scg::sGraphicsPipeline& s_gpipeline, bool depthPrepass);
+    VkPipeline buildGraphicsPipeline(scg::sDevice& s_device, scg::sRenderPass& s_rpass, scg::sPipelineCache& s_pcache, scg::sGraphicsPipeline& s_gpipeline, const scg::sPipelineKey& key, VkGraphicsPipelineLibraryFlagsEXT parts, const std::vector<VkPipeline>& libraries, VkPipelineCreateFlags flags);
 }
 
-void scg::createGraphicsPipeline(scg::sDevice& s_device, scg::sDescriptor& s_descriptor, scg::sRenderPass& s_rpass, scg::sGraphicsPipeline& s_gpipeline) {
-    auto vertShaderCode = scg::readSpvFile("shaders/vert.spv");
-    auto fragShaderCode = scg::readSpvFile("shaders/frag.spv");
+void scg::createGraphicsPipeline(scg::sDevice& s_device, scg::sDescriptor& s_descriptor, scg::sRenderPass& s_rpass, scg::sPipelineCache& s_pcache, scg::sGraphicsPipeline& s_gpipeline) {
+    SCG_FUNCTION_ZONE();
+    // the shader modules come from the shader library, see scg::createShaderLibrary
+    std::vector<VkDescriptorSetLayout> setLayouts = {s_descriptor.descriptorSetLayout};
+    if (s_descriptor.useBindless) {
+        setLayouts.push_back(s_descriptor.bindlessSetLayout);
+    }
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+
+    if (vkCreatePipelineLayout(s_device.device, &pipelineLayoutInfo, nullptr, &(s_gpipeline.pipelineLayout)) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    s_gpipeline.graphicsPipeline = scg::buildGraphicsPipeline(s_device, s_rpass, s_pcache, s_gpipeline, s_gpipeline.defaultKey, 0, {}, 0);
+    auto elapsed = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+    std::cout << "created graphics pipeline in " << elapsed << " ms (" << (s_pcache.loadedSize > 0 ? "warm" : "cold") << " pipeline cache)" << std::endl;
+}
 
-    VkShaderModule vertShaderModule = scg::createShaderModule(vertShaderCode, s_device.device);
-    VkShaderModule fragShaderModule = scg::createShaderModule(fragShaderCode, s_device.device);
+// with a prepass only the fragments that won the depth test get shaded
+VkCompareOp scg::getDepthCompareOp(scg::sGraphicsPipeline& s_gpipeline, bool depthPrepass) {
+    if (depthPrepass) {
+        return VK_COMPARE_OP_EQUAL;
+    }
+    return s_gpipeline.reversedZ ? VK_COMPARE_OP_GREATER : VK_COMPARE_OP_LESS;
+}
 
+// Position only pipelines for the depth prepass, one per cull mode. There is no fragment shader,
+// so alpha tested geometry cannot go through the prepass.
+void scg::createDepthPipelines(scg::sDevice& s_device, scg::sRenderPass& s_rpass, scg::sPipelineCache& s_pcache, scg::sGraphicsPipeline& s_gpipeline) {
+    SCG_FUNCTION_ZONE();
     VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
     vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vertShaderStageInfo.module = vertShaderModule;
+    vertShaderStageInfo.module = s_gpipeline.depthShaderModule;
+    vertShaderStageInfo.pName = "main";
+
+    auto bindingDescription = scg::getPositionBindingDescription();
+    auto attributeDescription = scg::getPositionAttributeDescription();
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputInfo.vertexBindingDescriptionCount = 1;
+    vertexInputInfo.vertexAttributeDescriptionCount = 1;
+    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+    vertexInputInfo.pVertexAttributeDescriptions = &attributeDescription;
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.depthClampEnable = VK_FALSE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterizer.depthBiasEnable = VK_FALSE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.rasterizationSamples = s_rpass.samples;
+
+    VkPipelineDepthStencilStateCreateInfo depthStencil{};
+    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencil.depthTestEnable = VK_TRUE;
+    depthStencil.depthWriteEnable = VK_TRUE;
+    depthStencil.depthCompareOp = scg::getDepthCompareOp(s_gpipeline, false);
+    depthStencil.depthBoundsTestEnable = VK_FALSE;
+    depthStencil.stencilTestEnable = VK_FALSE;
+
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.attachmentCount = 0;
+
+    std::vector<VkDynamicState> dynamicStates = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR
+    };
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+    dynamicState.pDynamicStates = dynamicStates.data();
+
+    for (uint32_t doubleSided = 0; doubleSided < 2; doubleSided++) {
+        rasterizer.cullMode = doubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = 1;
+        pipelineInfo.pStages = &vertShaderStageInfo;
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = &depthStencil;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDynamicState = &dynamicState;
+        pipelineInfo.layout = s_gpipeline.pipelineLayout;
+        pipelineInfo.renderPass = s_rpass.depthRenderPass;
+        pipelineInfo.subpass = 0;
+
+        if (vkCreateGraphicsPipelines(s_device.device, s_pcache.pipelineCache, 1, &pipelineInfo, nullptr, &(s_gpipeline.depthPipelines[doubleSided])) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create depth prepass pipeline!");
+        }
+    }
+}
+
+// parts == 0 builds a complete pipeline for the key. Otherwise only the state owned by those
+// graphics pipeline library parts is filled in, and non empty libraries are linked together.
+VkPipeline scg::buildGraphicsPipeline(scg::sDevice& s_device, scg::sRenderPass& s_rpass, scg::sPipelineCache& s_pcache, scg::sGraphicsPipeline& s_gpipeline, const scg::sPipelineKey& key, VkGraphicsPipelineLibraryFlagsEXT parts, const std::vector<VkPipeline>& libraries, VkPipelineCreateFlags flags) {
+    bool complete = parts == 0 && libraries.empty();
+    bool vertexInput = complete || (parts & VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT);
+    bool preRasterization = complete || (parts & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT);
+    bool fragmentShader = complete || (parts & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT);
+    bool fragmentOutput = complete || (parts & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT);
+
+    VkBool32 alphaTest = key.alphaTest ? VK_TRUE : VK_FALSE;
+    float alphaCutoff = 0.5f;
+    std::array<VkSpecializationMapEntry, 2> specializationEntries{};
+    specializationEntries[0].constantID = 0;
+    specializationEntries[0].offset = 0;
+    specializationEntries[0].size = sizeof(VkBool32);
+    specializationEntries[1].constantID = 1;
+    specializationEntries[1].offset = sizeof(VkBool32);
+    specializationEntries[1].size = sizeof(float);
+    std::array<char, sizeof(VkBool32) + sizeof(float)> specializationData;
+    memcpy(specializationData.data(), &alphaTest, sizeof(VkBool32));
+    memcpy(specializationData.data() + sizeof(VkBool32), &alphaCutoff, sizeof(float));
+
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+    specializationInfo.pMapEntries = specializationEntries.data();
+    specializationInfo.dataSize = specializationData.size();
+    specializationInfo.pData = specializationData.data();
+
+    VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+    vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+    vertShaderStageInfo.module = s_gpipeline.vertShaderModule;
     vertShaderStageInfo.pName = "main";
 
     VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
     fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragShaderStageInfo.module = fragShaderModule;
+    fragShaderStageInfo.module = s_gpipeline.fragShaderModule;
     fragShaderStageInfo.pName = "main";
+    fragShaderStageInfo.pSpecializationInfo = &specializationInfo;
 
-    VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+    std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+    if (preRasterization) {
+        shaderStages.push_back(vertShaderStageInfo);
+    }
+    if (fragmentShader) {
+        shaderStages.push_back(fragShaderStageInfo);
+    }
 
     VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
     vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
@@ -65,20 +219,20 @@ void scg::createGraphicsPipeline(scg::sDevice& s_device, scg::sDescriptor& s_des
     rasterizer.rasterizerDiscardEnable = VK_FALSE;
     rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
     rasterizer.lineWidth = 1.0f;
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+    rasterizer.cullMode = key.doubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
     rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
     rasterizer.depthBiasEnable = VK_FALSE;
 
     VkPipelineMultisampleStateCreateInfo multisampling{};
     multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
     multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampling.rasterizationSamples = key.samples;
 
     VkPipelineDepthStencilStateCreateInfo depthStencil{};
     depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
     depthStencil.depthTestEnable = VK_TRUE;
-    depthStencil.depthWriteEnable = VK_TRUE;
-    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+    depthStencil.depthWriteEnable = key.depthPrepass ? VK_FALSE : VK_TRUE;
+    depthStencil.depthCompareOp = scg::getDepthCompareOp(s_gpipeline, key.depthPrepass);
     depthStencil.depthBoundsTestEnable = VK_FALSE;
     depthStencil.stencilTestEnable = VK_FALSE;
 
@@ -106,70 +260,43 @@ void scg::createGraphicsPipeline(scg::sDevice& s_device, scg::sDescriptor& s_des
     dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
     dynamicState.pDynamicStates = dynamicStates.data();
 
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &(s_descriptor.descriptorSetLayout);
+    VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
+    libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+    libraryInfo.flags = parts;
 
-    if (vkCreatePipelineLayout(s_device.device, &pipelineLayoutInfo, nullptr, &(s_gpipeline.pipelineLayout)) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create pipeline layout!");
-    }
+    VkPipelineLibraryCreateInfoKHR linkInfo{};
+    linkInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+    linkInfo.libraryCount = static_cast<uint32_t>(libraries.size());
+    linkInfo.pLibraries = libraries.data();
 
     VkGraphicsPipelineCreateInfo pipelineInfo{};
     pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = 2;
-    pipelineInfo.pStages = shaderStages;
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
-    pipelineInfo.pInputAssemblyState = &inputAssembly;
-    pipelineInfo.pViewportState = &viewportState;
-    pipelineInfo.pRasterizationState = &rasterizer;
-    pipelineInfo.pMultisampleState = &multisampling;
-    pipelineInfo.pDepthStencilState = &depthStencil;
-    pipelineInfo.pColorBlendState = &colorBlending;
-    pipelineInfo.pDynamicState = &dynamicState;
-    pipelineInfo.layout = s_gpipeline.pipelineLayout;
-    pipelineInfo.renderPass = s_rpass.renderPass;
+    pipelineInfo.flags = flags;
+    if (parts != 0) {
+        pipelineInfo.pNext = &libraryInfo;
+        pipelineInfo.flags |= VK_PIPELINE_CREATE_LIBRARY_BIT_KHR;
+    } else if (!libraries.empty()) {
+        pipelineInfo.pNext = &linkInfo;
+    }
+    pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+    pipelineInfo.pStages = shaderStages.empty() ? nullptr : shaderStages.data();
+    pipelineInfo.pVertexInputState = vertexInput ? &vertexInputInfo : nullptr;
+    pipelineInfo.pInputAssemblyState = vertexInput ? &inputAssembly : nullptr;
+    pipelineInfo.pViewportState = preRasterization ? &viewportState : nullptr;
+    pipelineInfo.pRasterizationState = preRasterization ? &rasterizer : nullptr;
+    pipelineInfo.pMultisampleState = (fragmentShader || fragmentOutput) ? &multisampling : nullptr;
+    pipelineInfo.pDepthStencilState = fragmentShader ? &depthStencil : nullptr;
+    pipelineInfo.pColorBlendState = fragmentOutput ? &colorBlending : nullptr;
+    pipelineInfo.pDynamicState = preRasterization ? &dynamicState : nullptr;
+    pipelineInfo.layout = (preRasterization || fragmentShader || !libraries.empty()) ? s_gpipeline.pipelineLayout : VK_NULL_HANDLE;
+    pipelineInfo.renderPass = (preRasterization || fragmentShader || fragmentOutput) ? s_rpass.renderPass : VK_NULL_HANDLE;
     pipelineInfo.subpass = 0;
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-    if (vkCreateGraphicsPipelines(s_device.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &(s_gpipeline.graphicsPipeline)) != VK_SUCCESS) {
+    VkPipeline pipeline;
+    if (vkCreateGraphicsPipelines(s_device.device, s_pcache.pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
         throw std::runtime_error("failed to create graphics pipeline!");
     }
 
-    vkDestroyShaderModule(s_device.device, fragShaderModule, nullptr);
-    vkDestroyShaderModule(s_device.device, vertShaderModule, nullptr);
+    return pipeline;
 }
-
-std::vector<char> scg::readSpvFile(const std::string& filename) {
-    std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-    if (!file.is_open()) {
-        throw std::runtime_error("failed to open file!");
-    }
-
-    size_t fileSize = (size_t) file.tellg();
-    std::vector<char> buffer(fileSize);
-
-    file.seekg(0);
-    file.read(buffer.data(), fileSize);
-
-    file.close();
-
-    return buffer;
-}
-
-VkShaderModule scg::createShaderModule(const std::vector<char>& code, VkDevice& device) {
-    VkShaderModuleCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = code.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-    VkShaderModule shaderModule;
-    if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create shader module!");
-    }
-
-    return shaderModule;
-}
-
-
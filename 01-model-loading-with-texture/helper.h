@@ -15,16 +15,18 @@
 #include <optional>
 
 #include "container.h"
+#include "zones.h"
 
 namespace scg {
-    bool isDeviceSuitable(VkPhysicalDevice& physicalDevice, VkSurfaceKHR& surface, std::vector<const char*>& deviceExtensions);
-    scg::QueueFamilyIndices findQueueFamilies(VkPhysicalDevice& device, VkSurfaceKHR& surface);
+    bool isDeviceSuitable(scg::sDeviceCapabilities& caps, VkSurfaceKHR& surface, std::vector<const char*>& deviceExtensions);
+    scg::QueueFamilyIndices findQueueFamilies(scg::sDeviceCapabilities& caps, VkSurfaceKHR& surface);
     bool checkValidationLayerSupport(std::vector<const char*>& validationLayers);
-    bool checkDeviceExtensionSupport(VkPhysicalDevice& device, std::vector<const char*>& deviceExtensions);
-    std::vector<const char*> getRequiredExtensions(bool validationLayers);
+    bool checkDeviceExtensionSupport(scg::sDeviceCapabilities& caps, std::vector<const char*>& deviceExtensions);
+    VkSampleCountFlagBits selectSampleCount(scg::sDevice& s_device, uint32_t requested);
+    std::vector<const char*> getRequiredExtensions(bool validationLayers, bool headless);
     scg::SwapchainSupportDetails querySwapchainSupport(VkPhysicalDevice& device, VkSurfaceKHR& surface);
     void createImage(scg::sDevice& s_device, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
-    uint32_t findMemoryType(VkPhysicalDevice physical, uint32_t typeFilter, VkMemoryPropertyFlags properties);
+    uint32_t findMemoryType(scg::sDevice& s_device, uint32_t typeFilter, VkMemoryPropertyFlags properties);
     
     // auxiliary methods for enhanced debugging messeges
     VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData) {
@@ -38,59 +40,65 @@ namespace scg {
     VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger);
     void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger, const VkAllocationCallbacks* pAllocator);
 
-    void loadModel(sInstance& s_inst, sGeometry& s_geom);
+    void loadModel(sInstance& s_inst, sGeometry& s_geom, sMaterialTable& s_mtable);
 }
 
-bool scg::isDeviceSuitable(VkPhysicalDevice& device, VkSurfaceKHR& surface, std::vector<const char*>& deviceExtensions) {
-    scg::QueueFamilyIndices indices = scg::findQueueFamilies(device, surface);
+bool scg::isDeviceSuitable(scg::sDeviceCapabilities& caps, VkSurfaceKHR& surface, std::vector<const char*>& deviceExtensions) {
+    bool extensionsSupported = scg::checkDeviceExtensionSupport(caps, deviceExtensions);
 
-    bool extensionsSupported = scg::checkDeviceExtensionSupport(device, deviceExtensions);
-
-    bool swapchainAdequate = false;
-    if (extensionsSupported) {
-        scg::SwapchainSupportDetails swapchainSupport = scg::querySwapchainSupport(device, surface);
+    // headless there is no surface, nothing is presented and any graphics queue will do
+    bool swapchainAdequate = surface == VK_NULL_HANDLE;
+    if (extensionsSupported && surface != VK_NULL_HANDLE) {
+        scg::SwapchainSupportDetails swapchainSupport = scg::querySwapchainSupport(caps.physicalDevice, surface);
         swapchainAdequate = !swapchainSupport.formats.empty() && !swapchainSupport.presentModes.empty();
     }
 
-    VkPhysicalDeviceFeatures supportedFeatures;
-    vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
-
-    return indices.isComplete() && extensionsSupported && swapchainAdequate  && supportedFeatures.samplerAnisotropy;
+    return caps.queueIndices.isComplete() && extensionsSupported && swapchainAdequate  && caps.features.samplerAnisotropy;
 }
 
-bool scg::checkDeviceExtensionSupport(VkPhysicalDevice& device, std::vector<const char*>& deviceExtensions) {
-    uint32_t extensionCount;
-    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
-
-    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
-    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+bool scg::checkDeviceExtensionSupport(scg::sDeviceCapabilities& caps, std::vector<const char*>& deviceExtensions) {
+    for (const char* extension : deviceExtensions) {
+        if (caps.extensions.count(extension) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+// the highest count up to the requested one that both color and depth attachments support
+VkSampleCountFlagBits scg::selectSampleCount(scg::sDevice& s_device, uint32_t requested) {
+    const VkPhysicalDeviceLimits& limits = s_device.caps.properties.limits;
+    VkSampleCountFlags supported = limits.framebufferColorSampleCounts & limits.framebufferDepthSampleCounts;
 
-    for (const auto& extension : availableExtensions) {
-        requiredExtensions.erase(extension.extensionName);
+    for (uint32_t count = VK_SAMPLE_COUNT_64_BIT; count > VK_SAMPLE_COUNT_1_BIT; count >>= 1) {
+        if (count <= requested && (supported & count)) {
+            if (count != requested) {
+                std::cout << requested << "x MSAA unsupported, using " << count << "x" << std::endl;
+            }
+            return static_cast<VkSampleCountFlagBits>(count);
+        }
     }
-
-    return requiredExtensions.empty();
+    if (requested > 1) {
+        std::cout << "MSAA unsupported, using 1 sample" << std::endl;
+    }
+    return VK_SAMPLE_COUNT_1_BIT;
 }
 
-scg::QueueFamilyIndices scg::findQueueFamilies(VkPhysicalDevice& device, VkSurfaceKHR& surface) {
+scg::QueueFamilyIndices scg::findQueueFamilies(scg::sDeviceCapabilities& caps, VkSurfaceKHR& surface) {
     scg::QueueFamilyIndices indices;
 
-    uint32_t queueFamilyCount = 0;
-    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
-
-    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
-
     int i = 0;
-    for (const auto& queueFamily : queueFamilies) {
+    for (const auto& queueFamily : caps.queueFamilies) {
         if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
             indices.graphicsFamily = i;
         }
 
         VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+        if (surface == VK_NULL_HANDLE) {
+            presentSupport = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+        } else {
+            vkGetPhysicalDeviceSurfaceSupportKHR(caps.physicalDevice, i, surface, &presentSupport);
+        }
 
         if (presentSupport) {
             indices.presentFamily = i;
@@ -131,12 +139,15 @@ bool scg::checkValidationLayerSupport(std::vector<const char*>& validationLayers
     return true;
 }
 
-std::vector<const char*> scg::getRequiredExtensions(bool validationLayers) {
-    uint32_t glfwExtensionCount{0};
-    const char** glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-    std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+// headless GLFW is never initialized and no surface extension is needed
+std::vector<const char*> scg::getRequiredExtensions(bool validationLayers, bool headless) {
+    std::vector<const char*> extensions;
+    if (!headless) {
+        uint32_t glfwExtensionCount{0};
+        const char** glfwExtensions;
+        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
 
     if (validationLayers) {
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -195,7 +206,7 @@ scg::SwapchainSupportDetails scg::querySwapchainSupport(VkPhysicalDevice& device
         VkMemoryAllocateInfo allocInfo{};
         allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
         allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = scg::findMemoryType(s_device.physicalDevice, memRequirements.memoryTypeBits, properties);
+        allocInfo.memoryTypeIndex = scg::findMemoryType(s_device, memRequirements.memoryTypeBits, properties);
 
         if (vkAllocateMemory(s_device.device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
             throw std::runtime_error("failed to allocate image memory!");
@@ -204,9 +215,8 @@ scg::SwapchainSupportDetails scg::querySwapchainSupport(VkPhysicalDevice& device
         vkBindImageMemory(s_device.device, image, imageMemory, 0);
     }
 
-    uint32_t scg::findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-        VkPhysicalDeviceMemoryProperties memProperties;
-        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+    uint32_t scg::findMemoryType(scg::sDevice& s_device, uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+        const VkPhysicalDeviceMemoryProperties& memProperties = s_device.caps.memory;
 
         for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
             if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
@@ -242,6 +252,7 @@ void scg::populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& c
 }
 
 void scg::setupDebugMessenger(VkInstance& instance, VkDebugUtilsMessengerEXT& debugMessenger) {
+    SCG_FUNCTION_ZONE();
     VkDebugUtilsMessengerCreateInfoEXT createInfo;
     populateDebugMessengerCreateInfo(createInfo);
 
@@ -250,20 +261,49 @@ void scg::setupDebugMessenger(VkInstance& instance, VkDebugUtilsMessengerEXT& de
     }
 }
 
-void scg::loadModel(sInstance& s_inst, sGeometry& s_geom) {
+void scg::loadModel(sInstance& s_inst, sGeometry& s_geom, sMaterialTable& s_mtable) {
+    SCG_FUNCTION_ZONE();
     tinyobj::attrib_t attrib;
     std::vector<tinyobj::shape_t> shapes;
     std::vector<tinyobj::material_t> materials;
     std::string warn, err;
 
-    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, s_inst.modelPath.c_str())) {
+    std::string baseDir = s_inst.modelPath.substr(0, s_inst.modelPath.find_last_of('/') + 1);
+
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, s_inst.modelPath.c_str(), baseDir.c_str())) {
         throw std::runtime_error(warn + err);
     }
 
+    // material 0 is the default for faces without a material and samples the default texture
+    std::unordered_map<std::string, uint32_t> textureSlots{{s_inst.texturePath, 0}};
+    s_mtable.texturePaths = {s_inst.texturePath};
+    s_mtable.materials.push_back({glm::vec4(1.0f), 0, {0, 0, 0}});
+
+    for (const auto& material : materials) {
+        scg::Material m{};
+        m.baseColor = glm::vec4(material.diffuse[0], material.diffuse[1], material.diffuse[2], material.dissolve);
+        m.textureIndex = 0;
+
+        if (!material.diffuse_texname.empty()) {
+            std::string path = baseDir + material.diffuse_texname;
+            if (textureSlots.count(path) == 0) {
+                textureSlots[path] = static_cast<uint32_t>(s_mtable.texturePaths.size());
+                s_mtable.texturePaths.push_back(path);
+            }
+            m.textureIndex = textureSlots[path];
+            // the texture carries the albedo, Kd only tints untextured materials
+            m.baseColor = glm::vec4(1.0f, 1.0f, 1.0f, material.dissolve);
+        }
+
+        s_mtable.materials.push_back(m);
+    }
+
     std::unordered_map<scg::Vertex, uint32_t> uniqueVertices{};
+    std::vector<std::vector<uint32_t>> indicesByMaterial(s_mtable.materials.size());
 
     for (const auto& shape : shapes) {
-        for (const auto& index : shape.mesh.indices) {
+        for (size_t i = 0; i < shape.mesh.indices.size(); i++) {
+            const auto& index = shape.mesh.indices[i];
             scg::Vertex vertex{};
 
             vertex.pos = {
@@ -284,7 +324,19 @@ void scg::loadModel(sInstance& s_inst, sGeometry& s_geom) {
                 s_geom.vertices.push_back(vertex);
             }
 
-            s_geom.indices.push_back(uniqueVertices[vertex]);
+            // faces are triangulated by tinyobj, so every 3 indices share one material id
+            int materialId = shape.mesh.material_ids.empty() ? -1 : shape.mesh.material_ids[i / 3];
+            indicesByMaterial[materialId + 1].push_back(uniqueVertices[vertex]);
+        }
+    }
+
+    // group the index buffer by material so each material is one contiguous draw range
+    for (uint32_t m = 0; m < indicesByMaterial.size(); m++) {
+        if (indicesByMaterial[m].empty()) {
+            continue;
         }
+
+        s_geom.drawRanges.push_back({static_cast<uint32_t>(s_geom.indices.size()), static_cast<uint32_t>(indicesByMaterial[m].size()), m});
+        s_geom.indices.insert(s_geom.indices.end(), indicesByMaterial[m].begin(), indicesByMaterial[m].end());
     }
 }
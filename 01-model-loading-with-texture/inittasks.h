@@ -0,0 +1,162 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+#include "container.h"
+#include "zones.h"
+
+// Initialization as a graph of named tasks, each listing the tasks whose results it reads. Ready
+// tasks run, in the order they became ready, on a small pool of threads that the main thread
+// joins, and with a single thread they simply run one after another. Tasks
+// only share the device, whose create calls need no locking; the command pool and the graphics
+// queue do, and the one-off uploads take sCommand::poolMutex for that. Once the graph has run,
+// the report lists the chain of tasks that decided how long startup took.
+namespace scg {
+    uint32_t addInitTask(scg::sInitGraph& s_init, const std::string& name, const std::vector<std::string>& dependencies, std::function<void()> run);
+    void runInitGraph(scg::sInstance& s_inst, scg::sInitGraph& s_init);
+    void initWorker(scg::sInitGraph& s_init, uint32_t thread);
+    void reportInitGraph(scg::sInitGraph& s_init);
+}
+
+// dependencies have to be added first, which also keeps the graph free of cycles
+uint32_t scg::addInitTask(scg::sInitGraph& s_init, const std::string& name, const std::vector<std::string>& dependencies, std::function<void()> run) {
+    uint32_t index = static_cast<uint32_t>(s_init.tasks.size());
+    scg::sInitTask task{};
+    task.name = name;
+    task.run = std::move(run);
+    for (const auto& dependency : dependencies) {
+        auto found = s_init.taskIndices.find(dependency);
+        if (found == s_init.taskIndices.end()) {
+            throw std::runtime_error("failed to add init task " + name + ", unknown dependency " + dependency + "!");
+        }
+        task.dependencies.push_back(found->second);
+        s_init.tasks[found->second].dependents.push_back(index);
+    }
+    task.waitingOn = static_cast<uint32_t>(task.dependencies.size());
+    s_init.tasks.push_back(std::move(task));
+    s_init.taskIndices[name] = index;
+    return index;
+}
+
+void scg::runInitGraph(scg::sInstance& s_inst, scg::sInitGraph& s_init) {
+    SCG_FUNCTION_ZONE();
+    uint32_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t threadCount = s_inst.initThreadCount != 0 ? s_inst.initThreadCount : std::min(hardwareThreads, 8u);
+
+    s_init.start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < s_init.tasks.size(); i++) {
+        if (s_init.tasks[i].waitingOn == 0) {
+            s_init.ready.push_back(i);
+        }
+    }
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < threadCount; i++) {
+        threads.push_back(std::thread(scg::initWorker, std::ref(s_init), i));
+    }
+    scg::initWorker(s_init, 0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    s_init.wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - s_init.start).count();
+
+    if (s_init.error) {
+        std::rethrow_exception(s_init.error);
+    }
+    if (s_init.finished != s_init.tasks.size()) {
+        throw std::runtime_error("failed to run every init task!");
+    }
+}
+
+void scg::initWorker(scg::sInitGraph& s_init, uint32_t thread) {
+    if (thread != 0) {
+        scg::nameZoneThread("init worker " + std::to_string(thread));
+    }
+
+    std::unique_lock<std::mutex> lock(s_init.mutex);
+    while (true) {
+        s_init.changed.wait(lock, [&s_init]() {
+            return !s_init.ready.empty() || s_init.finished == s_init.tasks.size() || s_init.error;
+        });
+        if (s_init.error || s_init.ready.empty()) {
+            return;
+        }
+        uint32_t index = s_init.ready.front();
+        s_init.ready.pop_front();
+        scg::sInitTask& task = s_init.tasks[index];
+        task.thread = thread;
+        lock.unlock();
+
+        auto start = std::chrono::steady_clock::now();
+        std::exception_ptr error;
+        try {
+            task.run();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        lock.lock();
+        task.startMs = std::chrono::duration<double, std::milli>(start - s_init.start).count();
+        task.endMs = std::chrono::duration<double, std::milli>(end - s_init.start).count();
+        if (error) {
+            s_init.error = error;
+        }
+        s_init.finished++;
+        for (uint32_t dependent : task.dependents) {
+            if (--s_init.tasks[dependent].waitingOn == 0) {
+                s_init.ready.push_back(dependent);
+            }
+        }
+        s_init.changed.notify_all();
+    }
+}
+
+// Walks back from the task that finished last, each time to the dependency that finished last.
+// A gap between a dependency's end and the task's start was spent waiting for a free thread.
+void scg::reportInitGraph(scg::sInitGraph& s_init) {
+    if (s_init.tasks.empty()) {
+        return;
+    }
+    double busyMs = 0.0;
+    uint32_t last = 0;
+    for (uint32_t i = 0; i < s_init.tasks.size(); i++) {
+        busyMs += s_init.tasks[i].endMs - s_init.tasks[i].startMs;
+        if (s_init.tasks[i].endMs > s_init.tasks[last].endMs) {
+            last = i;
+        }
+    }
+
+    std::vector<uint32_t> path{last};
+    while (!s_init.tasks[path.back()].dependencies.empty()) {
+        const auto& dependencies = s_init.tasks[path.back()].dependencies;
+        path.push_back(*std::max_element(dependencies.begin(), dependencies.end(), [&s_init](uint32_t a, uint32_t b) {
+            return s_init.tasks[a].endMs < s_init.tasks[b].endMs;
+        }));
+    }
+    std::reverse(path.begin(), path.end());
+
+    std::cout << std::fixed << std::setprecision(1) << "init: " << s_init.tasks.size() << " tasks in " << s_init.wallMs << " ms, "
+        << busyMs << " ms of work, critical path:" << std::endl;
+    double previousEnd = 0.0;
+    for (uint32_t index : path) {
+        const scg::sInitTask& task = s_init.tasks[index];
+        std::cout << "  " << std::setw(8) << task.startMs << " ms  " << std::setw(8) << task.endMs - task.startMs << " ms  " << task.name;
+        if (task.startMs - previousEnd > 0.5) {
+            std::cout << " (waited " << task.startMs - previousEnd << " ms for a thread)";
+        }
+        std::cout << std::endl;
+        previousEnd = task.endMs;
+    }
+    std::cout << std::defaultfloat;
+}
@@ -9,6 +9,7 @@
 
 #include "helper.h"
 #include "container.h"
+#include "zones.h"
 
 namespace scg {
     void createInstance(scg::sInstance& s_inst);
@@ -16,6 +17,7 @@ namespace scg {
 }
 
 void scg::createInstance(scg::sInstance& s_inst) {
+    SCG_FUNCTION_ZONE();
     if (s_inst.enableValidationLayers && !scg::checkValidationLayerSupport(s_inst.validationLayers)) {
         throw std::runtime_error("validation layers requested, but not available");
     }
@@ -26,13 +28,13 @@ void scg::createInstance(scg::sInstance& s_inst) {
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    appInfo.apiVersion = VK_API_VERSION_1_1;
 
     VkInstanceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
     createInfo.pApplicationInfo = &appInfo;
 
-    auto extensions = scg::getRequiredExtensions(s_inst.enableValidationLayers);
+    auto extensions = scg::getRequiredExtensions(s_inst.enableValidationLayers, s_inst.headless);
 
 #ifdef __APPLE__
     extensions.push_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
@@ -65,6 +67,7 @@ void scg::createInstance(scg::sInstance& s_inst) {
 }
 
 void scg::createSurface(scg::sInstance& s_inst) {
+    SCG_FUNCTION_ZONE();
     if (glfwCreateWindowSurface(s_inst.instance, s_inst.window, nullptr, &s_inst.surface) != VK_SUCCESS) {
         throw std::runtime_error("failed to create window surface");
     }
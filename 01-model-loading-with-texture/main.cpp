@@ -80,6 +80,7 @@ int main(int argc, char **argv) {
     VulkanApplication vkapp(512, 512, "simple vulkan app");
 
     try {
+        vkapp.configure(argc, argv);
         vkapp.run();
     } catch (std::exception& e) {
         std::cerr << e.what() << std::endl;
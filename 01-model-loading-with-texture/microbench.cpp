@@ -0,0 +1,31 @@
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/hash.hpp>
+
+#include "microbench.h"
+
+int main(int argc, char **argv) {
+    scg::sMicrobench s_mbench;
+
+    try {
+        scg::parseMicrobenchOptions(argc, argv, s_mbench);
+        scg::benchmarkObjLoading(s_mbench);
+        scg::benchmarkVertexHash(s_mbench);
+        scg::benchmarkImageDecode(s_mbench);
+        scg::benchmarkStagingCopy(s_mbench);
+        scg::benchmarkUniformBuild(s_mbench);
+        scg::writeMicrobenchCsv(s_mbench);
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "checksum " << s_mbench.sink << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,291 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <stdexcept>
+#include <unordered_set>
+
+#include "container.h"
+#include "helper.h"
+#include "texture.h"
+#include "vertex.h"
+#include "simulation.h"
+
+// CPU microbenchmarks for the paths the app runs before and between GPU work: loadModel (OBJ
+// parsing by tinyobj and the vertex dedup after it), std::hash<scg::Vertex> on its own, stb PNG
+// decoding, the memcpy into staging memory and building a frame's uniform buffer object. Meshes
+// are synthetic grids from 10k triangles up to --max-triangles, so throughput can be followed as
+// the inputs grow. Every case runs a few times and the fastest run is reported, in a table and,
+// with --csv, as one row per case to track over time.
+namespace scg {
+    void parseMicrobenchOptions(int argc, char** argv, scg::sMicrobench& s_mbench);
+    uint64_t writeSyntheticObj(const std::string& path, uint64_t triangles);
+    double fastestRun(uint32_t runs, const std::function<void()>& run);
+    void reportMicrobench(scg::sMicrobench& s_mbench, const std::string& path, uint64_t size, double ms, double throughput, const std::string& unit);
+    void benchmarkObjLoading(scg::sMicrobench& s_mbench);
+    void benchmarkVertexHash(scg::sMicrobench& s_mbench);
+    void benchmarkImageDecode(scg::sMicrobench& s_mbench);
+    void benchmarkStagingCopy(scg::sMicrobench& s_mbench);
+    void benchmarkUniformBuild(scg::sMicrobench& s_mbench);
+    void writeMicrobenchCsv(scg::sMicrobench& s_mbench);
+    void appendToVector(void* context, void* data, int size);
+}
+
+void scg::parseMicrobenchOptions(int argc, char** argv, scg::sMicrobench& s_mbench) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("missing value for " + arg);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--max-triangles") {
+            s_mbench.maxTriangles = std::stoull(value());
+        } else if (arg == "--csv") {
+            s_mbench.csvPath = value();
+        } else if (arg == "--texture") {
+            s_mbench.texturePath = value();
+        } else {
+            std::cout << "usage: " << argv[0] << " [--max-triangles <n>] [--csv <path>] [--texture <png>]" << std::endl;
+            throw std::invalid_argument("unknown option " + arg);
+        }
+    }
+}
+
+// A square grid with two triangles per cell and a vertex shared by up to six faces, like a real
+// mesh, so the dedup in loadModel folds every corner back to one vertex. Returns the triangle count.
+uint64_t scg::writeSyntheticObj(const std::string& path, uint64_t triangles) {
+    uint64_t cells = std::max<uint64_t>(1, static_cast<uint64_t>(std::sqrt(triangles / 2.0)));
+    uint64_t side = cells + 1;
+
+    std::ofstream file(path);
+    if (!file) {
+        throw std::runtime_error("failed to write " + path + "!");
+    }
+    file << std::fixed;
+    for (uint64_t y = 0; y < side; y++) {
+        for (uint64_t x = 0; x < side; x++) {
+            float u = static_cast<float>(x) / cells;
+            float v = static_cast<float>(y) / cells;
+            file << "v " << u - 0.5f << " " << v - 0.5f << " " << 0.1f * std::sin(u * 20.0f) * std::cos(v * 20.0f) << "\nvt " << u << " " << v << "\n";
+        }
+    }
+    for (uint64_t y = 0; y < cells; y++) {
+        for (uint64_t x = 0; x < cells; x++) {
+            uint64_t a = y * side + x + 1;
+            uint64_t b = a + 1;
+            uint64_t c = a + side;
+            uint64_t d = c + 1;
+            file << "f " << a << "/" << a << " " << b << "/" << b << " " << d << "/" << d << "\n"
+                << "f " << a << "/" << a << " " << d << "/" << d << " " << c << "/" << c << "\n";
+        }
+    }
+    return cells * cells * 2;
+}
+
+double scg::fastestRun(uint32_t runs, const std::function<void()>& run) {
+    double best = 0.0;
+    for (uint32_t i = 0; i < runs; i++) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        best = i == 0 ? ms : std::min(best, ms);
+    }
+    return best;
+}
+
+void scg::reportMicrobench(scg::sMicrobench& s_mbench, const std::string& path, uint64_t size, double ms, double throughput, const std::string& unit) {
+    std::cout << std::left << std::setw(16) << path << std::right << std::setw(12) << size << std::fixed << std::setprecision(3)
+        << std::setw(14) << ms << " ms" << std::setw(14) << throughput << " " << unit << std::defaultfloat << std::endl;
+    s_mbench.rows.push_back({path, size, ms, throughput, unit});
+}
+
+// the load is timed as a whole and tinyobj alone, the difference is the dedup and the material split
+void scg::benchmarkObjLoading(scg::sMicrobench& s_mbench) {
+    std::string path = (std::filesystem::temp_directory_path() / "scg_microbench.obj").string();
+
+    for (uint64_t target = 10000; target <= s_mbench.maxTriangles; target *= 10) {
+        uint64_t triangles = scg::writeSyntheticObj(path, target);
+        // the large grids take a while to load, a single run is enough for them
+        uint32_t runs = triangles > 2000000 ? 1 : 3;
+
+        double parseMs = scg::fastestRun(runs, [&]() {
+            tinyobj::attrib_t attrib;
+            std::vector<tinyobj::shape_t> shapes;
+            std::vector<tinyobj::material_t> materials;
+            std::string warn, err;
+            if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.c_str())) {
+                throw std::runtime_error(warn + err);
+            }
+            s_mbench.sink += attrib.vertices.size();
+        });
+        scg::reportMicrobench(s_mbench, "obj parse", triangles, parseMs, triangles / parseMs / 1000.0, "Mtris/s");
+
+        size_t uniqueVertices = 0;
+        double loadMs = scg::fastestRun(runs, [&]() {
+            scg::sInstance s_inst{};
+            s_inst.modelPath = path;
+            scg::sGeometry s_geom{};
+            scg::sMaterialTable s_mtable{};
+            scg::loadModel(s_inst, s_geom, s_mtable);
+            uniqueVertices = s_geom.vertices.size();
+            s_mbench.sink += s_geom.indices.size();
+        });
+        scg::reportMicrobench(s_mbench, "loadModel", triangles, loadMs, triangles / loadMs / 1000.0, "Mtris/s");
+        scg::reportMicrobench(s_mbench, "dedup", triangles, loadMs - parseMs, uniqueVertices / std::max(loadMs - parseMs, 0.001) / 1000.0, "Mverts/s");
+    }
+
+    std::filesystem::remove(path);
+}
+
+// also reports how many distinct hashes the vertices get, the hash mixes its parts with xor and shifts
+void scg::benchmarkVertexHash(scg::sMicrobench& s_mbench) {
+    for (uint64_t count = 10000; count <= std::min<uint64_t>(s_mbench.maxTriangles, 10000000); count *= 10) {
+        std::vector<scg::Vertex> vertices(count);
+        uint64_t side = std::max<uint64_t>(1, static_cast<uint64_t>(std::sqrt(static_cast<double>(count))));
+        for (uint64_t i = 0; i < count; i++) {
+            float u = static_cast<float>(i % side) / side;
+            float v = static_cast<float>(i / side) / side;
+            vertices[i] = {{u - 0.5f, v - 0.5f, 0.0f}, {1.0f, 1.0f, 1.0f}, {u, 1.0f - v}};
+        }
+
+        std::hash<scg::Vertex> hasher;
+        double ms = scg::fastestRun(5, [&]() {
+            size_t combined = 0;
+            for (const auto& vertex : vertices) {
+                combined += hasher(vertex);
+            }
+            s_mbench.sink += combined;
+        });
+        scg::reportMicrobench(s_mbench, "vertex hash", count, ms, ms * 1000000.0 / count, "ns/hash");
+
+        std::unordered_set<size_t> distinct;
+        distinct.reserve(count);
+        for (const auto& vertex : vertices) {
+            distinct.insert(hasher(vertex));
+        }
+        std::cout << "  " << distinct.size() << " distinct hashes for " << count << " distinct vertices" << std::endl;
+    }
+}
+
+void scg::appendToVector(void* context, void* data, int size) {
+    auto bytes = static_cast<std::vector<unsigned char>*>(context);
+    bytes->insert(bytes->end(), static_cast<unsigned char*>(data), static_cast<unsigned char*>(data) + size);
+}
+
+// synthetic images are a gradient with some noise, which compresses about as well as a photo texture
+void scg::benchmarkImageDecode(scg::sMicrobench& s_mbench) {
+    for (int size = 256; size <= 4096; size *= 4) {
+        std::vector<unsigned char> pixels(static_cast<size_t>(size) * size * 4);
+        uint32_t noise = 1;
+        for (size_t i = 0; i < pixels.size(); i++) {
+            noise = noise * 1664525u + 1013904223u;
+            size_t pixel = i / 4;
+            pixels[i] = static_cast<unsigned char>((pixel % size) * 255 / size / 2 + (pixel / size) * 255 / size / 4 + (noise >> 28));
+        }
+        std::vector<unsigned char> png;
+        stbi_write_png_to_func(scg::appendToVector, &png, size, size, 4, pixels.data(), size * 4);
+
+        double ms = scg::fastestRun(3, [&]() {
+            int width, height, channels;
+            stbi_uc* decoded = stbi_load_from_memory(png.data(), static_cast<int>(png.size()), &width, &height, &channels, STBI_rgb_alpha);
+            if (!decoded) {
+                throw std::runtime_error("failed to decode synthetic png!");
+            }
+            s_mbench.sink += decoded[0];
+            stbi_image_free(decoded);
+        });
+        scg::reportMicrobench(s_mbench, "png decode", static_cast<uint64_t>(size) * size, ms, pixels.size() / ms / 1000.0, "MB/s");
+    }
+
+    if (!std::filesystem::exists(s_mbench.texturePath)) {
+        std::cout << "  " << s_mbench.texturePath << " not found, run make get-assets to decode the real texture" << std::endl;
+        return;
+    }
+    uint64_t bytes = 0;
+    double ms = scg::fastestRun(3, [&]() {
+        int width, height, channels;
+        stbi_uc* decoded = stbi_load(s_mbench.texturePath.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+        if (!decoded) {
+            throw std::runtime_error("failed to load texture image!");
+        }
+        bytes = static_cast<uint64_t>(width) * height * 4;
+        s_mbench.sink += decoded[0];
+        stbi_image_free(decoded);
+    });
+    scg::reportMicrobench(s_mbench, "texture decode", bytes / 4, ms, bytes / ms / 1000.0, "MB/s");
+}
+
+// plain host memory stands in for the mapped staging buffer, the copy itself is the same
+void scg::benchmarkStagingCopy(scg::sMicrobench& s_mbench) {
+    for (uint64_t size = 64 * 1024; size <= 256ull * 1024 * 1024; size *= 16) {
+        std::vector<unsigned char> source(size, 1);
+        std::vector<unsigned char> staging(size, 0);
+        uint32_t runs = static_cast<uint32_t>(std::clamp<uint64_t>(1024ull * 1024 * 1024 / size, 5, 1000));
+        double ms = scg::fastestRun(runs, [&]() {
+            memcpy(staging.data(), source.data(), size);
+            s_mbench.sink += staging[size - 1];
+        });
+        scg::reportMicrobench(s_mbench, "staging memcpy", size, ms, size / ms / 1000000.0, "GB/s");
+    }
+}
+
+// what updateUniformBuffer does per frame, minus mapping the memory
+void scg::benchmarkUniformBuild(scg::sMicrobench& s_mbench) {
+    uint64_t count = 1000000;
+    scg::UniformBufferObject mapped{};
+    for (int reversed = 0; reversed < 2; reversed++) {
+        double ms = scg::fastestRun(3, [&]() {
+            for (uint64_t i = 0; i < count; i++) {
+                scg::sSimulationState state;
+                scg::simulate(state, i / 60.0f);
+
+                scg::UniformBufferObject ubo{};
+                ubo.model = state.model;
+                ubo.view = state.view;
+                if (reversed) {
+                    ubo.proj = scg::reversedInfinitePerspective(glm::radians(45.0f), 1.0f, 0.1f);
+                } else {
+                    ubo.proj = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 10.0f);
+                }
+                ubo.proj[1][1] *= -1;
+                memcpy(&mapped, &ubo, sizeof(ubo));
+                s_mbench.sink += static_cast<uint64_t>(mapped.model[0][0] * 1000.0f);
+            }
+        });
+        scg::reportMicrobench(s_mbench, reversed ? "ubo reversed-z" : "ubo", count, ms, ms * 1000000.0 / count, "ns/ubo");
+    }
+}
+
+void scg::writeMicrobenchCsv(scg::sMicrobench& s_mbench) {
+    if (s_mbench.csvPath.empty()) {
+        return;
+    }
+    std::ofstream file(s_mbench.csvPath);
+    if (!file) {
+        throw std::runtime_error("failed to write " + s_mbench.csvPath + "!");
+    }
+    file << "path,size,ms,throughput,unit\n";
+    for (const auto& row : s_mbench.rows) {
+        file << row.path << "," << row.size << "," << row.ms << "," << row.throughput << "," << row.unit << "\n";
+    }
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <string>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#include "container.h"
+
+namespace scg {
+    void parseCommandLine(int argc, char** argv, scg::sInstance& s_inst);
+    void printUsage(const char* program);
+    VkPresentModeKHR parsePresentMode(const std::string& name);
+}
+
+void scg::printUsage(const char* program) {
+    std::cout << "usage: " << program << " [options]\n"
+        << "  --model <path>           obj model to load\n"
+        << "  --texture <path>         default texture\n"
+        << "  --no-bindless            always use the single texture descriptor path\n"
+        << "  --alpha-test             start with alpha testing enabled (toggle with T)\n"
+        << "  --double-sided           start without back face culling (toggle with C)\n"
+        << "  --depth-prepass          lay down depth first and shade each pixel once (toggle with Z)\n"
+        << "  --reversed-z             reversed depth with an infinite far plane\n"
+        << "  --msaa <n>               MSAA sample count, lowered to what the GPU supports\n"
+        << "  --dynamic-resolution     scale the render resolution to fit the GPU budget\n"
+        << "  --gpu-budget <ms>        GPU time per frame dynamic resolution aims for\n"
+        << "  --min-scale <f>          lowest render scale, 0.1 to 1\n"
+        << "  --max-scale <f>          highest render scale, 0.1 to 1\n"
+        << "  --present-mode <mode>    immediate, mailbox, fifo or fifo-relaxed (cycle with P)\n"
+        << "  --swapchain-images <n>   swapchain image count, clamped to what the surface allows\n"
+        << "  --frames-in-flight <n>   frames the CPU may record ahead of the GPU\n"
+        << "  --wait-before-input      let the GPU drain before sampling input, for lower latency\n"
+        << "  --report-latency         log the input to GPU completion latency once a second\n"
+        << "  --headless               render offscreen without a window, for machines without a display\n"
+        << "  --frames <n>             exit after n frames, 300 by default when headless\n"
+        << "  --render-sequence <dir>  render a turntable of --frames images into dir, implies --headless\n"
+        << "  --sequence-format <fmt>  png or exr\n"
+        << "  --readback-ring <n>      host visible readback buffers frames are copied into\n"
+        << "  --encode-threads <n>     image encoding workers, all but two cores by default\n"
+        << "  --device <index|name>    use this GPU instead of the best scoring one\n"
+        << "  --init-threads <n>       threads startup runs on, 1 runs it serially\n"
+        << "  --benchmark <report>     fixed timestep run that writes frame time percentiles as JSON\n"
+        << "  --warmup <n>             frames left out of the benchmark, 60 by default\n"
+        << "  --baseline <report>      fail when the benchmark is slower than this earlier report\n"
+        << "  --threshold <percent>    regression allowed against the baseline, 10 by default\n"
+        << "  --gpu-profile            time the render graph passes and uploads on the GPU\n"
+        << "  --trace <path>           write CPU and GPU scopes as a Chrome trace, implies --gpu-profile\n"
+        << "  --wait-idle-on-resize    drain the GPU before recreating the swapchain\n"
+        << "  --resize-storm <n>       resize the window n times and report the hitches\n"
+        << "  --update-thread          simulate on a separate thread at a fixed rate\n"
+        << "  --update-rate <hz>       update thread ticks per second\n"
+        << "  --simulation-cost <ms>   artificial CPU time spent in every update tick\n"
+        << "  --gpu-culling            frustum cull the draws in a compute shader\n"
+        << "  --no-async-compute       cull on the graphics queue even when there is a compute queue\n"
+        << "  --no-timeline            track frames with fences instead of a timeline semaphore\n"
+        << "  --pipeline-workers <n>   threads compiling pipeline variants\n"
+        << "  --record-threads <n>     threads recording the forward pass, 0 records inline\n"
+        << "  --cache-commands         reuse recorded command buffers until something changes\n"
+        << "  --synthetic-draws <n>    split the model into n draws to measure recording\n"
+        << "  --no-pipeline-library    build variants without VK_EXT_graphics_pipeline_library\n"
+        << "  --no-hot-reload          do not watch the compiled shaders for changes\n"
+        << "  --pipeline-cache <path>  file the pipeline cache is loaded from and saved to\n"
+        << "  --no-pipeline-cache      neither load nor save the pipeline cache\n"
+        << "  --no-atlas               keep every material texture in its own image\n";
+}
+
+VkPresentModeKHR scg::parsePresentMode(const std::string& name) {
+    if (name == "immediate") {
+        return VK_PRESENT_MODE_IMMEDIATE_KHR;
+    } else if (name == "mailbox") {
+        return VK_PRESENT_MODE_MAILBOX_KHR;
+    } else if (name == "fifo") {
+        return VK_PRESENT_MODE_FIFO_KHR;
+    } else if (name == "fifo-relaxed") {
+        return VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+    }
+    throw std::invalid_argument("unknown present mode " + name);
+}
+
+void scg::parseCommandLine(int argc, char** argv, scg::sInstance& s_inst) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("missing value for " + arg);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--model") {
+            s_inst.modelPath = value();
+        } else if (arg == "--texture") {
+            s_inst.texturePath = value();
+        } else if (arg == "--no-bindless") {
+            s_inst.enableBindless = false;
+        } else if (arg == "--alpha-test") {
+            s_inst.alphaTest = true;
+        } else if (arg == "--double-sided") {
+            s_inst.doubleSided = true;
+        } else if (arg == "--depth-prepass") {
+            s_inst.depthPrepass = true;
+        } else if (arg == "--reversed-z") {
+            s_inst.reversedZ = true;
+        } else if (arg == "--msaa") {
+            s_inst.msaaSamples = static_cast<uint32_t>(std::stoul(value()));
+        } else if (arg == "--dynamic-resolution") {
+            s_inst.enableDynamicResolution = true;
+        } else if (arg == "--gpu-budget") {
+            s_inst.gpuBudgetMs = std::stof(value());
+        } else if (arg == "--min-scale") {
+            s_inst.minResolutionScale = std::stof(value());
+        } else if (arg == "--max-scale") {
+            s_inst.maxResolutionScale = std::stof(value());
+        } else if (arg == "--present-mode") {
+            s_inst.presentMode = scg::parsePresentMode(value());
+        } else if (arg == "--swapchain-images") {
+            s_inst.swapchainImageCount = static_cast<uint32_t>(std::stoul(value()));
+        } else if (arg == "--frames-in-flight") {
+            s_inst.maxFramesInFlight = std::max(1, std::stoi(value()));
+        } else if (arg == "--wait-before-input") {
+            s_inst.waitBeforeInput = true;
+        } else if (arg == "--report-latency") {
+            s_inst.reportLatency = true;
+        } else if (arg == "--headless") {
+            s_inst.headless = true;
+        } else if (arg == "--frames") {
+            s_inst.frameLimit = std::stoull(value());
+        } else if (arg == "--render-sequence") {
+            s_inst.sequencePath = value();
+        } else if (arg == "--sequence-format") {
+            s_inst.sequenceFormat = value();
+            if (s_inst.sequenceFormat != "png" && s_inst.sequenceFormat != "exr") {
+                throw std::invalid_argument("unknown sequence format " + s_inst.sequenceFormat);
+            }
+        } else if (arg == "--readback-ring") {
+            s_inst.readbackRingSize = static_cast<uint32_t>(std::stoul(value()));
+        } else if (arg == "--encode-threads") {
+            s_inst.encodeThreadCount = static_cast<uint32_t>(std::stoul(value()));
+        } else if (arg == "--device") {
+            s_inst.preferredDevice = value();
+        } else if (arg == "--init-threads") {
+            s_inst.initThreadCount = static_cast<uint32_t>(std::stoul(value()));
+        } else if (arg == "--benchmark") {
+            s_inst.benchmarkPath = value();
+        } else if (arg == "--warmup") {
+            s_inst.warmupFrames = std::stoull(value());
+        } else if (arg == "--baseline") {
+            s_inst.baselinePath = value();
+        } else if (arg == "--threshold") {
+            s_inst.regressionThreshold = std::stod(value());
+        } else if (arg == "--gpu-profile") {
+            s_inst.enableGpuProfiler = true;
+        } else if (arg == "--trace") {
+            s_inst.tracePath = value();
+            s_inst.enableGpuProfiler = true;
+        } else if (arg == "--wait-idle-on-resize") {
+            s_inst.waitIdleOnResize = true;
+        } else if (arg == "--resize-storm") {
+            s_inst.resizeStormCount = static_cast<uint32_t>(std::stoul(value()));
+        } else if (arg == "--update-thread") {
+            s_inst.enableUpdateThread = true;
+        } else if (arg == "--update-rate") {
+            s_inst.updateRate = std::stof(value());
+        } else if (arg == "--simulation-cost") {
+            s_inst.simulationCostMs = std::stof(value());
+        } else if (arg == "--gpu-culling") {
+            s_inst.enableGpuCulling = true;
+        } else if (arg == "--no-async-compute") {
+            s_inst.enableAsyncCompute = false;
+        } else if (arg == "--no-timeline") {
+            s_inst.enableTimelineSemaphore = false;
+        } else if (arg == "--pipeline-workers") {
+            s_inst.pipelineWorkerCount = static_cast<uint32_t>(std::stoul(value()));
+        } else if (arg == "--cache-commands") {
+            s_inst.cacheCommandBuffers = true;
+        } else if (arg == "--record-threads") {
+            s_inst.recordThreadCount = static_cast<uint32_t>(std::stoul(value()));
+        } else if (arg == "--synthetic-draws") {
+            s_inst.syntheticDrawCount = static_cast<uint32_t>(std::stoul(value()));
+        } else if (arg == "--no-pipeline-library") {
+            s_inst.enableGraphicsPipelineLibrary = false;
+        } else if (arg == "--no-hot-reload") {
+            s_inst.enableShaderHotReload = false;
+        } else if (arg == "--pipeline-cache") {
+            s_inst.pipelineCachePath = value();
+        } else if (arg == "--no-pipeline-cache") {
+            s_inst.enablePipelineCache = false;
+        } else if (arg == "--no-atlas") {
+            s_inst.enableAtlas = false;
+        } else if (arg == "--help" || arg == "-h") {
+            scg::printUsage(argv[0]);
+            std::exit(EXIT_SUCCESS);
+        } else {
+            scg::printUsage(argv[0]);
+            throw std::invalid_argument("unknown option " + arg);
+        }
+    }
+
+    // GPU frame times come from the profiler, and --frames counts only the measured frames
+    if (!s_inst.benchmarkPath.empty()) {
+        s_inst.enableGpuProfiler = true;
+        s_inst.frameLimit = s_inst.warmupFrames + (s_inst.frameLimit != 0 ? s_inst.frameLimit : 600);
+    }
+
+    // every frame copies into the next readback buffer, so a recorded command buffer is never reused
+    if (!s_inst.sequencePath.empty()) {
+        s_inst.headless = true;
+        s_inst.cacheCommandBuffers = false;
+        if (s_inst.frameLimit == 0) {
+            s_inst.frameLimit = 360;
+        }
+    }
+
+    // nobody can close a window that does not exist
+    if (s_inst.headless && s_inst.frameLimit == 0) {
+        s_inst.frameLimit = 300;
+    }
+}
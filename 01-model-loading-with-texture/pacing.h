@@ -0,0 +1,79 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+
+#include "container.h"
+#include "zones.h"
+#include "synchronization.h"
+
+// Input is sampled once per frame, right after the events are polled, and the latency of a frame
+// runs from that sample until the CPU sees the frame complete. Completion is checked at the
+// start of every frame, so a sample can read up to one frame late; with FIFO the wait for the
+// next vertical blank comes on top and is not part of the number.
+namespace scg {
+    void createFramePacing(scg::sInstance& s_inst, scg::sFramePacing& s_pacing);
+    void waitBeforeInput(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sSynch& s_synch, scg::sFramePacing& s_pacing, int currentFrame);
+    void sampleInput(scg::sFramePacing& s_pacing);
+    void submitFrameLatency(scg::sFramePacing& s_pacing, int frame);
+    void collectFrameLatency(scg::sDevice& s_device, scg::sSynch& s_synch, scg::sFramePacing& s_pacing);
+}
+
+void scg::createFramePacing(scg::sInstance& s_inst, scg::sFramePacing& s_pacing) {
+    SCG_FUNCTION_ZONE();
+    s_pacing.submittedInputTimes.resize(s_inst.maxFramesInFlight);
+    s_pacing.pending.assign(s_inst.maxFramesInFlight, false);
+    s_pacing.lastReport = std::chrono::steady_clock::now();
+    s_pacing.report = s_inst.reportLatency;
+}
+
+// Without the wait the CPU runs up to maxFramesInFlight frames ahead of the GPU and every one of
+// them sits in the queue with stale input. Waiting for the frame submitted last lets the GPU drain
+// first, so the input that gets sampled next is shown as soon as the GPU can draw it.
+void scg::waitBeforeInput(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sSynch& s_synch, scg::sFramePacing& s_pacing, int currentFrame) {
+    if (s_inst.waitBeforeInput) {
+        int previousFrame = (currentFrame + s_inst.maxFramesInFlight - 1) % s_inst.maxFramesInFlight;
+        scg::waitForFrame(s_device, s_synch, previousFrame);
+    }
+    scg::collectFrameLatency(s_device, s_synch, s_pacing);
+}
+
+void scg::sampleInput(scg::sFramePacing& s_pacing) {
+    s_pacing.inputTime = std::chrono::steady_clock::now();
+}
+
+// called once the frame is submitted, a frame dropped before that never completes
+void scg::submitFrameLatency(scg::sFramePacing& s_pacing, int frame) {
+    s_pacing.submittedInputTimes[frame] = s_pacing.inputTime;
+    s_pacing.pending[frame] = true;
+}
+
+void scg::collectFrameLatency(scg::sDevice& s_device, scg::sSynch& s_synch, scg::sFramePacing& s_pacing) {
+    auto now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < s_pacing.pending.size(); i++) {
+        if (!s_pacing.pending[i] || !scg::isFrameComplete(s_device, s_synch, static_cast<uint32_t>(i))) {
+            continue;
+        }
+        s_pacing.pending[i] = false;
+
+        double latencyMs = std::chrono::duration<double, std::milli>(now - s_pacing.submittedInputTimes[i]).count();
+        s_pacing.latencySumMs += latencyMs;
+        s_pacing.latencyMaxMs = std::max(s_pacing.latencyMaxMs, latencyMs);
+        s_pacing.latencySamples++;
+    }
+
+    if (!s_pacing.report || now - s_pacing.lastReport < std::chrono::seconds(1) || s_pacing.latencySamples == 0) {
+        return;
+    }
+    std::cout << "input latency " << s_pacing.latencySumMs / s_pacing.latencySamples << " ms average, " << s_pacing.latencyMaxMs
+        << " ms max over " << s_pacing.latencySamples << " frames" << std::endl;
+    s_pacing.lastReport = now;
+    s_pacing.latencySumMs = 0.0;
+    s_pacing.latencyMaxMs = 0.0;
+    s_pacing.latencySamples = 0;
+}
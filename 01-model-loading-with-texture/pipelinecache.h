@@ -0,0 +1,140 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+
+#include "container.h"
+#include "zones.h"
+
+// Serialized VkPipelineCache shared by every pipeline the app builds. The blob is only handed to
+// the driver when its header matches this physical device, and is rewritten atomically on exit.
+namespace scg {
+    void createPipelineCache(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sPipelineCache& s_pcache);
+    void savePipelineCache(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sPipelineCache& s_pcache);
+    void destroyPipelineCache(scg::sDevice& s_device, scg::sPipelineCache& s_pcache);
+    bool validatePipelineCacheHeader(scg::sDevice& s_device, const std::vector<char>& data);
+}
+
+bool scg::validatePipelineCacheHeader(scg::sDevice& s_device, const std::vector<char>& data) {
+    if (data.size() < sizeof(VkPipelineCacheHeaderVersionOne)) {
+        std::cout << "pipeline cache rejected: truncated header" << std::endl;
+        return false;
+    }
+
+    VkPipelineCacheHeaderVersionOne header;
+    memcpy(&header, data.data(), sizeof(header));
+
+    const VkPhysicalDeviceProperties& properties = s_device.caps.properties;
+
+    if (header.headerSize < sizeof(header) || header.headerSize > data.size()) {
+        std::cout << "pipeline cache rejected: bad header size" << std::endl;
+        return false;
+    }
+    if (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) {
+        std::cout << "pipeline cache rejected: unknown header version" << std::endl;
+        return false;
+    }
+    if (header.vendorID != properties.vendorID || header.deviceID != properties.deviceID) {
+        std::cout << "pipeline cache rejected: written by another device" << std::endl;
+        return false;
+    }
+    if (memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        std::cout << "pipeline cache rejected: driver cache uuid changed" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void scg::createPipelineCache(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sPipelineCache& s_pcache) {
+    SCG_FUNCTION_ZONE();
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    std::vector<char> data;
+    if (s_inst.enablePipelineCache) {
+        std::ifstream file(s_inst.pipelineCachePath, std::ios::ate | std::ios::binary);
+        if (file.is_open()) {
+            data.resize(static_cast<size_t>(file.tellg()));
+            file.seekg(0);
+            file.read(data.data(), data.size());
+        }
+        if (!data.empty() && !scg::validatePipelineCacheHeader(s_device, data)) {
+            data.clear();
+        }
+    }
+
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = data.size();
+    cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+    // drivers may still refuse a blob that passed the header check, so retry empty before giving up
+    if (vkCreatePipelineCache(s_device.device, &cacheInfo, nullptr, &(s_pcache.pipelineCache)) != VK_SUCCESS) {
+        data.clear();
+        cacheInfo.initialDataSize = 0;
+        cacheInfo.pInitialData = nullptr;
+        if (vkCreatePipelineCache(s_device.device, &cacheInfo, nullptr, &(s_pcache.pipelineCache)) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline cache!");
+        }
+    }
+    s_pcache.loadedSize = data.size();
+
+    auto elapsed = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+    if (s_pcache.loadedSize > 0) {
+        std::cout << "loaded " << s_pcache.loadedSize << " byte pipeline cache from " << s_inst.pipelineCachePath << " in " << elapsed << " ms" << std::endl;
+    } else {
+        std::cout << "starting with an empty pipeline cache" << std::endl;
+    }
+}
+
+void scg::savePipelineCache(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sPipelineCache& s_pcache) {
+    if (!s_inst.enablePipelineCache) {
+        return;
+    }
+
+    size_t dataSize = 0;
+    if (vkGetPipelineCacheData(s_device.device, s_pcache.pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0) {
+        return;
+    }
+    std::vector<char> data(dataSize);
+    if (vkGetPipelineCacheData(s_device.device, s_pcache.pipelineCache, &dataSize, data.data()) != VK_SUCCESS) {
+        std::cout << "failed to read back pipeline cache data" << std::endl;
+        return;
+    }
+
+    // write next to the target and rename over it, so a crash never leaves a torn cache behind
+    std::string tmpPath = s_inst.pipelineCachePath + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cout << "failed to open " << tmpPath << " for writing" << std::endl;
+            return;
+        }
+        file.write(data.data(), dataSize);
+        if (!file.good()) {
+            std::cout << "failed to write " << tmpPath << std::endl;
+            std::remove(tmpPath.c_str());
+            return;
+        }
+    }
+    if (std::rename(tmpPath.c_str(), s_inst.pipelineCachePath.c_str()) != 0) {
+        std::cout << "failed to replace " << s_inst.pipelineCachePath << std::endl;
+        std::remove(tmpPath.c_str());
+        return;
+    }
+
+    std::cout << "saved " << dataSize << " byte pipeline cache to " << s_inst.pipelineCachePath << std::endl;
+}
+
+void scg::destroyPipelineCache(scg::sDevice& s_device, scg::sPipelineCache& s_pcache) {
+    vkDestroyPipelineCache(s_device.device, s_pcache.pipelineCache, nullptr);
+}
@@ -0,0 +1,320 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+#include "container.h"
+#include "zones.h"
+#include "graphicspipeline.h"
+#include "deletion.h"
+
+// Pipeline variants keyed by sPipelineKey. Missing variants are compiled on worker threads while
+// the render loop keeps drawing with the default pipeline, so a frame never waits on a compile.
+// With VK_EXT_graphics_pipeline_library each variant is first fast linked from cached library
+// parts and then swapped for a link time optimized build.
+namespace scg {
+    void startPipelineManager(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sRenderPass& s_rpass, scg::sPipelineCache& s_pcache, scg::sGraphicsPipeline& s_gpipeline, scg::sPipelineManager& s_pmanager);
+    void stopPipelineManager(scg::sDevice& s_device, scg::sPipelineManager& s_pmanager);
+    void requestPipeline(scg::sGraphicsPipeline& s_gpipeline, scg::sPipelineManager& s_pmanager, const scg::sPipelineKey& key);
+    VkPipeline getPipeline(scg::sGraphicsPipeline& s_gpipeline, scg::sPipelineManager& s_pmanager, const scg::sPipelineKey& key);
+    bool hasPipeline(scg::sGraphicsPipeline& s_gpipeline, scg::sPipelineManager& s_pmanager, const scg::sPipelineKey& key);
+    void pipelineWorker(scg::sDevice& s_device, scg::sRenderPass& s_rpass, scg::sPipelineCache& s_pcache, scg::sGraphicsPipeline& s_gpipeline, scg::sPipelineManager& s_pmanager);
+    void compilePipelineVariant(scg::sDevice& s_device, scg::sRenderPass& s_rpass, scg::sPipelineCache& s_pcache, scg::sGraphicsPipeline& s_gpipeline, scg::sPipelineManager& s_pmanager, uint32_t generation, const scg::sPipelineKey& key);
+    VkPipeline getPipelineLibrary(scg::sDevice& s_device, scg::sRenderPass& s_rpass, scg::sPipelineCache& s_pcache, scg::sGraphicsPipeline& s_gpipeline, scg::sPipelineManager& s_pmanager, uint32_t generation, const scg::sPipelineKey& key, VkGraphicsPipelineLibraryFlagBitsEXT part);
+    bool publishPipeline(scg::sPipelineManager& s_pmanager, uint32_t generation, uint32_t packed, VkPipeline pipeline);
+    void retireShaderModule(scg::sPipelineManager& s_pmanager, VkShaderModule module);
+    void trimRetiredPipelines(scg::sDevice& s_device, scg::sPipelineManager& s_pmanager, uint64_t pendingFrame, uint64_t completedFrame);
+    void replaceDefaultPipeline(scg::sDevice& s_device, scg::sGraphicsPipeline& s_gpipeline, scg::sPipelineManager& s_pmanager, scg::sDeletionQueue& s_deletion, uint64_t frame, const scg::sGraphicsPipeline& staged);
+}
+
+void scg::startPipelineManager(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sRenderPass& s_rpass, scg::sPipelineCache& s_pcache, scg::sGraphicsPipeline& s_gpipeline, scg::sPipelineManager& s_pmanager) {
+    SCG_FUNCTION_ZONE();
+    uint32_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t workerCount = std::max(1u, std::min(s_inst.pipelineWorkerCount, hardwareThreads));
+
+    for (uint32_t i = 0; i < workerCount; i++) {
+        s_pmanager.workers.emplace_back(scg::pipelineWorker, std::ref(s_device), std::ref(s_rpass), std::ref(s_pcache), std::ref(s_gpipeline), std::ref(s_pmanager));
+    }
+
+    std::cout << "started " << workerCount << " pipeline compile workers" << (s_device.graphicsPipelineLibrary ? " with graphics pipeline library" : "") << std::endl;
+}
+
+void scg::stopPipelineManager(scg::sDevice& s_device, scg::sPipelineManager& s_pmanager) {
+    {
+        std::lock_guard<std::mutex> lock(s_pmanager.mutex);
+        s_pmanager.stopping = true;
+        s_pmanager.queue.clear();
+    }
+    s_pmanager.condition.notify_all();
+
+    for (auto& worker : s_pmanager.workers) {
+        worker.join();
+    }
+    s_pmanager.workers.clear();
+
+    for (auto& [packed, pipeline] : s_pmanager.pipelines) {
+        vkDestroyPipeline(s_device.device, pipeline, nullptr);
+    }
+    for (auto& [partKey, library] : s_pmanager.libraries) {
+        vkDestroyPipeline(s_device.device, library, nullptr);
+    }
+    for (auto& retired : s_pmanager.retiredPipelines) {
+        vkDestroyPipeline(s_device.device, retired.pipeline, nullptr);
+        vkDestroyShaderModule(s_device.device, retired.module, nullptr);
+    }
+    s_pmanager.pipelines.clear();
+    s_pmanager.libraries.clear();
+    s_pmanager.retiredPipelines.clear();
+    s_pmanager.activeBuilds.clear();
+}
+
+void scg::requestPipeline(scg::sGraphicsPipeline& s_gpipeline, scg::sPipelineManager& s_pmanager, const scg::sPipelineKey& key) {
+    uint32_t packed = key.pack();
+    if (packed == s_gpipeline.defaultKey.pack()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(s_pmanager.mutex);
+        if (s_pmanager.stopping || !s_pmanager.requested.insert(packed).second) {
+            return;
+        }
+        s_pmanager.queue.push_back(key);
+    }
+    s_pmanager.condition.notify_one();
+}
+
+VkPipeline scg::getPipeline(scg::sGraphicsPipeline& s_gpipeline, scg::sPipelineManager& s_pmanager, const scg::sPipelineKey& key) {
+    uint32_t packed = key.pack();
+    if (packed == s_gpipeline.defaultKey.pack()) {
+        return s_gpipeline.graphicsPipeline;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(s_pmanager.mutex);
+        auto it = s_pmanager.pipelines.find(packed);
+        if (it != s_pmanager.pipelines.end()) {
+            return it->second;
+        }
+    }
+
+    scg::requestPipeline(s_gpipeline, s_pmanager, key);
+    return s_gpipeline.graphicsPipeline;
+}
+
+// for variants the default pipeline cannot stand in for, such as the EQUAL tested prepass color pass
+bool scg::hasPipeline(scg::sGraphicsPipeline& s_gpipeline, scg::sPipelineManager& s_pmanager, const scg::sPipelineKey& key) {
+    uint32_t packed = key.pack();
+    if (packed == s_gpipeline.defaultKey.pack()) {
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(s_pmanager.mutex);
+        if (s_pmanager.pipelines.count(packed) != 0) {
+            return true;
+        }
+    }
+
+    scg::requestPipeline(s_gpipeline, s_pmanager, key);
+    return false;
+}
+
+void scg::pipelineWorker(scg::sDevice& s_device, scg::sRenderPass& s_rpass, scg::sPipelineCache& s_pcache, scg::sGraphicsPipeline& s_gpipeline, scg::sPipelineManager& s_pmanager) {
+    scg::nameZoneThread("pipeline worker");
+    while (true) {
+        scg::sPipelineKey key;
+        // the shader modules may be swapped by a reload, so each build works from a snapshot
+        scg::sGraphicsPipeline snapshot;
+        uint32_t generation;
+        {
+            std::unique_lock<std::mutex> lock(s_pmanager.mutex);
+            s_pmanager.condition.wait(lock, [&s_pmanager]() { return s_pmanager.stopping || !s_pmanager.queue.empty(); });
+            if (s_pmanager.stopping) {
+                return;
+            }
+            key = s_pmanager.queue.front();
+            s_pmanager.queue.pop_front();
+            snapshot = s_gpipeline;
+            generation = s_pmanager.generation;
+            s_pmanager.activeBuilds[generation]++;
+        }
+
+        // a failed variant stays requested, so the fallback keeps being used instead of retrying every frame
+        try {
+            scg::compilePipelineVariant(s_device, s_rpass, s_pcache, snapshot, s_pmanager, generation, key);
+        } catch (const std::exception& e) {
+            std::cerr << "pipeline variant " << key.pack() << ": " << e.what() << std::endl;
+        }
+
+        std::lock_guard<std::mutex> lock(s_pmanager.mutex);
+        if (--s_pmanager.activeBuilds[generation] == 0) {
+            s_pmanager.activeBuilds.erase(generation);
+        }
+    }
+}
+
+void scg::compilePipelineVariant(scg::sDevice& s_device, scg::sRenderPass& s_rpass, scg::sPipelineCache& s_pcache, scg::sGraphicsPipeline& s_gpipeline, scg::sPipelineManager& s_pmanager, uint32_t generation, const scg::sPipelineKey& key) {
+    SCG_FUNCTION_ZONE();
+    uint32_t packed = key.pack();
+    auto startTime = std::chrono::high_resolution_clock::now();
+    auto elapsed = [&startTime]() {
+        return std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+    };
+
+    if (!s_device.graphicsPipelineLibrary) {
+        VkPipeline pipeline = scg::buildGraphicsPipeline(s_device, s_rpass, s_pcache, s_gpipeline, key, 0, {}, 0);
+        if (!scg::publishPipeline(s_pmanager, generation, packed, pipeline)) {
+            return;
+        }
+        std::cout << "pipeline variant " << packed << " ready in " << elapsed() << " ms" << std::endl;
+        return;
+    }
+
+    std::vector<VkPipeline> libraries = {
+        scg::getPipelineLibrary(s_device, s_rpass, s_pcache, s_gpipeline, s_pmanager, generation, key, VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT),
+        scg::getPipelineLibrary(s_device, s_rpass, s_pcache, s_gpipeline, s_pmanager, generation, key, VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT),
+        scg::getPipelineLibrary(s_device, s_rpass, s_pcache, s_gpipeline, s_pmanager, generation, key, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT),
+        scg::getPipelineLibrary(s_device, s_rpass, s_pcache, s_gpipeline, s_pmanager, generation, key, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT)
+    };
+
+    VkPipeline fastLinked = scg::buildGraphicsPipeline(s_device, s_rpass, s_pcache, s_gpipeline, key, 0, libraries, 0);
+    if (!scg::publishPipeline(s_pmanager, generation, packed, fastLinked)) {
+        return;
+    }
+    std::cout << "pipeline variant " << packed << " fast linked in " << elapsed() << " ms" << std::endl;
+
+    VkPipeline optimized = scg::buildGraphicsPipeline(s_device, s_rpass, s_pcache, s_gpipeline, key, 0, libraries, VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT);
+    if (!scg::publishPipeline(s_pmanager, generation, packed, optimized)) {
+        return;
+    }
+    std::cout << "pipeline variant " << packed << " optimized in " << elapsed() << " ms" << std::endl;
+}
+
+// each part only depends on some of the key, so parts are shared between variants
+VkPipeline scg::getPipelineLibrary(scg::sDevice& s_device, scg::sRenderPass& s_rpass, scg::sPipelineCache& s_pcache, scg::sGraphicsPipeline& s_gpipeline, scg::sPipelineManager& s_pmanager, uint32_t generation, const scg::sPipelineKey& key, VkGraphicsPipelineLibraryFlagBitsEXT part) {
+    scg::sPipelineKey partKey{};
+    if (part == VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT) {
+        partKey.doubleSided = key.doubleSided;
+    } else if (part == VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT) {
+        partKey.alphaTest = key.alphaTest;
+        partKey.depthPrepass = key.depthPrepass;
+        partKey.samples = key.samples;
+    } else if (part == VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT) {
+        partKey.samples = key.samples;
+    }
+    uint64_t libraryKey = (static_cast<uint64_t>(part) << 32) | partKey.pack();
+
+    {
+        std::lock_guard<std::mutex> lock(s_pmanager.mutex);
+        auto it = s_pmanager.libraries.find(libraryKey);
+        if (it != s_pmanager.libraries.end() && generation == s_pmanager.generation) {
+            return it->second;
+        }
+    }
+
+    VkPipeline library = scg::buildGraphicsPipeline(s_device, s_rpass, s_pcache, s_gpipeline, partKey, part, {}, VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT);
+
+    // another worker may have built the same part meanwhile, keep whichever landed first
+    std::lock_guard<std::mutex> lock(s_pmanager.mutex);
+    if (generation != s_pmanager.generation) {
+        // built from replaced shaders, only good for finishing this stale variant
+        s_pmanager.retiredPipelines.push_back({library, generation});
+        return library;
+    }
+    auto [it, inserted] = s_pmanager.libraries.emplace(libraryKey, library);
+    if (!inserted) {
+        vkDestroyPipeline(s_device.device, library, nullptr);
+    }
+    return it->second;
+}
+
+// a variant that finished after a shader reload was built from the old modules and is dropped
+bool scg::publishPipeline(scg::sPipelineManager& s_pmanager, uint32_t generation, uint32_t packed, VkPipeline pipeline) {
+    std::lock_guard<std::mutex> lock(s_pmanager.mutex);
+    if (generation != s_pmanager.generation) {
+        s_pmanager.retiredPipelines.push_back({pipeline, generation});
+        return false;
+    }
+
+    auto it = s_pmanager.pipelines.find(packed);
+    if (it != s_pmanager.pipelines.end()) {
+        s_pmanager.retiredPipelines.push_back({it->second, generation});
+    }
+    s_pmanager.pipelines[packed] = pipeline;
+    return true;
+}
+
+// Builds copy the module handles when they start, so a module released now may be in use by any
+// build of the current or an earlier generation. Newer builds copy the modules that replaced it.
+void scg::retireShaderModule(scg::sPipelineManager& s_pmanager, VkShaderModule module) {
+    std::lock_guard<std::mutex> lock(s_pmanager.mutex);
+    s_pmanager.retiredPipelines.push_back({VK_NULL_HANDLE, s_pmanager.generation, module});
+}
+
+// Called between frames. Whatever was retired since the last call may be bound by the frames
+// submitted so far, so it is stamped with the pending timeline value and destroyed once that has
+// completed and no build up to its generation is still compiling or linking against it.
+void scg::trimRetiredPipelines(scg::sDevice& s_device, scg::sPipelineManager& s_pmanager, uint64_t pendingFrame, uint64_t completedFrame) {
+    std::lock_guard<std::mutex> lock(s_pmanager.mutex);
+    auto idle = [&](scg::sRetiredPipeline& retired) {
+        if (retired.frame == UINT64_MAX) {
+            retired.frame = pendingFrame;
+        }
+        if (retired.frame > completedFrame) {
+            return false;
+        }
+        for (auto& [generation, count] : s_pmanager.activeBuilds) {
+            if (generation <= retired.generation) {
+                return false;
+            }
+        }
+        vkDestroyPipeline(s_device.device, retired.pipeline, nullptr);
+        vkDestroyShaderModule(s_device.device, retired.module, nullptr);
+        return true;
+    };
+    s_pmanager.retiredPipelines.erase(std::remove_if(s_pmanager.retiredPipelines.begin(), s_pmanager.retiredPipelines.end(), idle), s_pmanager.retiredPipelines.end());
+}
+
+// Called between frames, every variant built so far is retired and rebuilt on demand. The libraries
+// are not used by the GPU directly, but workers of the old generation may still be linking them.
+void scg::replaceDefaultPipeline(scg::sDevice& s_device, scg::sGraphicsPipeline& s_gpipeline, scg::sPipelineManager& s_pmanager, scg::sDeletionQueue& s_deletion, uint64_t frame, const scg::sGraphicsPipeline& staged) {
+    VkDevice device = s_device.device;
+    std::vector<VkPipeline> retired = {s_gpipeline.graphicsPipeline, s_gpipeline.depthPipelines[0], s_gpipeline.depthPipelines[1]};
+
+    {
+        std::lock_guard<std::mutex> lock(s_pmanager.mutex);
+        s_gpipeline.graphicsPipeline = staged.graphicsPipeline;
+        s_gpipeline.vertShaderModule = staged.vertShaderModule;
+        s_gpipeline.fragShaderModule = staged.fragShaderModule;
+        // the prepass has to match the forward pass's positions exactly, so it is swapped along
+        s_gpipeline.depthShaderModule = staged.depthShaderModule;
+        s_gpipeline.depthPipelines = staged.depthPipelines;
+
+        for (auto& [packed, variant] : s_pmanager.pipelines) {
+            retired.push_back(variant);
+        }
+        for (auto& [partKey, library] : s_pmanager.libraries) {
+            s_pmanager.retiredPipelines.push_back({library, s_pmanager.generation});
+        }
+        s_pmanager.generation++;
+        s_pmanager.pipelines.clear();
+        s_pmanager.libraries.clear();
+        s_pmanager.requested.clear();
+        s_pmanager.queue.clear();
+    }
+
+    scg::deferDeletion(s_deletion, frame, [device, retired]() {
+        for (auto retiredPipeline : retired) {
+            vkDestroyPipeline(device, retiredPipeline, nullptr);
+        }
+    });
+}
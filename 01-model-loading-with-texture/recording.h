@@ -0,0 +1,216 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <iostream>
+#include <stdexcept>
+
+#include "container.h"
+#include "zones.h"
+#include "helper.h"
+
+// Records a draw list into secondary command buffers on worker threads. Every worker owns one
+// command pool per frame in flight, so pools are never shared between threads and a frame's pool
+// is reset in one call once that frame has completed. The draw list is cut into one contiguous
+// slice per worker and the primary command buffer executes the slices in order, which keeps the
+// draw order of single threaded recording.
+namespace scg {
+    void createRecorder(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sRecorder& s_recorder);
+    void destroyRecorder(scg::sDevice& s_device, scg::sRecorder& s_recorder);
+    std::vector<scg::sDrawRange> splitDrawRanges(const std::vector<scg::sDrawRange>& drawRanges, uint32_t drawCount);
+    void recordInParallel(scg::sRecorder& s_recorder, uint32_t frame, VkCommandBufferInheritanceInfo inheritanceInfo, std::function<void(VkCommandBuffer, uint32_t, uint32_t)> record, VkCommandBuffer primary);
+    void recordWorker(scg::sDevice& s_device, scg::sRecorder& s_recorder, uint32_t index);
+    void reportRecordTime(scg::sRecorder& s_recorder, double ms);
+}
+
+void scg::createRecorder(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sRecorder& s_recorder) {
+    SCG_FUNCTION_ZONE();
+    uint32_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t workerCount = std::min(s_inst.recordThreadCount, hardwareThreads);
+    if (workerCount == 0) {
+        return;
+    }
+
+    QueueFamilyIndices queueFamilyIndices = s_device.caps.queueIndices;
+
+    for (uint32_t i = 0; i < workerCount; i++) {
+        auto worker = std::make_unique<scg::sRecordWorker>();
+        worker->commandPools.resize(s_inst.maxFramesInFlight);
+        worker->commandBuffers.resize(s_inst.maxFramesInFlight);
+
+        for (int frame = 0; frame < s_inst.maxFramesInFlight; frame++) {
+            VkCommandPoolCreateInfo poolInfo{};
+            poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+            poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+            if (vkCreateCommandPool(s_device.device, &poolInfo, nullptr, &(worker->commandPools[frame])) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create recording command pool!");
+            }
+
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = worker->commandPools[frame];
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            allocInfo.commandBufferCount = 1;
+
+            if (vkAllocateCommandBuffers(s_device.device, &allocInfo, &(worker->commandBuffers[frame])) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate secondary command buffers!");
+            }
+        }
+
+        s_recorder.workers.push_back(std::move(worker));
+    }
+
+    for (uint32_t i = 0; i < workerCount; i++) {
+        s_recorder.workers[i]->thread = std::thread(scg::recordWorker, std::ref(s_device), std::ref(s_recorder), i);
+    }
+
+    std::cout << "started " << workerCount << " command recording workers" << std::endl;
+}
+
+// the frames using the secondary command buffers have to be finished
+void scg::destroyRecorder(scg::sDevice& s_device, scg::sRecorder& s_recorder) {
+    {
+        std::lock_guard<std::mutex> lock(s_recorder.mutex);
+        s_recorder.stopping = true;
+    }
+    s_recorder.workReady.notify_all();
+
+    for (auto& worker : s_recorder.workers) {
+        worker->thread.join();
+        for (auto commandPool : worker->commandPools) {
+            vkDestroyCommandPool(s_device.device, commandPool, nullptr);
+        }
+    }
+    s_recorder.workers.clear();
+}
+
+// Cuts the material ranges into about drawCount draws of whole triangles. The mesh and the pixels
+// stay the same, only the number of draws to record grows, so this isolates the CPU side.
+std::vector<scg::sDrawRange> scg::splitDrawRanges(const std::vector<scg::sDrawRange>& drawRanges, uint32_t drawCount) {
+    SCG_FUNCTION_ZONE();
+    if (drawCount == 0) {
+        return drawRanges;
+    }
+
+    uint64_t totalIndices = 0;
+    for (const auto& range : drawRanges) {
+        totalIndices += range.indexCount;
+    }
+    uint32_t chunk = std::max<uint32_t>(3, static_cast<uint32_t>(totalIndices / drawCount / 3 * 3));
+
+    std::vector<scg::sDrawRange> draws;
+    for (const auto& range : drawRanges) {
+        for (uint32_t offset = 0; offset < range.indexCount; offset += chunk) {
+            draws.push_back({range.firstIndex + offset, std::min(chunk, range.indexCount - offset), range.materialIndex});
+        }
+    }
+
+    std::cout << "split " << drawRanges.size() << " draw ranges into " << draws.size() << " draws" << std::endl;
+    return draws;
+}
+
+// record is called on the workers with a range [first, last) of s_recorder.draws and a secondary
+// command buffer that has already begun, and is done with once this returns
+void scg::recordInParallel(scg::sRecorder& s_recorder, uint32_t frame, VkCommandBufferInheritanceInfo inheritanceInfo, std::function<void(VkCommandBuffer, uint32_t, uint32_t)> record, VkCommandBuffer primary) {
+    {
+        std::lock_guard<std::mutex> lock(s_recorder.mutex);
+        s_recorder.frame = frame;
+        s_recorder.inheritance = inheritanceInfo;
+        s_recorder.record = std::move(record);
+        s_recorder.pending = static_cast<uint32_t>(s_recorder.workers.size());
+        s_recorder.batch++;
+    }
+    s_recorder.workReady.notify_all();
+
+    {
+        std::unique_lock<std::mutex> lock(s_recorder.mutex);
+        s_recorder.workDone.wait(lock, [&s_recorder]() { return s_recorder.pending == 0; });
+        s_recorder.record = nullptr;
+    }
+
+    std::vector<VkCommandBuffer> secondaries;
+    for (auto& worker : s_recorder.workers) {
+        if (worker->recorded) {
+            secondaries.push_back(worker->commandBuffers[frame]);
+        }
+    }
+    if (!secondaries.empty()) {
+        vkCmdExecuteCommands(primary, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+    }
+}
+
+void scg::recordWorker(scg::sDevice& s_device, scg::sRecorder& s_recorder, uint32_t index) {
+    uint64_t seenBatch = 0;
+    scg::sRecordWorker& worker = *(s_recorder.workers[index]);
+    scg::nameZoneThread("record worker " + std::to_string(index));
+
+    while (true) {
+        uint32_t frame;
+        {
+            std::unique_lock<std::mutex> lock(s_recorder.mutex);
+            s_recorder.workReady.wait(lock, [&s_recorder, seenBatch]() { return s_recorder.stopping || s_recorder.batch != seenBatch; });
+            if (s_recorder.stopping) {
+                return;
+            }
+            seenBatch = s_recorder.batch;
+            frame = s_recorder.frame;
+        }
+
+        uint64_t drawCount = s_recorder.draws.size();
+        uint64_t workerCount = s_recorder.workers.size();
+        uint32_t first = static_cast<uint32_t>(drawCount * index / workerCount);
+        uint32_t last = static_cast<uint32_t>(drawCount * (index + 1) / workerCount);
+
+        worker.recorded = first < last;
+        if (worker.recorded) {
+            SCG_ZONE("record slice");
+            // the frame has completed, nothing recorded from this pool is in flight anymore
+            vkResetCommandPool(s_device.device, worker.commandPools[frame], 0);
+            VkCommandBuffer commandBuffer = worker.commandBuffers[frame];
+
+            VkCommandBufferBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+            beginInfo.pInheritanceInfo = &(s_recorder.inheritance);
+
+            if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+                throw std::runtime_error("failed to begin recording secondary command buffer!");
+            }
+            s_recorder.record(commandBuffer, first, last);
+            if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to record secondary command buffer!");
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(s_recorder.mutex);
+            s_recorder.pending--;
+        }
+        s_recorder.workDone.notify_one();
+    }
+}
+
+void scg::reportRecordTime(scg::sRecorder& s_recorder, double ms) {
+    s_recorder.recordMs += ms;
+    s_recorder.recordedFrames++;
+    if (s_recorder.recordedFrames < s_recorder.reportInterval) {
+        return;
+    }
+
+    std::cout << "command recording: " << s_recorder.recordMs / s_recorder.recordedFrames << " ms per frame, "
+        << s_recorder.draws.size() << " draws on ";
+    if (s_recorder.workers.empty()) {
+        std::cout << "the main thread" << std::endl;
+    } else {
+        std::cout << s_recorder.workers.size() << " threads" << std::endl;
+    }
+    s_recorder.recordMs = 0.0;
+    s_recorder.recordedFrames = 0;
+}
@@ -0,0 +1,807 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <iostream>
+
+#include "container.h"
+#include "helper.h"
+#include "swapchain.h"
+#include "gpuprofiler.h"
+#include "synchronization.h"
+#include "deletion.h"
+
+// Passes are declared every frame together with the images and buffers they read and write.
+// scg::compileRenderGraph culls the passes nothing consumes, works out one batched barrier per
+// pass from the tracked resource states, and places transient attachments whose lifetimes do not
+// overlap in the same memory. Render passes, framebuffers and transient memory are cached and only
+// rebuilt when the declarations change.
+namespace scg {
+    uint32_t importImage(scg::sRenderGraph& s_graph, const std::string& name, VkImage image, VkImageView view, VkFormat format, VkExtent2D extent, VkImageAspectFlags aspect, scg::sGraphResourceState initialState, VkImageLayout finalLayout);
+    uint32_t createTransientImage(scg::sRenderGraph& s_graph, const std::string& name, VkFormat format, VkExtent2D extent, VkSampleCountFlagBits samples, VkImageAspectFlags aspect);
+    uint32_t importBuffer(scg::sRenderGraph& s_graph, const std::string& name, VkBuffer buffer, scg::sGraphResourceState initialState, bool output);
+
+    uint32_t addPass(scg::sRenderGraph& s_graph, const std::string& name, std::function<void(VkCommandBuffer)> execute);
+    void writeColor(scg::sRenderGraph& s_graph, uint32_t pass, uint32_t image, VkAttachmentLoadOp loadOp, VkClearColorValue clear);
+    void writeDepth(scg::sRenderGraph& s_graph, uint32_t pass, uint32_t image, VkAttachmentLoadOp loadOp, VkClearDepthStencilValue clear);
+    void resolveColor(scg::sRenderGraph& s_graph, uint32_t pass, uint32_t image);
+    void readDepth(scg::sRenderGraph& s_graph, uint32_t pass, uint32_t image);
+    void readImage(scg::sRenderGraph& s_graph, uint32_t pass, uint32_t image, VkPipelineStageFlags stages);
+    void readBuffer(scg::sRenderGraph& s_graph, uint32_t pass, uint32_t buffer, VkPipelineStageFlags stages, VkAccessFlags access);
+    void writeBuffer(scg::sRenderGraph& s_graph, uint32_t pass, uint32_t buffer, VkPipelineStageFlags stages, VkAccessFlags access);
+    void setRenderArea(scg::sRenderGraph& s_graph, uint32_t pass, VkExtent2D extent);
+    void useSecondaryCommandBuffers(scg::sRenderGraph& s_graph, uint32_t pass);
+
+    VkImageView getImageView(scg::sRenderGraph& s_graph, uint32_t image);
+    VkCommandBufferInheritanceInfo getInheritanceInfo(scg::sRenderGraph& s_graph);
+    void compileRenderGraph(scg::sDevice& s_device, scg::sRenderGraph& s_graph, scg::sDeletionQueue& s_deletion, uint64_t frame);
+    void executeRenderGraph(scg::sRenderGraph& s_graph, VkCommandBuffer commandBuffer, scg::sGpuProfiler& s_gprof, uint32_t frame);
+    void resetRenderGraph(scg::sRenderGraph& s_graph);
+    void invalidateRenderGraph(scg::sDevice& s_device, scg::sRenderGraph& s_graph);
+    void retireRenderGraph(scg::sDevice& s_device, scg::sRenderGraph& s_graph, scg::sDeletionQueue& s_deletion, uint64_t frame);
+    void destroyRenderGraph(scg::sDevice& s_device, scg::sRenderGraph& s_graph);
+
+    void cullPasses(scg::sRenderGraph& s_graph);
+    void allocateTransientImages(scg::sDevice& s_device, scg::sRenderGraph& s_graph, scg::sDeletionQueue& s_deletion, uint64_t frame);
+    void computeBarriers(scg::sRenderGraph& s_graph);
+    void createPassObjects(scg::sDevice& s_device, scg::sRenderGraph& s_graph, uint32_t passIndex);
+    void addImageAccess(scg::sRenderGraph& s_graph, uint32_t pass, uint32_t image, bool write, VkPipelineStageFlags stages, VkAccessFlags access, VkImageLayout layout);
+}
+
+uint32_t scg::importImage(scg::sRenderGraph& s_graph, const std::string& name, VkImage image, VkImageView view, VkFormat format, VkExtent2D extent, VkImageAspectFlags aspect, scg::sGraphResourceState initialState, VkImageLayout finalLayout) {
+    scg::sGraphImage graphImage{};
+    graphImage.name = name;
+    graphImage.format = format;
+    graphImage.extent = extent;
+    graphImage.aspect = aspect;
+    graphImage.image = image;
+    graphImage.view = view;
+    graphImage.imported = true;
+    graphImage.initialState = initialState;
+    graphImage.finalLayout = finalLayout;
+
+    s_graph.images.push_back(graphImage);
+    return static_cast<uint32_t>(s_graph.images.size() - 1);
+}
+
+uint32_t scg::createTransientImage(scg::sRenderGraph& s_graph, const std::string& name, VkFormat format, VkExtent2D extent, VkSampleCountFlagBits samples, VkImageAspectFlags aspect) {
+    scg::sGraphImage graphImage{};
+    graphImage.name = name;
+    graphImage.format = format;
+    graphImage.extent = extent;
+    graphImage.samples = samples;
+    graphImage.aspect = aspect;
+
+    s_graph.images.push_back(graphImage);
+    return static_cast<uint32_t>(s_graph.images.size() - 1);
+}
+
+// output buffers are consumed outside the graph and keep the passes writing them alive
+uint32_t scg::importBuffer(scg::sRenderGraph& s_graph, const std::string& name, VkBuffer buffer, scg::sGraphResourceState initialState, bool output) {
+    scg::sGraphBuffer graphBuffer{};
+    graphBuffer.name = name;
+    graphBuffer.buffer = buffer;
+    graphBuffer.initialState = initialState;
+    graphBuffer.output = output;
+
+    s_graph.buffers.push_back(graphBuffer);
+    return static_cast<uint32_t>(s_graph.buffers.size() - 1);
+}
+
+uint32_t scg::addPass(scg::sRenderGraph& s_graph, const std::string& name, std::function<void(VkCommandBuffer)> execute) {
+    scg::sGraphPass pass{};
+    pass.name = name;
+    pass.execute = std::move(execute);
+
+    s_graph.passes.push_back(std::move(pass));
+    return static_cast<uint32_t>(s_graph.passes.size() - 1);
+}
+
+void scg::addImageAccess(scg::sRenderGraph& s_graph, uint32_t pass, uint32_t image, bool write, VkPipelineStageFlags stages, VkAccessFlags access, VkImageLayout layout) {
+    scg::sGraphAccess graphAccess{};
+    graphAccess.resource = image;
+    graphAccess.write = write;
+    graphAccess.stages = stages;
+    graphAccess.access = access;
+    graphAccess.layout = layout;
+    s_graph.passes[pass].accesses.push_back(graphAccess);
+}
+
+// loading the previous contents makes the attachment a read as well as a write
+void scg::writeColor(scg::sRenderGraph& s_graph, uint32_t pass, uint32_t image, VkAttachmentLoadOp loadOp, VkClearColorValue clear) {
+    scg::sGraphAttachment attachment{};
+    attachment.image = image;
+    attachment.loadOp = loadOp;
+    attachment.clearValue.color = clear;
+    attachment.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    s_graph.passes[pass].colorAttachments.push_back(attachment);
+
+    VkAccessFlags access = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    if (loadOp == VK_ATTACHMENT_LOAD_OP_LOAD) {
+        access |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+    }
+    scg::addImageAccess(s_graph, pass, image, true, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, access, attachment.layout);
+}
+
+// resolves the color attachment declared in the same position into image at the end of the pass
+void scg::resolveColor(scg::sRenderGraph& s_graph, uint32_t pass, uint32_t image) {
+    scg::sGraphAttachment attachment{};
+    attachment.image = image;
+    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachment.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    s_graph.passes[pass].resolveAttachments.push_back(attachment);
+
+    scg::addImageAccess(s_graph, pass, image, true, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, attachment.layout);
+}
+
+void scg::writeDepth(scg::sRenderGraph& s_graph, uint32_t pass, uint32_t image, VkAttachmentLoadOp loadOp, VkClearDepthStencilValue clear) {
+    scg::sGraphAttachment attachment{};
+    attachment.image = image;
+    attachment.loadOp = loadOp;
+    attachment.clearValue.depthStencil = clear;
+    attachment.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    s_graph.passes[pass].depthAttachment = attachment;
+
+    // depth testing reads the attachment even when it was just cleared
+    scg::addImageAccess(s_graph, pass, image, true, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, attachment.layout);
+}
+
+// depth test against an earlier pass's depth without writing it
+void scg::readDepth(scg::sRenderGraph& s_graph, uint32_t pass, uint32_t image) {
+    scg::sGraphAttachment attachment{};
+    attachment.image = image;
+    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachment.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    s_graph.passes[pass].depthAttachment = attachment;
+
+    scg::addImageAccess(s_graph, pass, image, false, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, attachment.layout);
+}
+
+void scg::readImage(scg::sRenderGraph& s_graph, uint32_t pass, uint32_t image, VkPipelineStageFlags stages) {
+    scg::addImageAccess(s_graph, pass, image, false, stages, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+}
+
+void scg::readBuffer(scg::sRenderGraph& s_graph, uint32_t pass, uint32_t buffer, VkPipelineStageFlags stages, VkAccessFlags access) {
+    scg::sGraphAccess graphAccess{};
+    graphAccess.resource = buffer;
+    graphAccess.buffer = true;
+    graphAccess.stages = stages;
+    graphAccess.access = access;
+    s_graph.passes[pass].accesses.push_back(graphAccess);
+}
+
+void scg::writeBuffer(scg::sRenderGraph& s_graph, uint32_t pass, uint32_t buffer, VkPipelineStageFlags stages, VkAccessFlags access) {
+    scg::sGraphAccess graphAccess{};
+    graphAccess.resource = buffer;
+    graphAccess.buffer = true;
+    graphAccess.write = true;
+    graphAccess.stages = stages;
+    graphAccess.access = access;
+    s_graph.passes[pass].accesses.push_back(graphAccess);
+}
+
+// lets a pass draw into the corner of larger attachments, which then never need reallocating
+void scg::setRenderArea(scg::sRenderGraph& s_graph, uint32_t pass, VkExtent2D extent) {
+    s_graph.passes[pass].renderArea = extent;
+}
+
+// the pass is then recorded into secondary command buffers, see scg::getInheritanceInfo
+void scg::useSecondaryCommandBuffers(scg::sRenderGraph& s_graph, uint32_t pass) {
+    s_graph.passes[pass].secondaryContents = true;
+}
+
+// transient views only exist after scg::compileRenderGraph
+VkImageView scg::getImageView(scg::sRenderGraph& s_graph, uint32_t image) {
+    return s_graph.images[image].view;
+}
+
+// only valid inside the execute callback of a pass, secondary command buffers continue its render pass
+VkCommandBufferInheritanceInfo scg::getInheritanceInfo(scg::sRenderGraph& s_graph) {
+    scg::sGraphPass& pass = s_graph.passes[s_graph.executingPass];
+
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = pass.renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = pass.framebuffer;
+    return inheritanceInfo;
+}
+
+void scg::compileRenderGraph(scg::sDevice& s_device, scg::sRenderGraph& s_graph, scg::sDeletionQueue& s_deletion, uint64_t frame) {
+    scg::cullPasses(s_graph);
+    scg::allocateTransientImages(s_device, s_graph, s_deletion, frame);
+    scg::computeBarriers(s_graph);
+
+    for (uint32_t i = 0; i < s_graph.passes.size(); i++) {
+        if (!s_graph.passes[i].culled) {
+            scg::createPassObjects(s_device, s_graph, i);
+        }
+    }
+}
+
+// Walks the passes backwards from the graph outputs: imported images with a final layout and
+// output buffers. A pass survives when it writes something a later surviving pass or the outside
+// needs. An attachment that is cleared or discarded on load replaces the old contents, so earlier
+// writers of it are no longer needed; every other write keeps the need alive.
+void scg::cullPasses(scg::sRenderGraph& s_graph) {
+    std::vector<bool> imageNeeded(s_graph.images.size(), false);
+    std::vector<bool> bufferNeeded(s_graph.buffers.size(), false);
+    for (size_t i = 0; i < s_graph.images.size(); i++) {
+        imageNeeded[i] = s_graph.images[i].imported && s_graph.images[i].finalLayout != VK_IMAGE_LAYOUT_UNDEFINED;
+    }
+    for (size_t i = 0; i < s_graph.buffers.size(); i++) {
+        bufferNeeded[i] = s_graph.buffers[i].output;
+    }
+
+    uint32_t culled = 0;
+    for (size_t p = s_graph.passes.size(); p-- > 0;) {
+        scg::sGraphPass& pass = s_graph.passes[p];
+
+        bool live = false;
+        for (auto& access : pass.accesses) {
+            if (access.write && (access.buffer ? bufferNeeded[access.resource] : imageNeeded[access.resource])) {
+                live = true;
+            }
+        }
+        pass.culled = !live;
+        if (!live) {
+            culled++;
+            continue;
+        }
+
+        auto overwrites = [&](uint32_t image) {
+            for (auto& attachment : pass.resolveAttachments) {
+                if (attachment.image == image) {
+                    return true;
+                }
+            }
+            for (auto& attachment : pass.colorAttachments) {
+                if (attachment.image == image) {
+                    return attachment.loadOp != VK_ATTACHMENT_LOAD_OP_LOAD;
+                }
+            }
+            return pass.depthAttachment.has_value() && pass.depthAttachment->image == image && pass.depthAttachment->loadOp != VK_ATTACHMENT_LOAD_OP_LOAD;
+        };
+
+        for (auto& access : pass.accesses) {
+            if (access.buffer) {
+                bufferNeeded[access.resource] = true;
+            } else {
+                imageNeeded[access.resource] = !(access.write && overwrites(access.resource));
+            }
+        }
+    }
+
+    if (culled != s_graph.culledPasses) {
+        std::cout << "render graph: " << s_graph.passes.size() - culled << " passes, " << culled << " culled" << std::endl;
+        s_graph.culledPasses = culled;
+    }
+}
+
+// Transient images are sorted by size and greedily packed into memory blocks: an image joins the
+// first block whose members it never overlaps in pass order and whose memory types it can use.
+// Images only ever used as attachments inside a single pass get TRANSIENT_ATTACHMENT usage and
+// lazily allocated memory where the device has it, so tiled GPUs never back them with memory at all.
+void scg::allocateTransientImages(scg::sDevice& s_device, scg::sRenderGraph& s_graph, scg::sDeletionQueue& s_deletion, uint64_t frame) {
+    std::vector<uint32_t> transients;
+    std::string signature;
+    for (uint32_t i = 0; i < s_graph.images.size(); i++) {
+        scg::sGraphImage& image = s_graph.images[i];
+        if (image.imported) {
+            continue;
+        }
+
+        image.firstPass = UINT32_MAX;
+        image.lastPass = 0;
+        image.usage = 0;
+        bool attachmentOnly = true;
+        for (uint32_t p = 0; p < s_graph.passes.size(); p++) {
+            if (s_graph.passes[p].culled) {
+                continue;
+            }
+            for (auto& access : s_graph.passes[p].accesses) {
+                if (access.buffer || access.resource != i) {
+                    continue;
+                }
+                image.firstPass = std::min(image.firstPass, p);
+                image.lastPass = std::max(image.lastPass, p);
+                if (access.layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) {
+                    image.usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+                } else if (access.layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL || access.layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL) {
+                    image.usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+                } else {
+                    image.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+                    attachmentOnly = false;
+                }
+            }
+        }
+        if (image.firstPass == UINT32_MAX) {
+            continue;
+        }
+        if (attachmentOnly && image.firstPass == image.lastPass) {
+            image.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        }
+
+        transients.push_back(i);
+        signature += image.name + ':' + std::to_string(image.format) + ':' + std::to_string(image.extent.width) + 'x' + std::to_string(image.extent.height) +
+            ':' + std::to_string(image.samples) + ':' + std::to_string(image.usage) + ':' + std::to_string(image.firstPass) + '-' + std::to_string(image.lastPass) + ';';
+    }
+
+    if (signature != s_graph.transientSignature) {
+        scg::retireRenderGraph(s_device, s_graph, s_deletion, frame);
+        s_graph.transientSignature = signature;
+
+        struct Block {
+            VkDeviceSize size;
+            uint32_t memoryTypeBits;
+            bool lazy;
+            std::vector<uint32_t> members;
+        };
+
+        std::vector<VkMemoryRequirements> requirements(transients.size());
+        s_graph.transientImages.resize(transients.size());
+        for (size_t t = 0; t < transients.size(); t++) {
+            scg::sGraphImage& image = s_graph.images[transients[t]];
+
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.extent.width = image.extent.width;
+            imageInfo.extent.height = image.extent.height;
+            imageInfo.extent.depth = 1;
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.format = image.format;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            imageInfo.usage = image.usage;
+            imageInfo.samples = image.samples;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+            if (vkCreateImage(s_device.device, &imageInfo, nullptr, &(s_graph.transientImages[t].image)) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create transient image!");
+            }
+            vkGetImageMemoryRequirements(s_device.device, s_graph.transientImages[t].image, &requirements[t]);
+        }
+
+        std::vector<size_t> order(transients.size());
+        for (size_t t = 0; t < order.size(); t++) {
+            order[t] = t;
+        }
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return requirements[a].size > requirements[b].size;
+        });
+
+        std::vector<Block> blocks;
+        VkDeviceSize requestedBytes = 0;
+        for (size_t t : order) {
+            scg::sGraphImage& image = s_graph.images[transients[t]];
+            bool lazy = (image.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) != 0;
+            requestedBytes += requirements[t].size;
+
+            Block* target = nullptr;
+            for (auto& block : blocks) {
+                if ((block.memoryTypeBits & requirements[t].memoryTypeBits) == 0 || block.lazy != lazy) {
+                    continue;
+                }
+                bool overlaps = false;
+                for (uint32_t member : block.members) {
+                    scg::sGraphImage& other = s_graph.images[transients[member]];
+                    if (image.firstPass <= other.lastPass && other.firstPass <= image.lastPass) {
+                        overlaps = true;
+                        break;
+                    }
+                }
+                if (!overlaps) {
+                    target = &block;
+                    break;
+                }
+            }
+            if (target == nullptr) {
+                blocks.push_back({0, requirements[t].memoryTypeBits, lazy, {}});
+                target = &blocks.back();
+            }
+            target->size = std::max(target->size, requirements[t].size);
+            target->memoryTypeBits &= requirements[t].memoryTypeBits;
+            target->members.push_back(static_cast<uint32_t>(t));
+        }
+
+        VkDeviceSize allocatedBytes = 0;
+        for (auto& block : blocks) {
+            VkMemoryAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            allocInfo.allocationSize = block.size;
+            try {
+                allocInfo.memoryTypeIndex = scg::findMemoryType(s_device, block.memoryTypeBits,
+                        block.lazy ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            } catch (const std::runtime_error&) {
+                allocInfo.memoryTypeIndex = scg::findMemoryType(s_device, block.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            }
+
+            VkDeviceMemory memory;
+            if (vkAllocateMemory(s_device.device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate transient image memory!");
+            }
+            s_graph.transientMemory.push_back(memory);
+            allocatedBytes += block.size;
+
+            // a block's first user in a frame has to wait for everything the previous users did
+            VkPipelineStageFlags aliasStages = 0;
+            VkAccessFlags aliasAccess = 0;
+            for (uint32_t member : block.members) {
+                for (auto& pass : s_graph.passes) {
+                    for (auto& access : pass.accesses) {
+                        if (!pass.culled && !access.buffer && access.resource == transients[member]) {
+                            aliasStages |= access.stages;
+                            aliasAccess |= scg::writeAccessMask(access.access);
+                        }
+                    }
+                }
+            }
+
+            for (uint32_t member : block.members) {
+                scg::sTransientImage& transient = s_graph.transientImages[member];
+                scg::sGraphImage& image = s_graph.images[transients[member]];
+                vkBindImageMemory(s_device.device, transient.image, memory, 0);
+                transient.view = scg::createImageView(s_device, transient.image, image.format, image.aspect);
+                transient.aliasStages = aliasStages;
+                transient.aliasAccess = aliasAccess;
+            }
+        }
+
+        std::cout << "render graph: " << transients.size() << " transient images in " << blocks.size() << " allocations, "
+            << (requestedBytes - allocatedBytes) / 1024 << " KiB saved by aliasing" << std::endl;
+    }
+
+    for (size_t t = 0; t < transients.size(); t++) {
+        scg::sGraphImage& image = s_graph.images[transients[t]];
+        image.image = s_graph.transientImages[t].image;
+        image.view = s_graph.transientImages[t].view;
+        image.initialState = {};
+        image.initialState.writeStages = s_graph.transientImages[t].aliasStages;
+        image.initialState.writeAccess = s_graph.transientImages[t].aliasAccess;
+    }
+}
+
+// Replays the surviving passes against the tracked state of every resource. A read only waits when
+// there is a write it has not seen yet, a write waits for the previous write and every read since,
+// and a layout change is always a barrier. The barriers a pass needs are merged into one call.
+void scg::computeBarriers(scg::sRenderGraph& s_graph) {
+    std::vector<scg::sGraphResourceState> imageStates(s_graph.images.size());
+    std::vector<scg::sGraphResourceState> bufferStates(s_graph.buffers.size());
+    for (size_t i = 0; i < s_graph.images.size(); i++) {
+        imageStates[i] = s_graph.images[i].initialState;
+    }
+    for (size_t i = 0; i < s_graph.buffers.size(); i++) {
+        bufferStates[i] = s_graph.buffers[i].initialState;
+    }
+
+    auto imageBarrier = [&](uint32_t image, const scg::sGraphResourceState& state, VkImageLayout newLayout, VkAccessFlags dstAccess) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = state.writeAccess;
+        barrier.dstAccessMask = dstAccess;
+        barrier.oldLayout = state.layout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = s_graph.images[image].image;
+        barrier.subresourceRange.aspectMask = s_graph.images[image].aspect;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        return barrier;
+    };
+
+    for (auto& pass : s_graph.passes) {
+        pass.srcStages = 0;
+        pass.dstStages = 0;
+        pass.memoryBarrier = {};
+        pass.memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        pass.imageBarriers.clear();
+        if (pass.culled) {
+            continue;
+        }
+
+        for (auto& access : pass.accesses) {
+            scg::sGraphResourceState& state = access.buffer ? bufferStates[access.resource] : imageStates[access.resource];
+            bool layoutChange = !access.buffer && state.layout != access.layout;
+
+            if (access.write || layoutChange) {
+                VkPipelineStageFlags waitStages = state.writeStages | state.readStages;
+                if (layoutChange || waitStages != 0) {
+                    pass.srcStages |= waitStages;
+                    pass.dstStages |= access.stages;
+                    if (access.buffer) {
+                        pass.memoryBarrier.srcAccessMask |= state.writeAccess;
+                        pass.memoryBarrier.dstAccessMask |= access.access;
+                    } else {
+                        pass.imageBarriers.push_back(imageBarrier(access.resource, state, access.layout, access.access));
+                    }
+                }
+                state.layout = access.layout;
+                state.writeStages = access.stages;
+                state.writeAccess = scg::writeAccessMask(access.access);
+                state.readStages = 0;
+                state.readAccess = 0;
+                if (!access.write) {
+                    // the transition is the write, this access has already seen it
+                    state.readStages = access.stages;
+                    state.readAccess = access.access;
+                }
+            } else {
+                bool unseen = state.writeStages != 0 && ((access.stages & ~state.readStages) != 0 || (access.access & ~state.readAccess) != 0);
+                if (unseen) {
+                    pass.srcStages |= state.writeStages;
+                    pass.dstStages |= access.stages;
+                    if (access.buffer) {
+                        pass.memoryBarrier.srcAccessMask |= state.writeAccess;
+                        pass.memoryBarrier.dstAccessMask |= access.access;
+                    } else {
+                        pass.imageBarriers.push_back(imageBarrier(access.resource, state, access.layout, access.access));
+                    }
+                }
+                state.readStages |= access.stages;
+                state.readAccess |= access.access;
+            }
+        }
+    }
+
+    s_graph.finalSrcStages = 0;
+    s_graph.finalBarriers.clear();
+    for (uint32_t i = 0; i < s_graph.images.size(); i++) {
+        scg::sGraphImage& image = s_graph.images[i];
+        if (!image.imported || image.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED || imageStates[i].layout == image.finalLayout) {
+            continue;
+        }
+        VkPipelineStageFlags dstStages;
+        VkAccessFlags dstAccess;
+        scg::getLayoutAccess(image.finalLayout, dstStages, dstAccess);
+        s_graph.finalSrcStages |= imageStates[i].writeStages | imageStates[i].readStages;
+        s_graph.finalBarriers.push_back(imageBarrier(i, imageStates[i], image.finalLayout, dstAccess));
+    }
+}
+
+// Attachments start and end the render pass in the layout the barriers put them in. Contents are
+// only stored when the image is imported or a later pass uses it, so the depth buffer of the last
+// pass never leaves tile memory.
+void scg::createPassObjects(scg::sDevice& s_device, scg::sRenderGraph& s_graph, uint32_t passIndex) {
+    scg::sGraphPass& pass = s_graph.passes[passIndex];
+    pass.renderPass = VK_NULL_HANDLE;
+    pass.framebuffer = VK_NULL_HANDLE;
+    if (pass.colorAttachments.empty() && !pass.depthAttachment.has_value()) {
+        return;
+    }
+
+    if (!pass.resolveAttachments.empty() && pass.resolveAttachments.size() != pass.colorAttachments.size()) {
+        throw std::runtime_error("render graph pass " + pass.name + " resolves some but not all color attachments!");
+    }
+
+    // colors, then depth, then resolves
+    std::vector<scg::sGraphAttachment> attachments = pass.colorAttachments;
+    if (pass.depthAttachment.has_value()) {
+        attachments.push_back(pass.depthAttachment.value());
+    }
+    attachments.insert(attachments.end(), pass.resolveAttachments.begin(), pass.resolveAttachments.end());
+
+    std::vector<VkAttachmentDescription> descriptions;
+    std::vector<VkImageView> views;
+    std::string passKey;
+    for (auto& attachment : attachments) {
+        scg::sGraphImage& image = s_graph.images[attachment.image];
+        bool stored = image.imported || image.lastPass > passIndex;
+
+        VkAttachmentDescription description{};
+        description.format = image.format;
+        description.samples = image.samples;
+        description.loadOp = attachment.loadOp;
+        description.storeOp = stored ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        description.initialLayout = attachment.layout;
+        description.finalLayout = attachment.layout;
+        descriptions.push_back(description);
+        views.push_back(image.view);
+
+        passKey += std::to_string(image.format) + ':' + std::to_string(image.samples) + ':' + std::to_string(attachment.loadOp) +
+            ':' + std::to_string(description.storeOp) + ':' + std::to_string(attachment.layout) + ';';
+    }
+    pass.extent = s_graph.images[attachments[0].image].extent;
+
+    auto cachedPass = s_graph.renderPasses.find(passKey);
+    if (cachedPass != s_graph.renderPasses.end()) {
+        pass.renderPass = cachedPass->second;
+    } else {
+        std::vector<VkAttachmentReference> colorRefs;
+        for (uint32_t i = 0; i < pass.colorAttachments.size(); i++) {
+            colorRefs.push_back({i, pass.colorAttachments[i].layout});
+        }
+        VkAttachmentReference depthRef{};
+        if (pass.depthAttachment.has_value()) {
+            depthRef = {static_cast<uint32_t>(colorRefs.size()), pass.depthAttachment->layout};
+        }
+        std::vector<VkAttachmentReference> resolveRefs;
+        uint32_t firstResolve = static_cast<uint32_t>(colorRefs.size() + (pass.depthAttachment.has_value() ? 1 : 0));
+        for (uint32_t i = 0; i < pass.resolveAttachments.size(); i++) {
+            resolveRefs.push_back({firstResolve + i, pass.resolveAttachments[i].layout});
+        }
+
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = static_cast<uint32_t>(colorRefs.size());
+        subpass.pColorAttachments = colorRefs.data();
+        subpass.pResolveAttachments = resolveRefs.empty() ? nullptr : resolveRefs.data();
+        subpass.pDepthStencilAttachment = pass.depthAttachment.has_value() ? &depthRef : nullptr;
+
+        VkRenderPassCreateInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = static_cast<uint32_t>(descriptions.size());
+        renderPassInfo.pAttachments = descriptions.data();
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+
+        if (vkCreateRenderPass(s_device.device, &renderPassInfo, nullptr, &(pass.renderPass)) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create render graph pass!");
+        }
+        s_graph.renderPasses[passKey] = pass.renderPass;
+    }
+
+    std::string framebufferKey = passKey + std::to_string(pass.extent.width) + 'x' + std::to_string(pass.extent.height);
+    for (auto view : views) {
+        framebufferKey += ':' + std::to_string(reinterpret_cast<uint64_t>(view));
+    }
+
+    auto cachedFramebuffer = s_graph.framebuffers.find(framebufferKey);
+    if (cachedFramebuffer != s_graph.framebuffers.end()) {
+        pass.framebuffer = cachedFramebuffer->second;
+        return;
+    }
+
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = pass.renderPass;
+    framebufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+    framebufferInfo.pAttachments = views.data();
+    framebufferInfo.width = pass.extent.width;
+    framebufferInfo.height = pass.extent.height;
+    framebufferInfo.layers = 1;
+
+    if (vkCreateFramebuffer(s_device.device, &framebufferInfo, nullptr, &(pass.framebuffer)) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create framebuffer!");
+    }
+    s_graph.framebuffers[framebufferKey] = pass.framebuffer;
+}
+
+// every pass that runs is a GPU scope of its own name, barriers included
+void scg::executeRenderGraph(scg::sRenderGraph& s_graph, VkCommandBuffer commandBuffer, scg::sGpuProfiler& s_gprof, uint32_t frame) {
+    for (uint32_t p = 0; p < s_graph.passes.size(); p++) {
+        scg::sGraphPass& pass = s_graph.passes[p];
+        if (pass.culled) {
+            continue;
+        }
+        s_graph.executingPass = p;
+        scg::beginGpuScope(commandBuffer, s_gprof, frame, pass.name);
+
+        if (pass.dstStages != 0) {
+            bool memory = pass.memoryBarrier.srcAccessMask != 0 || pass.memoryBarrier.dstAccessMask != 0;
+            VkPipelineStageFlags srcStages = pass.srcStages != 0 ? pass.srcStages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+            vkCmdPipelineBarrier(commandBuffer,
+                    srcStages, pass.dstStages, 0,
+                    memory ? 1 : 0, memory ? &(pass.memoryBarrier) : nullptr,
+                    0, nullptr,
+                    static_cast<uint32_t>(pass.imageBarriers.size()), pass.imageBarriers.data());
+        }
+
+        if (pass.renderPass == VK_NULL_HANDLE) {
+            pass.execute(commandBuffer);
+            scg::endGpuScope(commandBuffer, s_gprof, frame);
+            continue;
+        }
+
+        std::vector<VkClearValue> clearValues;
+        for (auto& attachment : pass.colorAttachments) {
+            clearValues.push_back(attachment.clearValue);
+        }
+        if (pass.depthAttachment.has_value()) {
+            clearValues.push_back(pass.depthAttachment->clearValue);
+        }
+        for (auto& attachment : pass.resolveAttachments) {
+            clearValues.push_back(attachment.clearValue);
+        }
+
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = pass.renderPass;
+        renderPassInfo.framebuffer = pass.framebuffer;
+        renderPassInfo.renderArea.offset = {0, 0};
+        renderPassInfo.renderArea.extent = pass.renderArea.width != 0 ? pass.renderArea : pass.extent;
+        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+        renderPassInfo.pClearValues = clearValues.data();
+
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, pass.secondaryContents ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+        pass.execute(commandBuffer);
+        vkCmdEndRenderPass(commandBuffer);
+        scg::endGpuScope(commandBuffer, s_gprof, frame);
+    }
+
+    if (!s_graph.finalBarriers.empty()) {
+        VkPipelineStageFlags srcStages = s_graph.finalSrcStages != 0 ? s_graph.finalSrcStages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+        vkCmdPipelineBarrier(commandBuffer,
+                srcStages, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                0, nullptr,
+                0, nullptr,
+                static_cast<uint32_t>(s_graph.finalBarriers.size()), s_graph.finalBarriers.data());
+    }
+}
+
+// the declarations are rebuilt every frame, the cached objects stay
+void scg::resetRenderGraph(scg::sRenderGraph& s_graph) {
+    s_graph.images.clear();
+    s_graph.buffers.clear();
+    s_graph.passes.clear();
+    s_graph.finalBarriers.clear();
+}
+
+// the device has to be idle, used when the swapchain images go away
+void scg::invalidateRenderGraph(scg::sDevice& s_device, scg::sRenderGraph& s_graph) {
+    for (auto& entry : s_graph.framebuffers) {
+        vkDestroyFramebuffer(s_device.device, entry.second, nullptr);
+    }
+    for (auto& transient : s_graph.transientImages) {
+        vkDestroyImageView(s_device.device, transient.view, nullptr);
+        vkDestroyImage(s_device.device, transient.image, nullptr);
+    }
+    for (auto memory : s_graph.transientMemory) {
+        vkFreeMemory(s_device.device, memory, nullptr);
+    }
+    s_graph.framebuffers.clear();
+    s_graph.transientImages.clear();
+    s_graph.transientMemory.clear();
+    s_graph.transientSignature.clear();
+    scg::resetRenderGraph(s_graph);
+}
+
+// like invalidateRenderGraph, but frames in flight may still use the old images, so they are freed
+// through the deletion queue, the framebuffers go with their views
+void scg::retireRenderGraph(scg::sDevice& s_device, scg::sRenderGraph& s_graph, scg::sDeletionQueue& s_deletion, uint64_t frame) {
+    auto images = s_graph.transientImages;
+    auto memory = s_graph.transientMemory;
+    std::vector<VkFramebuffer> framebuffers;
+    for (auto& entry : s_graph.framebuffers) {
+        framebuffers.push_back(entry.second);
+    }
+    VkDevice device = s_device.device;
+    scg::deferDeletion(s_deletion, frame, [device, images, memory, framebuffers]() {
+        for (auto framebuffer : framebuffers) {
+            vkDestroyFramebuffer(device, framebuffer, nullptr);
+        }
+        for (auto& transient : images) {
+            vkDestroyImageView(device, transient.view, nullptr);
+            vkDestroyImage(device, transient.image, nullptr);
+        }
+        for (auto block : memory) {
+            vkFreeMemory(device, block, nullptr);
+        }
+    });
+    s_graph.framebuffers.clear();
+    s_graph.transientImages.clear();
+    s_graph.transientMemory.clear();
+    s_graph.transientSignature.clear();
+}
+
+void scg::destroyRenderGraph(scg::sDevice& s_device, scg::sRenderGraph& s_graph) {
+    scg::invalidateRenderGraph(s_device, s_graph);
+    for (auto& entry : s_graph.renderPasses) {
+        vkDestroyRenderPass(s_device.device, entry.second, nullptr);
+    }
+    s_graph.renderPasses.clear();
+}
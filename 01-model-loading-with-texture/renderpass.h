@@ -5,28 +5,36 @@
 
 #include <stdexcept>
 #include <array>
+#include <vector>
 
 #include "container.h"
+#include "zones.h"
 #include "format.h"
 
 namespace scg {
     void createRenderPass(scg::sDevice& s_device, scg::sSwapchain& s_swapchain, scg::sRenderPass& s_rpass);
 }
 
+// pipelines are built against this pass, the render graph creates compatible ones for drawing
 void scg::createRenderPass(scg::sDevice& s_device, scg::sSwapchain& s_swapchain, scg::sRenderPass& s_rpass) {
+    SCG_FUNCTION_ZONE();
+    bool multisampled = s_rpass.samples != VK_SAMPLE_COUNT_1_BIT;
+
     VkAttachmentDescription colorAttachment{};
     colorAttachment.format = s_swapchain.swapchainImageFormat;
-    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment.samples = s_rpass.samples;
     colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttachment.finalLayout = s_swapchain.finalLayout;
+
+    s_rpass.depthFormat = scg::findDepthFormat(s_device);
 
     VkAttachmentDescription depthAttachment{};
-    depthAttachment.format = scg::findDepthFormat(s_device);
-    depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthAttachment.format = s_rpass.depthFormat;
+    depthAttachment.samples = s_rpass.samples;
     depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
@@ -34,6 +42,11 @@ void scg::createRenderPass(scg::sDevice& s_device, scg::sSwapchain& s_swapchain,
     depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
+    // multisampled color is resolved into a single sample image of the same format
+    VkAttachmentDescription resolveAttachment = colorAttachment;
+    resolveAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    resolveAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+
     VkAttachmentReference colorAttachmentRef{};
     colorAttachmentRef.attachment = 0;
     colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
@@ -48,6 +61,13 @@ void scg::createRenderPass(scg::sDevice& s_device, scg::sSwapchain& s_swapchain,
     subpass.pColorAttachments = &colorAttachmentRef;
     subpass.pDepthStencilAttachment = &depthAttachmentRef;
 
+    VkAttachmentReference resolveAttachmentRef{};
+    resolveAttachmentRef.attachment = 2;
+    resolveAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    if (multisampled) {
+        subpass.pResolveAttachments = &resolveAttachmentRef;
+    }
+
     VkSubpassDependency dependency{};
     dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
     dependency.dstSubpass = 0;
@@ -56,7 +76,10 @@ void scg::createRenderPass(scg::sDevice& s_device, scg::sSwapchain& s_swapchain,
     dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
     dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
-    std::array<VkAttachmentDescription, 2> attachments = {colorAttachment, depthAttachment};
+    std::vector<VkAttachmentDescription> attachments = {colorAttachment, depthAttachment};
+    if (multisampled) {
+        attachments.push_back(resolveAttachment);
+    }
     VkRenderPassCreateInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
     renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
@@ -70,4 +93,44 @@ void scg::createRenderPass(scg::sDevice& s_device, scg::sSwapchain& s_swapchain,
         throw std::runtime_error("failed to create render pass!");
     }
 
+    // same depth attachment without color, only its format and sample count matter for compatibility
+    VkAttachmentReference depthOnlyRef{};
+    depthOnlyRef.attachment = 0;
+    depthOnlyRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription depthSubpass{};
+    depthSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    depthSubpass.colorAttachmentCount = 0;
+    depthSubpass.pDepthStencilAttachment = &depthOnlyRef;
+
+    VkRenderPassCreateInfo depthPassInfo{};
+    depthPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    depthPassInfo.attachmentCount = 1;
+    depthPassInfo.pAttachments = &depthAttachment;
+    depthPassInfo.subpassCount = 1;
+    depthPassInfo.pSubpasses = &depthSubpass;
+
+    if (vkCreateRenderPass(s_device.device, &depthPassInfo, nullptr, &(s_rpass.depthRenderPass)) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create depth render pass!");
+    }
+
+    VkAttachmentReference colorOnlyRef{};
+    colorOnlyRef.attachment = 0;
+    colorOnlyRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription colorSubpass{};
+    colorSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    colorSubpass.colorAttachmentCount = 1;
+    colorSubpass.pColorAttachments = &colorOnlyRef;
+
+    VkRenderPassCreateInfo colorPassInfo{};
+    colorPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    colorPassInfo.attachmentCount = 1;
+    colorPassInfo.pAttachments = &resolveAttachment;
+    colorPassInfo.subpassCount = 1;
+    colorPassInfo.pSubpasses = &colorSubpass;
+
+    if (vkCreateRenderPass(s_device.device, &colorPassInfo, nullptr, &(s_rpass.colorRenderPass)) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create color render pass!");
+    }
 }
@@ -0,0 +1,96 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+
+#include "container.h"
+#include "zones.h"
+
+// A resize storm flips the window between its full and a smaller size every few frames and times
+// every frame. Frames that recreated the swapchain are hitches, the rest are the steady state the
+// hitches are compared against. The time spent in the recreation itself is reported as well, which
+// with --wait-idle-on-resize includes draining the GPU.
+namespace scg {
+    void createResizeStorm(scg::sInstance& s_inst, scg::sResizeStorm& s_storm);
+    void noteSwapchainRecreate(scg::sResizeStorm& s_storm, double ms);
+    void stepResizeStorm(scg::sInstance& s_inst, scg::sResizeStorm& s_storm);
+    void reportResizeStorm(scg::sResizeStorm& s_storm);
+}
+
+void scg::createResizeStorm(scg::sInstance& s_inst, scg::sResizeStorm& s_storm) {
+    SCG_FUNCTION_ZONE();
+    // the storm resizes a window, headless there is none
+    s_storm.enabled = s_inst.resizeStormCount != 0 && !s_inst.headless;
+    s_storm.remaining = s_inst.resizeStormCount;
+    s_storm.width = static_cast<int>(s_inst.width);
+    s_storm.height = static_cast<int>(s_inst.height);
+    s_storm.lastFrame = std::chrono::steady_clock::now();
+}
+
+void scg::noteSwapchainRecreate(scg::sResizeStorm& s_storm, double ms) {
+    s_storm.recreated = true;
+    s_storm.recreateMs = ms;
+}
+
+// called once per frame, the window size set here is picked up by the framebuffer size callback
+void scg::stepResizeStorm(scg::sInstance& s_inst, scg::sResizeStorm& s_storm) {
+    if (!s_storm.enabled) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    double frameMs = std::chrono::duration<double, std::milli>(now - s_storm.lastFrame).count();
+    s_storm.lastFrame = now;
+
+    if (s_storm.recreated) {
+        s_storm.hitchSumMs += frameMs;
+        s_storm.hitchMaxMs = std::max(s_storm.hitchMaxMs, frameMs);
+        s_storm.recreateSumMs += s_storm.recreateMs;
+        s_storm.recreateMaxMs = std::max(s_storm.recreateMaxMs, s_storm.recreateMs);
+        s_storm.hitches++;
+        s_storm.recreated = false;
+    } else {
+        s_storm.steadySumMs += frameMs;
+        s_storm.steadyMaxMs = std::max(s_storm.steadyMaxMs, frameMs);
+        s_storm.steadyFrames++;
+    }
+
+    s_storm.framesSinceResize++;
+    if (s_storm.framesSinceResize < s_storm.framesBetween) {
+        return;
+    }
+    s_storm.framesSinceResize = 0;
+
+    if (s_storm.remaining == 0) {
+        scg::reportResizeStorm(s_storm);
+        s_storm.enabled = false;
+        glfwSetWindowShouldClose(s_inst.window, GLFW_TRUE);
+        return;
+    }
+    s_storm.remaining--;
+
+    s_storm.shrunk = !s_storm.shrunk;
+    if (s_storm.shrunk) {
+        glfwSetWindowSize(s_inst.window, s_storm.width * 3 / 4, s_storm.height * 3 / 4);
+    } else {
+        glfwSetWindowSize(s_inst.window, s_storm.width, s_storm.height);
+    }
+}
+
+void scg::reportResizeStorm(scg::sResizeStorm& s_storm) {
+    if (s_storm.steadyFrames != 0) {
+        std::cout << "resize storm: steady frames " << s_storm.steadySumMs / s_storm.steadyFrames << " ms average, " << s_storm.steadyMaxMs
+            << " ms max over " << s_storm.steadyFrames << " frames" << std::endl;
+    }
+    if (s_storm.hitches != 0) {
+        std::cout << "resize storm: resize frames " << s_storm.hitchSumMs / s_storm.hitches << " ms average, " << s_storm.hitchMaxMs
+            << " ms max over " << s_storm.hitches << " resizes, swapchain recreation " << s_storm.recreateSumMs / s_storm.hitches
+            << " ms average, " << s_storm.recreateMaxMs << " ms max" << std::endl;
+    } else {
+        std::cout << "resize storm: the swapchain was never recreated" << std::endl;
+    }
+}
@@ -0,0 +1,319 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <array>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#include "container.h"
+#include "zones.h"
+#include "shaderlibrary.h"
+#include "descriptorallocator.h"
+
+// The scene is rendered into the top left corner of a swapchain sized target and stretched onto
+// the swapchain image by a bilinear upscale pass. GPU time is measured with a timestamp pair per
+// frame, and the render scale follows the ratio of the budget to the measured time.
+namespace scg {
+    void createDynamicResolution(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sRenderPass& s_rpass, scg::sPipelineCache& s_pcache, scg::sShaderLibrary& s_shaderlib, scg::sDynamicResolution& s_dres);
+    void beginGpuFrame(VkCommandBuffer commandBuffer, scg::sDynamicResolution& s_dres, uint32_t frame);
+    void endGpuFrame(VkCommandBuffer commandBuffer, scg::sDynamicResolution& s_dres, uint32_t frame);
+    void submitGpuFrame(scg::sDynamicResolution& s_dres, uint32_t frame);
+    void updateDynamicResolution(scg::sDevice& s_device, scg::sDynamicResolution& s_dres, uint32_t frame);
+    VkExtent2D getRenderExtent(scg::sDynamicResolution& s_dres, VkExtent2D extent);
+    void recordUpscale(VkCommandBuffer commandBuffer, scg::sDevice& s_device, scg::sDescriptor& s_descriptor, scg::sDynamicResolution& s_dres, uint32_t frame, uint32_t image, VkImageView scene, VkExtent2D renderExtent, VkExtent2D extent);
+    void destroyDynamicResolution(scg::sDevice& s_device, scg::sDynamicResolution& s_dres);
+}
+
+void scg::createDynamicResolution(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sRenderPass& s_rpass, scg::sPipelineCache& s_pcache, scg::sShaderLibrary& s_shaderlib, scg::sDynamicResolution& s_dres) {
+    SCG_FUNCTION_ZONE();
+    s_dres.budgetMs = s_inst.gpuBudgetMs;
+    s_dres.minScale = std::clamp(s_inst.minResolutionScale, 0.1f, 1.0f);
+    s_dres.maxScale = std::clamp(s_inst.maxResolutionScale, s_dres.minScale, 1.0f);
+    s_dres.scale = s_dres.maxScale;
+    s_dres.lastReport = std::chrono::steady_clock::now();
+
+    const VkPhysicalDeviceProperties& properties = s_device.caps.properties;
+    if (!properties.limits.timestampComputeAndGraphics) {
+        std::cout << "timestamps unsupported, dynamic resolution disabled" << std::endl;
+        return;
+    }
+    s_dres.timestampPeriod = properties.limits.timestampPeriod;
+    // the counter wraps at the graphics family's valid bits
+    uint32_t validBits = s_device.caps.queueFamilies[s_device.caps.queueIndices.graphicsFamily.value()].timestampValidBits;
+    s_dres.timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = 2 * static_cast<uint32_t>(s_inst.maxFramesInFlight);
+
+    if (vkCreateQueryPool(s_device.device, &queryPoolInfo, nullptr, &(s_dres.queryPool)) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create timestamp query pool!");
+    }
+    s_dres.queryPending.assign(s_inst.maxFramesInFlight, false);
+
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.anisotropyEnable = VK_FALSE;
+    samplerInfo.maxAnisotropy = 1.0f;
+    samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+    samplerInfo.unnormalizedCoordinates = VK_FALSE;
+    samplerInfo.compareEnable = VK_FALSE;
+    samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+
+    if (vkCreateSampler(s_device.device, &samplerInfo, nullptr, &(s_dres.sampler)) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create upscale sampler!");
+    }
+
+    VkDescriptorSetLayoutBinding samplerLayoutBinding{};
+    samplerLayoutBinding.binding = 0;
+    samplerLayoutBinding.descriptorCount = 1;
+    samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &samplerLayoutBinding;
+
+    if (vkCreateDescriptorSetLayout(s_device.device, &layoutInfo, nullptr, &(s_dres.descriptorSetLayout)) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create upscale descriptor set layout!");
+    }
+
+    VkDescriptorUpdateTemplateEntry entry{};
+    entry.dstBinding = 0;
+    entry.descriptorCount = 1;
+    entry.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    entry.offset = 0;
+    entry.stride = sizeof(VkDescriptorImageInfo);
+    s_dres.updateTemplate = scg::createDescriptorUpdateTemplate(s_device, s_dres.descriptorSetLayout, {entry});
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = 4 * sizeof(float);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &(s_dres.descriptorSetLayout);
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(s_device.device, &pipelineLayoutInfo, nullptr, &(s_dres.pipelineLayout)) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create upscale pipeline layout!");
+    }
+
+    // the modules stay owned by the shader library
+    uint64_t vertHash = scg::acquireShaderModule(s_device, s_shaderlib, "shaders/upscale_vert.spv");
+    uint64_t fragHash = scg::acquireShaderModule(s_device, s_shaderlib, "shaders/upscale_frag.spv");
+
+    std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages{};
+    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderStages[0].module = s_shaderlib.modules[vertHash].module;
+    shaderStages[0].pName = "main";
+    shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shaderStages[1].module = s_shaderlib.modules[fragHash].module;
+    shaderStages[1].pName = "main";
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.depthClampEnable = VK_FALSE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = VK_CULL_MODE_NONE;
+    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterizer.depthBiasEnable = VK_FALSE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachment.blendEnable = VK_FALSE;
+
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.logicOpEnable = VK_FALSE;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &colorBlendAttachment;
+
+    std::vector<VkDynamicState> dynamicStates = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR
+    };
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+    dynamicState.pDynamicStates = dynamicStates.data();
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+    pipelineInfo.pStages = shaderStages.data();
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicState;
+    pipelineInfo.layout = s_dres.pipelineLayout;
+    pipelineInfo.renderPass = s_rpass.colorRenderPass;
+    pipelineInfo.subpass = 0;
+
+    if (vkCreateGraphicsPipelines(s_device.device, s_pcache.pipelineCache, 1, &pipelineInfo, nullptr, &(s_dres.pipeline)) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create upscale pipeline!");
+    }
+
+    s_dres.enabled = true;
+    std::cout << "dynamic resolution targeting " << s_dres.budgetMs << " ms of GPU time, scale " << s_dres.minScale << " to " << s_dres.maxScale << std::endl;
+}
+
+void scg::beginGpuFrame(VkCommandBuffer commandBuffer, scg::sDynamicResolution& s_dres, uint32_t frame) {
+    if (s_dres.queryPool == VK_NULL_HANDLE) {
+        return;
+    }
+    vkCmdResetQueryPool(commandBuffer, s_dres.queryPool, 2 * frame, 2);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, s_dres.queryPool, 2 * frame);
+}
+
+void scg::endGpuFrame(VkCommandBuffer commandBuffer, scg::sDynamicResolution& s_dres, uint32_t frame) {
+    if (s_dres.queryPool == VK_NULL_HANDLE) {
+        return;
+    }
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, s_dres.queryPool, 2 * frame + 1);
+}
+
+// cached command buffers write the timestamps without being recorded again, so this goes with the submit
+void scg::submitGpuFrame(scg::sDynamicResolution& s_dres, uint32_t frame) {
+    if (s_dres.queryPool == VK_NULL_HANDLE) {
+        return;
+    }
+    s_dres.queryPending[frame] = true;
+}
+
+// Called once the frame has completed, so its timestamps are final. Pixel count, and with
+// it roughly the GPU time, goes with the square of the scale. The scale drops quickly when over
+// budget and recovers slowly, and small errors are ignored so it does not hunt.
+void scg::updateDynamicResolution(scg::sDevice& s_device, scg::sDynamicResolution& s_dres, uint32_t frame) {
+    if (!s_dres.enabled || !s_dres.queryPending[frame]) {
+        return;
+    }
+
+    std::array<uint64_t, 2> timestamps{};
+    if (vkGetQueryPoolResults(s_device.device, s_dres.queryPool, 2 * frame, 2, sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+        return;
+    }
+    s_dres.queryPending[frame] = false;
+
+    s_dres.gpuMs = static_cast<float>((timestamps[1] - timestamps[0]) & s_dres.timestampMask) * s_dres.timestampPeriod / 1000000.0f;
+    s_dres.smoothedGpuMs = s_dres.smoothedGpuMs == 0.0f ? s_dres.gpuMs : 0.9f * s_dres.smoothedGpuMs + 0.1f * s_dres.gpuMs;
+
+    float ratio = s_dres.budgetMs / std::max(s_dres.smoothedGpuMs, 0.01f);
+    if (ratio < 0.95f || ratio > 1.05f) {
+        float target = s_dres.scale * std::sqrt(ratio);
+        float step = std::clamp(target - s_dres.scale, -0.05f, 0.01f);
+        s_dres.scale = std::clamp(s_dres.scale + step, s_dres.minScale, s_dres.maxScale);
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - s_dres.lastReport >= std::chrono::seconds(1)) {
+        s_dres.lastReport = now;
+        std::cout << "gpu " << s_dres.smoothedGpuMs << " ms (budget " << s_dres.budgetMs << " ms), render scale " << s_dres.scale << std::endl;
+    }
+}
+
+// rounded to multiples of 8 so small scale changes do not shift the image every frame
+VkExtent2D scg::getRenderExtent(scg::sDynamicResolution& s_dres, VkExtent2D extent) {
+    if (!s_dres.enabled) {
+        return extent;
+    }
+    auto scaled = [&](uint32_t size) {
+        uint32_t rounded = static_cast<uint32_t>(std::lround(size * s_dres.scale / 8.0f)) * 8;
+        return std::clamp(rounded, std::min(8u, size), size);
+    };
+    return {scaled(extent.width), scaled(extent.height)};
+}
+
+// The set comes from the transient chain of the command buffer being recorded, a fresh set per
+// recording, so a set a cached or in flight command buffer still binds is never rewritten.
+void scg::recordUpscale(VkCommandBuffer commandBuffer, scg::sDevice& s_device, scg::sDescriptor& s_descriptor, scg::sDynamicResolution& s_dres, uint32_t frame, uint32_t image, VkImageView scene, VkExtent2D renderExtent, VkExtent2D extent) {
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfo.imageView = scene;
+    imageInfo.sampler = s_dres.sampler;
+    VkDescriptorSet descriptorSet = scg::allocateTransientDescriptorSet(s_device, s_descriptor, frame, image, s_dres.descriptorSetLayout, s_dres.updateTemplate, &imageInfo);
+
+    std::array<float, 4> constants = {
+        renderExtent.width / (float) extent.width,
+        renderExtent.height / (float) extent.height,
+        (renderExtent.width - 0.5f) / (float) extent.width,
+        (renderExtent.height - 0.5f) / (float) extent.height
+    };
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, s_dres.pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, s_dres.pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, s_dres.pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(constants), constants.data());
+
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = (float) extent.width;
+    viewport.height = (float) extent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = extent;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+}
+
+void scg::destroyDynamicResolution(scg::sDevice& s_device, scg::sDynamicResolution& s_dres) {
+    if (s_dres.queryPool == VK_NULL_HANDLE) {
+        return;
+    }
+    vkDestroyQueryPool(s_device.device, s_dres.queryPool, nullptr);
+    if (!s_dres.enabled) {
+        return;
+    }
+    vkDestroyPipeline(s_device.device, s_dres.pipeline, nullptr);
+    vkDestroyPipelineLayout(s_device.device, s_dres.pipelineLayout, nullptr);
+    vkDestroyDescriptorUpdateTemplate(s_device.device, s_dres.updateTemplate, nullptr);
+    vkDestroyDescriptorSetLayout(s_device.device, s_dres.descriptorSetLayout, nullptr);
+    vkDestroySampler(s_device.device, s_dres.sampler, nullptr);
+}
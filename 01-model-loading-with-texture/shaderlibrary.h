@@ -0,0 +1,463 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <iostream>
+#include <stdexcept>
+#include <filesystem>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "container.h"
+#include "zones.h"
+#include "deletion.h"
+#include "graphicspipeline.h"
+#include "pipelinemanager.h"
+
+// SPIR-V modules mapped straight from disk, deduplicated by content hash and reflected for their
+// descriptor and push constant layout. The compiled .spv files are polled for changes; a changed
+// shader rebuilds the default pipeline on a background thread and is swapped in between frames.
+namespace scg {
+    void createShaderLibrary(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sDescriptor& s_descriptor, scg::sShaderLibrary& s_shaderlib, scg::sGraphicsPipeline& s_gpipeline);
+    uint64_t hashBytes(const void* data, size_t size);
+    scg::sShaderReflection reflectSpirv(const uint32_t* words, size_t wordCount);
+    uint64_t acquireShaderModule(scg::sDevice& s_device, scg::sShaderLibrary& s_shaderlib, const std::string& path);
+    void releaseShaderModule(scg::sShaderLibrary& s_shaderlib, scg::sPipelineManager& s_pmanager, uint64_t hash);
+    bool checkReflectionCompatible(const scg::sShaderReflection& current, const scg::sShaderReflection& reloaded);
+    void pollShaderChanges(scg::sDevice& s_device, scg::sRenderPass& s_rpass, scg::sPipelineCache& s_pcache, scg::sGraphicsPipeline& s_gpipeline, scg::sPipelineManager& s_pmanager, scg::sShaderLibrary& s_shaderlib);
+    void destroyStagedPipelines(scg::sDevice& s_device, scg::sShaderLibrary& s_shaderlib);
+    void applyShaderReload(scg::sDevice& s_device, scg::sGraphicsPipeline& s_gpipeline, scg::sPipelineManager& s_pmanager, scg::sShaderLibrary& s_shaderlib, scg::sDeletionQueue& s_deletion, uint64_t frame);
+    void destroyShaderLibrary(scg::sDevice& s_device, scg::sShaderLibrary& s_shaderlib);
+}
+
+void scg::createShaderLibrary(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sDescriptor& s_descriptor, scg::sShaderLibrary& s_shaderlib, scg::sGraphicsPipeline& s_gpipeline) {
+    SCG_FUNCTION_ZONE();
+    s_shaderlib.vertPath = s_descriptor.useBindless ? "shaders/bindless_vert.spv" : "shaders/vert.spv";
+    s_shaderlib.fragPath = s_descriptor.useBindless ? "shaders/bindless_frag.spv" : "shaders/frag.spv";
+    s_shaderlib.depthPath = "shaders/depth_vert.spv";
+    s_shaderlib.hotReload = s_inst.enableShaderHotReload;
+    s_shaderlib.lastPoll = std::chrono::steady_clock::now();
+
+    s_shaderlib.vertHash = scg::acquireShaderModule(s_device, s_shaderlib, s_shaderlib.vertPath);
+    s_shaderlib.fragHash = scg::acquireShaderModule(s_device, s_shaderlib, s_shaderlib.fragPath);
+    s_shaderlib.depthHash = scg::acquireShaderModule(s_device, s_shaderlib, s_shaderlib.depthPath);
+
+    s_gpipeline.vertShaderModule = s_shaderlib.modules[s_shaderlib.vertHash].module;
+    s_gpipeline.fragShaderModule = s_shaderlib.modules[s_shaderlib.fragHash].module;
+    s_gpipeline.depthShaderModule = s_shaderlib.modules[s_shaderlib.depthHash].module;
+}
+
+// FNV-1a, only used to tell SPIR-V blobs apart
+uint64_t scg::hashBytes(const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Walks the instruction stream once and records just enough of the type graph to describe the
+// resource variables. Struct sizes follow the Offset/ArrayStride decorations glslc emits.
+scg::sShaderReflection scg::reflectSpirv(const uint32_t* words, size_t wordCount) {
+    const uint32_t spirvMagic = 0x07230203;
+    if (wordCount < 5 || words[0] != spirvMagic) {
+        throw std::runtime_error("failed to reflect shader, not a SPIR-V module!");
+    }
+
+    struct sType {
+        uint32_t opcode{0};
+        std::vector<uint32_t> operands;
+    };
+    struct sVariable {
+        uint32_t pointerType;
+        uint32_t storageClass;
+    };
+
+    std::unordered_map<uint32_t, sType> types;
+    std::unordered_map<uint32_t, uint32_t> constants;
+    std::unordered_map<uint32_t, sVariable> variables;
+    std::unordered_map<uint32_t, uint32_t> descriptorSets;
+    std::unordered_map<uint32_t, uint32_t> bindings;
+    std::unordered_map<uint32_t, uint32_t> arrayStrides;
+    std::unordered_map<uint32_t, bool> bufferBlocks;
+    std::unordered_map<uint64_t, uint32_t> memberOffsets;
+
+    scg::sShaderReflection reflection{};
+
+    for (size_t i = 5; i < wordCount;) {
+        uint32_t opcode = words[i] & 0xffff;
+        uint32_t length = words[i] >> 16;
+        if (length == 0 || i + length > wordCount) {
+            throw std::runtime_error("failed to reflect shader, truncated instruction!");
+        }
+        const uint32_t* operands = words + i + 1;
+
+        switch (opcode) {
+            case 15: // OpEntryPoint
+                switch (operands[0]) {
+                    case 0: reflection.stage |= VK_SHADER_STAGE_VERTEX_BIT; break;
+                    case 1: reflection.stage |= VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT; break;
+                    case 2: reflection.stage |= VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT; break;
+                    case 3: reflection.stage |= VK_SHADER_STAGE_GEOMETRY_BIT; break;
+                    case 4: reflection.stage |= VK_SHADER_STAGE_FRAGMENT_BIT; break;
+                    case 5: reflection.stage |= VK_SHADER_STAGE_COMPUTE_BIT; break;
+                }
+                break;
+            case 71: // OpDecorate
+                if (operands[1] == 34) {
+                    descriptorSets[operands[0]] = operands[2];
+                } else if (operands[1] == 33) {
+                    bindings[operands[0]] = operands[2];
+                } else if (operands[1] == 6) {
+                    arrayStrides[operands[0]] = operands[2];
+                } else if (operands[1] == 3) {
+                    bufferBlocks[operands[0]] = true;
+                }
+                break;
+            case 72: // OpMemberDecorate
+                if (operands[2] == 35) {
+                    memberOffsets[(static_cast<uint64_t>(operands[0]) << 32) | operands[1]] = operands[3];
+                }
+                break;
+            case 43: // OpConstant
+                constants[operands[1]] = operands[2];
+                break;
+            case 59: // OpVariable
+                variables[operands[1]] = {operands[0], operands[2]};
+                break;
+            default:
+                // OpTypeInt .. OpTypePointer
+                if (opcode >= 21 && opcode <= 32) {
+                    sType type;
+                    type.opcode = opcode;
+                    type.operands.assign(operands + 1, operands + length - 1);
+                    types[operands[0]] = type;
+                }
+                break;
+        }
+
+        i += length;
+    }
+
+    std::function<uint32_t(uint32_t)> sizeOf = [&](uint32_t id) -> uint32_t {
+        const sType& type = types[id];
+        switch (type.opcode) {
+            case 21: // OpTypeInt
+            case 22: // OpTypeFloat
+                return type.operands[0] / 8;
+            case 23: // OpTypeVector
+                return sizeOf(type.operands[0]) * type.operands[1];
+            case 24: { // OpTypeMatrix, columns of three are padded to four
+                const sType& column = types[type.operands[0]];
+                uint32_t columnSize = sizeOf(type.operands[0]);
+                if (column.opcode == 23 && column.operands[1] == 3) {
+                    columnSize = sizeOf(column.operands[0]) * 4;
+                }
+                return columnSize * type.operands[1];
+            }
+            case 28: { // OpTypeArray
+                uint32_t stride = arrayStrides.count(id) ? arrayStrides[id] : sizeOf(type.operands[0]);
+                return stride * constants[type.operands[1]];
+            }
+            case 30: { // OpTypeStruct
+                uint32_t size = 0;
+                for (uint32_t m = 0; m < type.operands.size(); m++) {
+                    uint32_t offset = memberOffsets[(static_cast<uint64_t>(id) << 32) | m];
+                    size = std::max(size, offset + sizeOf(type.operands[m]));
+                }
+                return size;
+            }
+            default:
+                return 0;
+        }
+    };
+
+    for (const auto& [id, variable] : variables) {
+        const sType& pointer = types[variable.pointerType];
+        if (pointer.opcode != 32) {
+            continue;
+        }
+        uint32_t typeId = pointer.operands[1];
+
+        if (variable.storageClass == 9) { // PushConstant
+            reflection.pushConstantSize = std::max(reflection.pushConstantSize, sizeOf(typeId));
+            continue;
+        }
+        if (variable.storageClass != 0 && variable.storageClass != 2 && variable.storageClass != 12) {
+            continue;
+        }
+
+        scg::sReflectedBinding binding{};
+        binding.set = descriptorSets.count(id) ? descriptorSets[id] : 0;
+        binding.binding = bindings.count(id) ? bindings[id] : 0;
+        binding.descriptorCount = 1;
+
+        if (types[typeId].opcode == 28) {
+            binding.descriptorCount = constants[types[typeId].operands[1]];
+            typeId = types[typeId].operands[0];
+        } else if (types[typeId].opcode == 29) {
+            binding.descriptorCount = 0;
+            typeId = types[typeId].operands[0];
+        }
+
+        const sType& type = types[typeId];
+        if (type.opcode == 27) {
+            binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        } else if (type.opcode == 26) {
+            binding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+        } else if (type.opcode == 25) {
+            uint32_t dim = type.operands[1];
+            uint32_t sampled = type.operands[5];
+            if (dim == 6) {
+                binding.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+            } else if (dim == 5) {
+                binding.descriptorType = sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+            } else {
+                binding.descriptorType = sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+            }
+        } else if (variable.storageClass == 12 || bufferBlocks.count(typeId)) {
+            binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        } else {
+            binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        }
+
+        reflection.bindings.push_back(binding);
+    }
+
+    std::sort(reflection.bindings.begin(), reflection.bindings.end(), [](const scg::sReflectedBinding& a, const scg::sReflectedBinding& b) {
+        return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+    });
+
+    return reflection;
+}
+
+uint64_t scg::acquireShaderModule(scg::sDevice& s_device, scg::sShaderLibrary& s_shaderlib, const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("failed to open file " + path + "!");
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0 || info.st_size % sizeof(uint32_t) != 0) {
+        close(fd);
+        throw std::runtime_error("failed to read SPIR-V from " + path + "!");
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        throw std::runtime_error("failed to map file " + path + "!");
+    }
+
+    uint64_t hash = scg::hashBytes(mapped, size);
+
+    auto existing = s_shaderlib.modules.find(hash);
+    if (existing == s_shaderlib.modules.end()) {
+        scg::sShaderModule shader{};
+        try {
+            shader.reflection = scg::reflectSpirv(static_cast<const uint32_t*>(mapped), size / sizeof(uint32_t));
+        } catch (...) {
+            munmap(mapped, size);
+            throw;
+        }
+
+        VkShaderModuleCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        createInfo.codeSize = size;
+        createInfo.pCode = static_cast<const uint32_t*>(mapped);
+
+        VkResult result = vkCreateShaderModule(s_device.device, &createInfo, nullptr, &(shader.module));
+        munmap(mapped, size);
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shader module!");
+        }
+
+        std::cout << path << ": " << shader.reflection.bindings.size() << " descriptor bindings, " << shader.reflection.pushConstantSize << " bytes of push constants" << std::endl;
+        existing = s_shaderlib.modules.emplace(hash, shader).first;
+    } else {
+        munmap(mapped, size);
+    }
+    existing->second.references++;
+
+    std::error_code error;
+    auto writeTime = std::filesystem::last_write_time(path, error);
+    s_shaderlib.sources[path] = {hash, writeTime, writeTime};
+
+    return hash;
+}
+
+// pipeline workers may still be compiling from the module, so it waits on their builds
+void scg::releaseShaderModule(scg::sShaderLibrary& s_shaderlib, scg::sPipelineManager& s_pmanager, uint64_t hash) {
+    auto it = s_shaderlib.modules.find(hash);
+    if (it == s_shaderlib.modules.end() || --(it->second.references) > 0) {
+        return;
+    }
+
+    scg::retireShaderModule(s_pmanager, it->second.module);
+    s_shaderlib.modules.erase(it);
+}
+
+// the pipeline layout is fixed for the lifetime of the app, so a reload may not change it
+bool scg::checkReflectionCompatible(const scg::sShaderReflection& current, const scg::sShaderReflection& reloaded) {
+    return current.stage == reloaded.stage && current.bindings == reloaded.bindings && current.pushConstantSize == reloaded.pushConstantSize;
+}
+
+void scg::pollShaderChanges(scg::sDevice& s_device, scg::sRenderPass& s_rpass, scg::sPipelineCache& s_pcache, scg::sGraphicsPipeline& s_gpipeline, scg::sPipelineManager& s_pmanager, scg::sShaderLibrary& s_shaderlib) {
+    if (!s_shaderlib.hotReload || s_shaderlib.reloading) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - s_shaderlib.lastPoll < std::chrono::milliseconds(250)) {
+        return;
+    }
+    s_shaderlib.lastPoll = now;
+
+    bool changed = false;
+    for (const std::string& path : {s_shaderlib.vertPath, s_shaderlib.fragPath, s_shaderlib.depthPath}) {
+        auto& source = s_shaderlib.sources[path];
+        std::error_code error;
+        auto writeTime = std::filesystem::last_write_time(path, error);
+        if (error || writeTime == source.writeTime) {
+            continue;
+        }
+        if (writeTime != source.pendingWriteTime) {
+            source.pendingWriteTime = writeTime;
+            continue;
+        }
+        // consumed even if the file turns out to be broken, the next write retries
+        source.writeTime = writeTime;
+        changed = true;
+    }
+    if (!changed) {
+        return;
+    }
+
+    // all three are reloaded together, the prepass must stay in step with the vertex shader
+    std::vector<std::string> paths = {s_shaderlib.vertPath, s_shaderlib.fragPath, s_shaderlib.depthPath};
+    std::vector<uint64_t> current = {s_shaderlib.vertHash, s_shaderlib.fragHash, s_shaderlib.depthHash};
+    std::vector<uint64_t> hashes;
+    try {
+        for (const std::string& path : paths) {
+            hashes.push_back(scg::acquireShaderModule(s_device, s_shaderlib, path));
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "shader reload skipped: " << e.what() << std::endl;
+        for (uint64_t hash : hashes) {
+            scg::releaseShaderModule(s_shaderlib, s_pmanager, hash);
+        }
+        return;
+    }
+
+    bool compatible = true;
+    for (size_t i = 0; i < hashes.size(); i++) {
+        compatible = compatible && scg::checkReflectionCompatible(s_shaderlib.modules[current[i]].reflection, s_shaderlib.modules[hashes[i]].reflection);
+    }
+    bool identical = hashes == current;
+
+    if (identical || !compatible) {
+        if (!compatible) {
+            std::cerr << "shader reload skipped: descriptor or push constant layout changed, restart to pick it up" << std::endl;
+        }
+        for (uint64_t hash : hashes) {
+            scg::releaseShaderModule(s_shaderlib, s_pmanager, hash);
+        }
+        return;
+    }
+
+    s_shaderlib.stagedVertHash = hashes[0];
+    s_shaderlib.stagedFragHash = hashes[1];
+    s_shaderlib.stagedDepthHash = hashes[2];
+    s_shaderlib.reloading = true;
+    s_shaderlib.reloadDone = false;
+    s_shaderlib.reloadFailed = false;
+
+    // the staged copy shares the pipeline layout and only swaps the shader modules
+    s_shaderlib.staged = s_gpipeline;
+    s_shaderlib.staged.vertShaderModule = s_shaderlib.modules[hashes[0]].module;
+    s_shaderlib.staged.fragShaderModule = s_shaderlib.modules[hashes[1]].module;
+    s_shaderlib.staged.depthShaderModule = s_shaderlib.modules[hashes[2]].module;
+    s_shaderlib.staged.graphicsPipeline = VK_NULL_HANDLE;
+    s_shaderlib.staged.depthPipelines = {};
+
+    std::cout << "shaders changed, rebuilding pipelines in the background" << std::endl;
+    s_shaderlib.reloadThread = std::thread([&s_device, &s_rpass, &s_pcache, &s_shaderlib]() {
+        scg::sGraphicsPipeline& staged = s_shaderlib.staged;
+        try {
+            staged.graphicsPipeline = scg::buildGraphicsPipeline(s_device, s_rpass, s_pcache, staged, staged.defaultKey, 0, {}, 0);
+            scg::createDepthPipelines(s_device, s_rpass, s_pcache, staged);
+        } catch (const std::exception& e) {
+            std::cerr << "shader reload failed: " << e.what() << std::endl;
+            scg::destroyStagedPipelines(s_device, s_shaderlib);
+            s_shaderlib.reloadFailed = true;
+        }
+        s_shaderlib.reloadDone = true;
+    });
+}
+
+// whatever the reload thread got to build before it failed or the app shut down
+void scg::destroyStagedPipelines(scg::sDevice& s_device, scg::sShaderLibrary& s_shaderlib) {
+    vkDestroyPipeline(s_device.device, s_shaderlib.staged.graphicsPipeline, nullptr);
+    for (auto pipeline : s_shaderlib.staged.depthPipelines) {
+        vkDestroyPipeline(s_device.device, pipeline, nullptr);
+    }
+    s_shaderlib.staged.graphicsPipeline = VK_NULL_HANDLE;
+    s_shaderlib.staged.depthPipelines = {};
+}
+
+void scg::applyShaderReload(scg::sDevice& s_device, scg::sGraphicsPipeline& s_gpipeline, scg::sPipelineManager& s_pmanager, scg::sShaderLibrary& s_shaderlib, scg::sDeletionQueue& s_deletion, uint64_t frame) {
+    if (!s_shaderlib.reloading || !s_shaderlib.reloadDone) {
+        return;
+    }
+    s_shaderlib.reloadThread.join();
+    s_shaderlib.reloading = false;
+
+    uint64_t retiredVertHash = s_shaderlib.stagedVertHash;
+    uint64_t retiredFragHash = s_shaderlib.stagedFragHash;
+    uint64_t retiredDepthHash = s_shaderlib.stagedDepthHash;
+
+    if (!s_shaderlib.reloadFailed) {
+        scg::replaceDefaultPipeline(s_device, s_gpipeline, s_pmanager, s_deletion, frame, s_shaderlib.staged);
+
+        retiredVertHash = s_shaderlib.vertHash;
+        retiredFragHash = s_shaderlib.fragHash;
+        retiredDepthHash = s_shaderlib.depthHash;
+        s_shaderlib.vertHash = s_shaderlib.stagedVertHash;
+        s_shaderlib.fragHash = s_shaderlib.stagedFragHash;
+        s_shaderlib.depthHash = s_shaderlib.stagedDepthHash;
+        std::cout << "swapped in reloaded shaders" << std::endl;
+    }
+
+    scg::releaseShaderModule(s_shaderlib, s_pmanager, retiredVertHash);
+    scg::releaseShaderModule(s_shaderlib, s_pmanager, retiredFragHash);
+    scg::releaseShaderModule(s_shaderlib, s_pmanager, retiredDepthHash);
+}
+
+void scg::destroyShaderLibrary(scg::sDevice& s_device, scg::sShaderLibrary& s_shaderlib) {
+    if (s_shaderlib.reloadThread.joinable()) {
+        s_shaderlib.reloadThread.join();
+        if (s_shaderlib.reloading && !s_shaderlib.reloadFailed) {
+            scg::destroyStagedPipelines(s_device, s_shaderlib);
+        }
+    }
+
+    for (auto& [hash, shader] : s_shaderlib.modules) {
+        vkDestroyShaderModule(s_device.device, shader.module, nullptr);
+    }
+    s_shaderlib.modules.clear();
+    s_shaderlib.sources.clear();
+}
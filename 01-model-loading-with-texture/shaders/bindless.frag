@@ -0,0 +1,32 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+struct Material {
+    vec4 baseColor;
+    uint textureIndex;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer MaterialBuffer {
+    Material materials[];
+};
+
+layout(set = 1, binding = 1) uniform sampler2D textures[];
+
+// specialized per pipeline variant by the pipeline manager
+layout(constant_id = 0) const bool ALPHA_TEST = false;
+layout(constant_id = 1) const float ALPHA_CUTOFF = 0.5;
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) flat in uint fragMaterialIndex;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    Material material = materials[fragMaterialIndex];
+    vec4 color = material.baseColor * texture(textures[nonuniformEXT(material.textureIndex)], fragTexCoord);
+    if (ALPHA_TEST && color.a < ALPHA_CUTOFF) {
+        discard;
+    }
+    outColor = color;
+}
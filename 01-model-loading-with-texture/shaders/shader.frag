@@ -2,11 +2,19 @@
 
 layout(binding = 1) uniform sampler2D texSampler;
 
+// specialized per pipeline variant by the pipeline manager
+layout(constant_id = 0) const bool ALPHA_TEST = false;
+layout(constant_id = 1) const float ALPHA_CUTOFF = 0.5;
+
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = texture(texSampler, fragTexCoord);
+    vec4 color = texture(texSampler, fragTexCoord);
+    if (ALPHA_TEST && color.a < ALPHA_CUTOFF) {
+        discard;
+    }
+    outColor = color;
 }
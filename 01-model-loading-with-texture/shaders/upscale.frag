@@ -0,0 +1,17 @@
+#version 450
+
+layout(binding = 0) uniform sampler2D scene;
+
+// the scene fills only the top left of its image, uvClamp keeps the filter off the unused part
+layout(push_constant) uniform Upscale {
+    vec2 uvScale;
+    vec2 uvClamp;
+} upscale;
+
+layout(location = 0) in vec2 fragTexCoord;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    outColor = texture(scene, min(fragTexCoord * upscale.uvScale, upscale.uvClamp));
+}
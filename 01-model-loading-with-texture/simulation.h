@@ -0,0 +1,105 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <iostream>
+
+#include "container.h"
+#include "zones.h"
+
+// The scene update runs on its own thread at a fixed tick rate and publishes every finished state
+// through a triple buffer. The render thread takes whatever state is newest when it builds a
+// frame, so a slow tick only makes the motion stutter and never holds back presentation, and a
+// slow frame never holds back the simulation.
+namespace scg {
+    void simulate(scg::sSimulationState& state, float time);
+    void startSimulation(scg::sInstance& s_inst, scg::sSimulation& s_sim);
+    void stopSimulation(scg::sSimulation& s_sim);
+    void simulationWorker(scg::sSimulation& s_sim);
+    void publishState(scg::sTripleBuffer& s_triple);
+    const scg::sSimulationState& acquireLatestState(scg::sTripleBuffer& s_triple);
+}
+
+void scg::simulate(scg::sSimulationState& state, float time) {
+    state.time = time;
+    state.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    state.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+}
+
+void scg::startSimulation(scg::sInstance& s_inst, scg::sSimulation& s_sim) {
+    SCG_FUNCTION_ZONE();
+    s_sim.enabled = s_inst.enableUpdateThread;
+    if (!s_sim.enabled) {
+        return;
+    }
+    s_sim.tickRate = std::max(s_inst.updateRate, 1.0f);
+    s_sim.costMs = s_inst.simulationCostMs;
+    s_sim.startTime = std::chrono::steady_clock::now();
+
+    // every slot starts out valid, so the renderer has a state before the first tick lands
+    for (auto& slot : s_sim.buffer.slots) {
+        scg::simulate(slot, 0.0f);
+        slot.tick = 0;
+    }
+
+    s_sim.thread = std::thread(scg::simulationWorker, std::ref(s_sim));
+    std::cout << "started the update thread at " << s_sim.tickRate << " ticks per second" << std::endl;
+}
+
+void scg::stopSimulation(scg::sSimulation& s_sim) {
+    if (!s_sim.enabled) {
+        return;
+    }
+    s_sim.stopping = true;
+    s_sim.thread.join();
+}
+
+// ticks are scheduled against the start time, so a late tick is followed by an early one instead
+// of the whole simulation drifting
+void scg::simulationWorker(scg::sSimulation& s_sim) {
+    auto tickLength = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / s_sim.tickRate));
+    uint64_t tick = 0;
+    scg::nameZoneThread("update thread");
+
+    while (!s_sim.stopping) {
+        tick++;
+        auto tickTime = s_sim.startTime + tickLength * tick;
+        std::this_thread::sleep_until(tickTime);
+
+        SCG_ZONE("tick");
+        scg::sSimulationState& state = s_sim.buffer.slots[s_sim.buffer.back];
+        scg::simulate(state, std::chrono::duration<float>(tickTime - s_sim.startTime).count());
+        state.tick = tick;
+
+        // stands in for the game logic, physics and animation a real update would do
+        auto busyUntil = std::chrono::steady_clock::now() + std::chrono::duration<double, std::milli>(s_sim.costMs);
+        while (std::chrono::steady_clock::now() < busyUntil) {
+        }
+
+        scg::publishState(s_sim.buffer);
+    }
+}
+
+// writer side, the filled back slot becomes the middle one and the old middle slot is reused
+void scg::publishState(scg::sTripleBuffer& s_triple) {
+    uint32_t previous = s_triple.middle.exchange(s_triple.back | 4, std::memory_order_acq_rel);
+    s_triple.back = previous & 3;
+}
+
+// reader side, the returned state stays untouched by the writer until the next call
+const scg::sSimulationState& scg::acquireLatestState(scg::sTripleBuffer& s_triple) {
+    if (s_triple.middle.load(std::memory_order_acquire) & 4) {
+        uint32_t previous = s_triple.middle.exchange(s_triple.front, std::memory_order_acq_rel);
+        s_triple.front = previous & 3;
+    }
+    return s_triple.slots[s_triple.front];
+}
@@ -5,29 +5,42 @@
 
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <iostream>
 
 #include "helper.h"
 #include "container.h"
+#include "zones.h"
+#include "deletion.h"
 //#include "instance.h"
 //#include "device.h"
 
 namespace scg {
     void createSwapchain(sInstance& s_inst, sDevice& s_device, scg::sSwapchain& s_swapchain);
     VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
-    VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes);
+    VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes, VkPresentModeKHR preferred);
+    const char* presentModeName(VkPresentModeKHR presentMode);
     VkExtent2D chooseSwapExtent(sInstance& s_inst, const VkSurfaceCapabilitiesKHR& capabilities);
     VkImageView createImageView(scg::sDevice& s_device, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
     void createImageViews(scg::sDevice& s_device, scg::sSwapchain& s_swapchain);
+    void retireSwapchain(scg::sDevice& s_device, const scg::sSwapchain& s_old, scg::sDeletionQueue& s_deletion, uint64_t frame);
+    void createOffscreenTargets(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sSwapchain& s_swapchain);
+    void destroyOffscreenTargets(scg::sDevice& s_device, scg::sSwapchain& s_swapchain);
 }
 
 void scg::createSwapchain(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sSwapchain& s_swapchain) {
+    SCG_FUNCTION_ZONE();
     scg::SwapchainSupportDetails swapchainSupport = scg::querySwapchainSupport(s_device.physicalDevice, s_inst.surface);
 
     VkSurfaceFormatKHR surfaceFormat = scg::chooseSwapSurfaceFormat(swapchainSupport.formats);
-    VkPresentModeKHR presentMode = scg::chooseSwapPresentMode(swapchainSupport.presentModes);
+    VkPresentModeKHR presentMode = scg::chooseSwapPresentMode(swapchainSupport.presentModes, s_inst.presentMode);
     VkExtent2D extent = scg::chooseSwapExtent(s_inst, swapchainSupport.capabilities);
 
+    // fewer images queue fewer frames ahead of the display, more keep MAILBOX from ever blocking
     uint32_t imageCount = swapchainSupport.capabilities.minImageCount + 1;
+    if (s_inst.swapchainImageCount != 0) {
+        imageCount = std::max(s_inst.swapchainImageCount, swapchainSupport.capabilities.minImageCount);
+    }
     if (swapchainSupport.capabilities.maxImageCount > 0 && imageCount > swapchainSupport.capabilities.maxImageCount) {
         imageCount = swapchainSupport.capabilities.maxImageCount;
     }
@@ -43,7 +56,7 @@ void scg::createSwapchain(scg::sInstance& s_inst, scg::sDevice& s_device, scg::s
     createInfo.imageArrayLayers = 1;
     createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
-    QueueFamilyIndices indices = scg::findQueueFamilies(s_device.physicalDevice, s_inst.surface);
+    QueueFamilyIndices indices = s_device.caps.queueIndices;
     uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
 
     if (indices.graphicsFamily != indices.presentFamily) {
@@ -58,6 +71,8 @@ void scg::createSwapchain(scg::sInstance& s_inst, scg::sDevice& s_device, scg::s
     createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     createInfo.presentMode = presentMode;
     createInfo.clipped = VK_TRUE;
+    // the current swapchain, if any, is retired by the new one and can keep presenting its last frames
+    createInfo.oldSwapchain = s_swapchain.swapchain;
 
     if (vkCreateSwapchainKHR(s_device.device, &createInfo, nullptr, &(s_swapchain.swapchain)) != VK_SUCCESS) {
         throw std::runtime_error("failed to create swap chain!");
@@ -69,6 +84,9 @@ void scg::createSwapchain(scg::sInstance& s_inst, scg::sDevice& s_device, scg::s
 
     s_swapchain.swapchainImageFormat = surfaceFormat.format;
     s_swapchain.swapchainExtent = extent;
+    s_swapchain.presentMode = presentMode;
+
+    std::cout << "swapchain: " << imageCount << " images, " << scg::presentModeName(presentMode) << std::endl;
 }
 
 VkSurfaceFormatKHR scg::chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats) {
@@ -81,16 +99,40 @@ VkSurfaceFormatKHR scg::chooseSwapSurfaceFormat(const std::vector<VkSurfaceForma
     return availableFormats[0];
 }
 
-VkPresentModeKHR scg::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) {
-    for (const auto& availablePresentMode : availablePresentModes) {
-        if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-            return availablePresentMode;
+// IMMEDIATE falls back to MAILBOX, which is the next lowest latency, and everything ends at FIFO,
+// the only mode every surface has to support
+VkPresentModeKHR scg::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes, VkPresentModeKHR preferred) {
+    std::vector<VkPresentModeKHR> candidates = {preferred};
+    if (preferred == VK_PRESENT_MODE_IMMEDIATE_KHR) {
+        candidates.push_back(VK_PRESENT_MODE_MAILBOX_KHR);
+    }
+
+    for (auto candidate : candidates) {
+        for (const auto& availablePresentMode : availablePresentModes) {
+            if (availablePresentMode == candidate) {
+                return availablePresentMode;
+            }
         }
     }
 
     return VK_PRESENT_MODE_FIFO_KHR;
 }
 
+const char* scg::presentModeName(VkPresentModeKHR presentMode) {
+    switch (presentMode) {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+        return "immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+        return "mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR:
+        return "fifo";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+        return "fifo-relaxed";
+    default:
+        return "unknown";
+    }
+}
+
 VkExtent2D scg::chooseSwapExtent(scg::sInstance& s_inst, const VkSurfaceCapabilitiesKHR& capabilities) {
     if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
         return capabilities.currentExtent;
@@ -131,9 +173,56 @@ VkImageView scg::createImageView(scg::sDevice& s_device, VkImage image, VkFormat
 }
 
 void scg::createImageViews(scg::sDevice& s_device, scg::sSwapchain& s_swapchain) {
+    SCG_FUNCTION_ZONE();
     s_swapchain.swapchainImageViews.resize(s_swapchain.swapchainImages.size());
 
     for (uint32_t i = 0; i < s_swapchain.swapchainImages.size(); i++) {
         s_swapchain.swapchainImageViews[i] = createImageView(s_device, s_swapchain.swapchainImages[i], s_swapchain.swapchainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
     }
 }
+
+// Frames in flight may still render to or present from the old images. Presentation is not
+// tracked by the timeline, so the old swapchain goes with the submission after its last frame.
+void scg::retireSwapchain(scg::sDevice& s_device, const scg::sSwapchain& s_old, scg::sDeletionQueue& s_deletion, uint64_t frame) {
+    VkDevice device = s_device.device;
+    VkSwapchainKHR swapchain = s_old.swapchain;
+    std::vector<VkImageView> imageViews = s_old.swapchainImageViews;
+    scg::deferDeletion(s_deletion, frame, [device, swapchain, imageViews]() {
+        for (auto imageView : imageViews) {
+            vkDestroyImageView(device, imageView, nullptr);
+        }
+        vkDestroySwapchainKHR(device, swapchain, nullptr);
+    });
+}
+
+// Headless the swapchain images are plain device local images, one per frame in flight so a frame
+// never has to wait for another one's image. They end up ready to be copied out instead of presented.
+void scg::createOffscreenTargets(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sSwapchain& s_swapchain) {
+    SCG_FUNCTION_ZONE();
+    s_swapchain.swapchain = VK_NULL_HANDLE;
+    s_swapchain.swapchainImageFormat = VK_FORMAT_B8G8R8A8_SRGB;
+    s_swapchain.swapchainExtent = {s_inst.width, s_inst.height};
+    s_swapchain.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+    s_swapchain.swapchainImages.resize(s_inst.maxFramesInFlight);
+    s_swapchain.offscreenMemory.resize(s_inst.maxFramesInFlight);
+    for (size_t i = 0; i < s_swapchain.swapchainImages.size(); i++) {
+        scg::createImage(s_device, s_inst.width, s_inst.height, s_swapchain.swapchainImageFormat, VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            s_swapchain.swapchainImages[i], s_swapchain.offscreenMemory[i]);
+    }
+    scg::createImageViews(s_device, s_swapchain);
+
+    std::cout << "rendering headless to " << s_swapchain.swapchainImages.size() << " offscreen images of " << s_inst.width << "x" << s_inst.height << std::endl;
+}
+
+void scg::destroyOffscreenTargets(scg::sDevice& s_device, scg::sSwapchain& s_swapchain) {
+    for (size_t i = 0; i < s_swapchain.swapchainImages.size(); i++) {
+        vkDestroyImageView(s_device.device, s_swapchain.swapchainImageViews[i], nullptr);
+        vkDestroyImage(s_device.device, s_swapchain.swapchainImages[i], nullptr);
+        vkFreeMemory(s_device.device, s_swapchain.offscreenMemory[i], nullptr);
+    }
+    s_swapchain.swapchainImageViews.clear();
+    s_swapchain.swapchainImages.clear();
+    s_swapchain.offscreenMemory.clear();
+}
@@ -5,17 +5,33 @@
 
 #include <vector>
 #include <stdexcept>
+#include <algorithm>
 
 #include "container.h"
+#include "zones.h"
 
+// Frames in flight are tracked with the graphics queue's timeline: a frame is done once the counter
+// reaches the value its submission signals. Uploads and deferred deletions key off the same counter.
 namespace scg {
     void createSynchObjects(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sSynch& s_synch);
+    uint64_t getPendingTimelineValue(scg::sDevice& s_device);
+    uint64_t getCompletedTimelineValue(scg::sDevice& s_device);
+    void waitTimelineValue(scg::sDevice& s_device, uint64_t value);
+    void waitForFrame(scg::sDevice& s_device, scg::sSynch& s_synch, uint32_t frame);
+    bool isFrameComplete(scg::sDevice& s_device, scg::sSynch& s_synch, uint32_t frame);
+    void submitFrame(scg::sDevice& s_device, scg::sSynch& s_synch, uint32_t frame, VkCommandBuffer commandBuffer, VkSemaphore cullSemaphore);
+    void submitAndWait(scg::sDevice& s_device, VkCommandBuffer commandBuffer);
+    void getLayoutAccess(VkImageLayout layout, VkPipelineStageFlags& stages, VkAccessFlags& access);
+    VkAccessFlags writeAccessMask(VkAccessFlags access);
 }
 
 void scg::createSynchObjects(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sSynch& s_synch) {
+    SCG_FUNCTION_ZONE();
+    s_synch.presenting = !s_inst.headless;
     s_synch.imageAvailableSemaphores.resize(s_inst.maxFramesInFlight);
     s_synch.renderFinishedSemaphores.resize(s_inst.maxFramesInFlight);
-    s_synch.inFlightFences.resize(s_inst.maxFramesInFlight);
+    s_synch.inFlightFences.resize(s_inst.maxFramesInFlight, VK_NULL_HANDLE);
+    s_synch.frameTimelineValues.assign(s_inst.maxFramesInFlight, 0);
 
     VkSemaphoreCreateInfo semaphoreInfo{};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -26,10 +42,204 @@ void scg::createSynchObjects(scg::sInstance& s_inst, scg::sDevice& s_device, scg
 
     for (size_t i = 0; i < s_inst.maxFramesInFlight; i++) {
         if (vkCreateSemaphore(s_device.device, &semaphoreInfo, nullptr, &(s_synch.imageAvailableSemaphores[i])) != VK_SUCCESS ||
-                vkCreateSemaphore(s_device.device, &semaphoreInfo, nullptr, &(s_synch.renderFinishedSemaphores[i])) != VK_SUCCESS ||
-                vkCreateFence(s_device.device, &fenceInfo, nullptr, &(s_synch.inFlightFences[i])) != VK_SUCCESS) {
+                vkCreateSemaphore(s_device.device, &semaphoreInfo, nullptr, &(s_synch.renderFinishedSemaphores[i])) != VK_SUCCESS) {
             throw std::runtime_error("failed to create synchronization objects for a frame!");
         }
+        if (!s_device.timelineSemaphore && vkCreateFence(s_device.device, &fenceInfo, nullptr, &(s_synch.inFlightFences[i])) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create synchronization objects for a frame!");
+        }
+    }
+}
+
+// the value the next submission will signal, resources retired now are free once it completes
+uint64_t scg::getPendingTimelineValue(scg::sDevice& s_device) {
+    return s_device.graphicsTimelineValue + 1;
+}
+
+uint64_t scg::getCompletedTimelineValue(scg::sDevice& s_device) {
+    if (s_device.timelineSemaphore) {
+        uint64_t value = 0;
+        s_device.getSemaphoreCounterValue(s_device.device, s_device.graphicsTimeline, &value);
+        s_device.completedTimelineValue = std::max(s_device.completedTimelineValue, value);
+    }
+    return s_device.completedTimelineValue;
+}
+
+// only for timeline semaphores, the fence path learns completion in scg::waitForFrame
+void scg::waitTimelineValue(scg::sDevice& s_device, uint64_t value) {
+    VkSemaphoreWaitInfoKHR waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &(s_device.graphicsTimeline);
+    waitInfo.pValues = &value;
+
+    if (s_device.waitSemaphores(s_device.device, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+        throw std::runtime_error("failed to wait for the graphics timeline!");
+    }
+    s_device.completedTimelineValue = std::max(s_device.completedTimelineValue, value);
+}
+
+void scg::waitForFrame(scg::sDevice& s_device, scg::sSynch& s_synch, uint32_t frame) {
+    if (s_device.timelineSemaphore) {
+        scg::waitTimelineValue(s_device, s_synch.frameTimelineValues[frame]);
+        return;
+    }
+    vkWaitForFences(s_device.device, 1, &(s_synch.inFlightFences[frame]), VK_TRUE, UINT64_MAX);
+    s_device.completedTimelineValue = std::max(s_device.completedTimelineValue, s_synch.frameTimelineValues[frame]);
+}
+
+bool scg::isFrameComplete(scg::sDevice& s_device, scg::sSynch& s_synch, uint32_t frame) {
+    if (s_device.timelineSemaphore) {
+        return scg::getCompletedTimelineValue(s_device) >= s_synch.frameTimelineValues[frame];
+    }
+    if (vkGetFenceStatus(s_device.device, s_synch.inFlightFences[frame]) != VK_SUCCESS) {
+        return false;
+    }
+    s_device.completedTimelineValue = std::max(s_device.completedTimelineValue, s_synch.frameTimelineValues[frame]);
+    return true;
+}
+
+// waits on the frame's acquire semaphore and signals its present semaphore next to the timeline,
+// with culling on the compute queue the indirect draws also wait for the culled commands
+void scg::submitFrame(scg::sDevice& s_device, scg::sSynch& s_synch, uint32_t frame, VkCommandBuffer commandBuffer, VkSemaphore cullSemaphore) {
+    uint64_t signalValue = ++(s_device.graphicsTimelineValue);
+    s_synch.frameTimelineValues[frame] = signalValue;
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+    // headless frames render into images nobody else touches, so there is nothing to wait on
+    std::vector<VkSemaphore> waitSemaphores;
+    std::vector<VkPipelineStageFlags> waitStages;
+    if (s_synch.presenting) {
+        waitSemaphores.push_back(s_synch.imageAvailableSemaphores[frame]);
+        waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+    }
+    if (cullSemaphore != VK_NULL_HANDLE) {
+        waitSemaphores.push_back(cullSemaphore);
+        waitStages.push_back(VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+    }
+    submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+    submitInfo.pWaitDstStageMask = waitStages.data();
+
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    // binary semaphores ignore their values
+    std::vector<VkSemaphore> signalSemaphores;
+    std::vector<uint64_t> signalValues;
+    if (s_synch.presenting) {
+        signalSemaphores.push_back(s_synch.renderFinishedSemaphores[frame]);
+        signalValues.push_back(0);
+    }
+    if (s_device.timelineSemaphore) {
+        signalSemaphores.push_back(s_device.graphicsTimeline);
+        signalValues.push_back(signalValue);
+    }
+    submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+    submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+    std::vector<uint64_t> waitValues(waitSemaphores.size(), 0);
+    VkTimelineSemaphoreSubmitInfoKHR timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+    timelineInfo.waitSemaphoreValueCount = submitInfo.waitSemaphoreCount;
+    timelineInfo.pWaitSemaphoreValues = waitValues.data();
+    timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+    timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+    VkFence fence = VK_NULL_HANDLE;
+    if (s_device.timelineSemaphore) {
+        submitInfo.pNext = &timelineInfo;
+    } else {
+        fence = s_synch.inFlightFences[frame];
+        vkResetFences(s_device.device, 1, &fence);
+    }
+
+    if (vkQueueSubmit(s_device.graphicsQueue, 1, &submitInfo, fence) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit draw command buffer!");
+    }
+}
+
+// one off work such as uploads, waits for exactly its own timeline value instead of the whole queue
+void scg::submitAndWait(scg::sDevice& s_device, VkCommandBuffer commandBuffer) {
+    uint64_t signalValue = ++(s_device.graphicsTimelineValue);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    VkTimelineSemaphoreSubmitInfoKHR timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+    if (s_device.timelineSemaphore) {
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &(s_device.graphicsTimeline);
+    }
+
+    if (vkQueueSubmit(s_device.graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit one time commands!");
+    }
+
+    if (s_device.timelineSemaphore) {
+        scg::waitTimelineValue(s_device, signalValue);
+    } else {
+        vkQueueWaitIdle(s_device.graphicsQueue);
+        s_device.completedTimelineValue = signalValue;
+    }
+}
+
+
+// the stages and accesses an image is used with while it sits in a given layout
+void scg::getLayoutAccess(VkImageLayout layout, VkPipelineStageFlags& stages, VkAccessFlags& access) {
+    switch (layout) {
+        case VK_IMAGE_LAYOUT_UNDEFINED:
+            stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+            access = 0;
+            break;
+        case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+            stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+            access = VK_ACCESS_TRANSFER_WRITE_BIT;
+            break;
+        case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+            stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+            access = VK_ACCESS_TRANSFER_READ_BIT;
+            break;
+        case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+            stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+            access = VK_ACCESS_SHADER_READ_BIT;
+            break;
+        case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+            stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            access = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            break;
+        case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+            stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+            access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+            break;
+        case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+            stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+            access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+            break;
+        case VK_IMAGE_LAYOUT_GENERAL:
+            stages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+            access = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+            break;
+        case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+            stages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+            access = 0;
+            break;
+        default:
+            throw std::invalid_argument("unsupported image layout!");
     }
 }
 
+// only writes need to be made available, reads just have to finish before whatever follows
+VkAccessFlags scg::writeAccessMask(VkAccessFlags access) {
+    return access & (VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+            VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT);
+}
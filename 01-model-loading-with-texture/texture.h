@@ -10,18 +10,21 @@
 
 #include "helper.h"
 #include "container.h"
+#include "zones.h"
 #include "buffer.h"
 #include "swapchain.h"
 
 namespace scg {
     void createTextureImage(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sCommand& s_command, scg::sTexture& s_texture);
+    void loadTextureImage(scg::sDevice& s_device, scg::sCommand& s_command, const std::string& path, VkImage& image, VkDeviceMemory& imageMemory);
+    void createTextureImageFromPixels(scg::sDevice& s_device, scg::sCommand& s_command, const unsigned char* pixels, uint32_t width, uint32_t height, VkImage& image, VkDeviceMemory& imageMemory);
     void createTextureImageView(scg::sDevice& s_device, scg::sTexture& s_texture);
     void createTextureSampler(scg::sDevice& s_device, scg::sTexture& s_texture);
 }
 
 void scg::createTextureSampler(scg::sDevice& s_device, scg::sTexture& s_texture) {
-    VkPhysicalDeviceProperties properties{};
-    vkGetPhysicalDeviceProperties(s_device.physicalDevice, &properties);
+    SCG_FUNCTION_ZONE();
+    const VkPhysicalDeviceProperties& properties = s_device.caps.properties;
 
     VkSamplerCreateInfo samplerInfo{};
     samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -44,16 +47,32 @@ void scg::createTextureSampler(scg::sDevice& s_device, scg::sTexture& s_texture)
 }
 
 void scg::createTextureImageView(scg::sDevice& s_device, scg::sTexture& s_texture) {
+    SCG_FUNCTION_ZONE();
     s_texture.textureImageView = scg::createImageView(s_device, s_texture.textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
 }
 
 void scg::createTextureImage(scg::sInstance& s_inst, scg::sDevice& s_device, scg::sCommand& s_command, scg::sTexture& s_texture) {
+    SCG_FUNCTION_ZONE();
+    scg::loadTextureImage(s_device, s_command, s_inst.texturePath, s_texture.textureImage, s_texture.textureImageMemory);
+}
+
+void scg::loadTextureImage(scg::sDevice& s_device, scg::sCommand& s_command, const std::string& path, VkImage& image, VkDeviceMemory& imageMemory) {
+    SCG_FUNCTION_ZONE();
     int texWidth, texHeight, texChannels;
-    stbi_uc* pixels = stbi_load(s_inst.texturePath.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-    VkDeviceSize imageSize = texWidth * texHeight * 4;
+    stbi_uc* pixels = stbi_load(path.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
     if (!pixels) {
-        throw std::runtime_error("failed to load texture image!");
+        throw std::runtime_error("failed to load texture image " + path + "!");
     }
+
+    scg::createTextureImageFromPixels(s_device, s_command, pixels, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), image, imageMemory);
+
+    stbi_image_free(pixels);
+}
+
+// pixels are tightly packed RGBA8
+void scg::createTextureImageFromPixels(scg::sDevice& s_device, scg::sCommand& s_command, const unsigned char* pixels, uint32_t width, uint32_t height, VkImage& image, VkDeviceMemory& imageMemory) {
+    SCG_FUNCTION_ZONE();
+    VkDeviceSize imageSize = static_cast<VkDeviceSize>(width) * height * 4;
     VkBuffer stagingBuffer;
     VkDeviceMemory stagingBufferMemory;
     scg::createBuffer(s_device, imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
@@ -63,12 +82,11 @@ void scg::createTextureImage(scg::sInstance& s_inst, scg::sDevice& s_device, scg
         memcpy(data, pixels, static_cast<size_t>(imageSize));
     vkUnmapMemory(s_device.device, stagingBufferMemory);
     
-    stbi_image_free(pixels);
-    scg::createImage(s_device, texWidth, texHeight, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, s_texture.textureImage, s_texture.textureImageMemory);
+    scg::createImage(s_device, width, height, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, imageMemory);
     
-    transitionImageLayout(s_device, s_command, s_texture.textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    scg::copyBufferToImage(s_device, s_command, stagingBuffer, s_texture.textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
-    transitionImageLayout(s_device, s_command, s_texture.textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    transitionImageLayout(s_device, s_command, image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    scg::copyBufferToImage(s_device, s_command, stagingBuffer, image, width, height);
+    transitionImageLayout(s_device, s_command, image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     
     vkDestroyBuffer(s_device.device, stagingBuffer, nullptr);
     vkFreeMemory(s_device.device, stagingBufferMemory, nullptr);
@@ -0,0 +1,90 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+#include "container.h"
+
+// Collects complete events ("ph":"X") on named tracks and writes them in the Chrome trace event
+// format, which chrome://tracing and Perfetto open directly. Every track shows up as a thread of
+// one process, so CPU and GPU work line up on the same time axis.
+namespace scg {
+    void createTrace(scg::sInstance& s_inst, scg::sTrace& s_trace);
+    uint32_t addTraceTrack(scg::sTrace& s_trace, const std::string& name);
+    double traceMicroseconds(scg::sTrace& s_trace, std::chrono::steady_clock::time_point time);
+    void addTraceEvent(scg::sTrace& s_trace, const std::string& name, const std::string& category, uint32_t track, double startUs, double durationUs);
+    std::string escapeJson(const std::string& text);
+    void writeTrace(scg::sTrace& s_trace);
+}
+
+void scg::createTrace(scg::sInstance& s_inst, scg::sTrace& s_trace) {
+    s_trace.enabled = !s_inst.tracePath.empty();
+    s_trace.path = s_inst.tracePath;
+    s_trace.origin = std::chrono::steady_clock::now();
+}
+
+uint32_t scg::addTraceTrack(scg::sTrace& s_trace, const std::string& name) {
+    std::lock_guard<std::mutex> lock(s_trace.mutex);
+    s_trace.trackNames.push_back(name);
+    return static_cast<uint32_t>(s_trace.trackNames.size() - 1);
+}
+
+double scg::traceMicroseconds(scg::sTrace& s_trace, std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration<double, std::micro>(time - s_trace.origin).count();
+}
+
+void scg::addTraceEvent(scg::sTrace& s_trace, const std::string& name, const std::string& category, uint32_t track, double startUs, double durationUs) {
+    if (!s_trace.enabled) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(s_trace.mutex);
+    s_trace.events.push_back({name, category, track, startUs, durationUs});
+}
+
+std::string scg::escapeJson(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+void scg::writeTrace(scg::sTrace& s_trace) {
+    if (!s_trace.enabled) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(s_trace.mutex);
+
+    std::ofstream file(s_trace.path, std::ios::trunc);
+    if (!file.is_open()) {
+        std::cout << "failed to open " << s_trace.path << " for writing" << std::endl;
+        return;
+    }
+
+    // the track names go first as metadata events, so the viewer labels the rows
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    const char* separator = "\n";
+    for (uint32_t track = 0; track < s_trace.trackNames.size(); track++) {
+        file << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << track << ",\"args\":{\"name\":\"" << scg::escapeJson(s_trace.trackNames[track]) << "\"}}";
+        separator = ",\n";
+    }
+    file << std::fixed;
+    for (const auto& event : s_trace.events) {
+        file << separator << "{\"name\":\"" << scg::escapeJson(event.name) << "\",\"cat\":\"" << event.category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.track
+            << ",\"ts\":" << event.startUs << ",\"dur\":" << event.durationUs << "}";
+        separator = ",\n";
+    }
+    file << "\n]}\n";
+
+    std::cout << "wrote " << s_trace.events.size() << " trace events to " << s_trace.path << std::endl;
+}
@@ -10,9 +10,15 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/hash.hpp>
 
+#include <array>
+#include <cmath>
+
 namespace scg {
     VkVertexInputBindingDescription getBindingDescription();
     std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions();
+    VkVertexInputBindingDescription getPositionBindingDescription();
+    VkVertexInputAttributeDescription getPositionAttributeDescription();
+    glm::mat4 reversedInfinitePerspective(float fovy, float aspect, float zNear);
 }
 
 VkVertexInputBindingDescription scg::getBindingDescription() {
@@ -45,3 +51,35 @@ std::array<VkVertexInputAttributeDescription, 3> scg::getAttributeDescriptions()
     return attributeDescriptions;
 }
 
+VkVertexInputBindingDescription scg::getPositionBindingDescription() {
+    VkVertexInputBindingDescription bindingDescription{};
+    bindingDescription.binding = 0;
+    bindingDescription.stride = sizeof(glm::vec3);
+    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    return bindingDescription;
+}
+
+VkVertexInputAttributeDescription scg::getPositionAttributeDescription() {
+    VkVertexInputAttributeDescription attributeDescription{};
+    attributeDescription.binding = 0;
+    attributeDescription.location = 0;
+    attributeDescription.format = VK_FORMAT_R32G32B32_SFLOAT;
+    attributeDescription.offset = 0;
+
+    return attributeDescription;
+}
+
+// Right handed projection mapping the near plane to depth 1 and infinity to 0. Floating point
+// depth is densest near 0, which reversing spends on the far range where a [0, 1] mapping has
+// almost no precision left.
+glm::mat4 scg::reversedInfinitePerspective(float fovy, float aspect, float zNear) {
+    float f = 1.0f / std::tan(fovy / 2.0f);
+
+    glm::mat4 proj(0.0f);
+    proj[0][0] = f / aspect;
+    proj[1][1] = f;
+    proj[2][3] = -1.0f;
+    proj[3][2] = zNear;
+    return proj;
+}
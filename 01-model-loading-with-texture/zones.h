@@ -0,0 +1,132 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <iostream>
+
+#include "container.h"
+#include "trace.h"
+
+// Scoped CPU zones. A zone takes a steady_clock timestamp when it opens and appends one event to
+// a buffer owned by the calling thread when it closes, so recording never takes a lock and threads
+// never share a cache line. Buffers have a fixed capacity and drop what does not fit. Nothing is
+// recorded until a trace is requested, and building with -DSCG_DISABLE_ZONES (make build NO_ZONES=1)
+// removes the zones from the code altogether. The names have to be string literals, only the
+// pointer is stored.
+#ifdef SCG_DISABLE_ZONES
+#define SCG_ZONE(name)
+#define SCG_FUNCTION_ZONE()
+#else
+#define SCG_ZONE_CONCAT_INNER(a, b) a##b
+#define SCG_ZONE_CONCAT(a, b) SCG_ZONE_CONCAT_INNER(a, b)
+#define SCG_ZONE(name) scg::sZone SCG_ZONE_CONCAT(zone, __LINE__)(name)
+#define SCG_FUNCTION_ZONE() SCG_ZONE(__func__)
+#endif
+
+namespace scg {
+    struct sZone {
+        const char* name;
+        int64_t startNs;
+
+        sZone(const char* name);
+        ~sZone();
+    };
+
+    scg::sZoneRegistry& zoneRegistry();
+    scg::sZoneBuffer& threadZoneBuffer();
+    int64_t zoneNow();
+    void enableZones(scg::sTrace& s_trace);
+    void nameZoneThread(const std::string& name);
+    void collectZones(scg::sTrace& s_trace);
+}
+
+scg::sZone::sZone(const char* name) {
+    if (!scg::zoneRegistry().enabled.load(std::memory_order_relaxed)) {
+        this->name = nullptr;
+        return;
+    }
+    this->name = name;
+    startNs = scg::zoneNow();
+}
+
+scg::sZone::~sZone() {
+    if (name == nullptr) {
+        return;
+    }
+    int64_t endNs = scg::zoneNow();
+
+    scg::sZoneBuffer& buffer = scg::threadZoneBuffer();
+    uint32_t index = buffer.count.load(std::memory_order_relaxed);
+    if (index >= buffer.events.size()) {
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer.events[index] = {name, startNs, endNs};
+    buffer.count.store(index + 1, std::memory_order_release);
+}
+
+scg::sZoneRegistry& scg::zoneRegistry() {
+    static scg::sZoneRegistry registry;
+    return registry;
+}
+
+// the buffers belong to the registry, so they outlive the threads that wrote them
+scg::sZoneBuffer& scg::threadZoneBuffer() {
+    thread_local scg::sZoneBuffer* buffer = nullptr;
+    if (buffer == nullptr) {
+        scg::sZoneRegistry& registry = scg::zoneRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.buffers.push_back(std::make_unique<scg::sZoneBuffer>());
+        buffer = registry.buffers.back().get();
+        buffer->threadName = "thread " + std::to_string(registry.buffers.size());
+        buffer->events.resize(registry.capacity);
+    }
+    return *buffer;
+}
+
+int64_t scg::zoneNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void scg::enableZones(scg::sTrace& s_trace) {
+    scg::zoneRegistry().enabled.store(s_trace.enabled, std::memory_order_relaxed);
+}
+
+// the name the thread's track gets in the trace
+void scg::nameZoneThread(const std::string& name) {
+    scg::sZoneBuffer& buffer = scg::threadZoneBuffer();
+    std::lock_guard<std::mutex> lock(scg::zoneRegistry().mutex);
+    buffer.threadName = name;
+}
+
+// threads may still be recording, only the events they have published are taken
+void scg::collectZones(scg::sTrace& s_trace) {
+    scg::sZoneRegistry& registry = scg::zoneRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    uint32_t dropped = 0;
+    for (auto& buffer : registry.buffers) {
+        uint32_t count = buffer->count.load(std::memory_order_acquire);
+        dropped += buffer->dropped.load(std::memory_order_relaxed);
+        if (count == 0) {
+            continue;
+        }
+
+        uint32_t track = scg::addTraceTrack(s_trace, buffer->threadName);
+        for (uint32_t i = 0; i < count; i++) {
+            const scg::sZoneEvent& event = buffer->events[i];
+            auto start = std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(event.startNs)));
+            scg::addTraceEvent(s_trace, event.name, "cpu", track, scg::traceMicroseconds(s_trace, start), (event.endNs - event.startNs) / 1000.0);
+        }
+    }
+
+    if (dropped != 0) {
+        std::cout << "zone buffers were full, dropped " << dropped << " zones" << std::endl;
+    }
+}